@@ -0,0 +1,371 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro and Maximilian Strobl.
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* ========== Checkpoint.c - save and restore the state of Anneal() ========== */
+
+/*
+
+A checkpoint holds everything Anneal() needs to carry on exactly where it
+was: its scalars and random number generator (Checkpoint_state), the
+current tree and the best trees found so far. Statesets are not saved, as
+they follow from the topology. Numbers are written as they are held in
+memory, so a checkpoint is only good for the same build of LVB on the same
+kind of computer, and only for the same data. The seed and the options that
+change the course of the search are saved too, and put back in place of
+any given when the search resumes.
+
+Anneal() only copies the state into a buffer. The best trees already
+copied for the last checkpoint are kept, so only those stored since then
+are copied, or read back from the spill file, unless the stack has lost
+trees or had them replaced or moved in the meantime. A separate thread
+writes the buffers to a temporary file and renames that over the
+checkpoint file, so that the file always holds a whole checkpoint. If the
+last checkpoint is still being written when the next is due, the next is
+put off.
+
+*/
+
+#include "Checkpoint.h"
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC "LVBCKPT2" /* first bytes of a checkpoint file */
+#define CHECKPOINT_MAGIC_BYTES 8	/* bytes of CHECKPOINT_MAGIC, without its terminator */
+
+typedef struct /* checkpoint in memory */
+{
+	unsigned char *data; /* contents */
+	size_t used;		 /* bytes of data in use */
+	size_t size;		 /* bytes allocated for data */
+} Checkpoint_buffer;
+
+static Checkpoint_buffer pending = {NULL, 0, 0}; /* checkpoint being written, up to its best trees */
+static Checkpoint_buffer stack_trees = {NULL, 0, 0}; /* best trees of checkpoint being written */
+static Checkpoint_buffer pending_end = {NULL, 0, 0}; /* rest of checkpoint being written */
+static const TREESTACK *stack_copied = NULL;		  /* stack whose trees are in stack_trees */
+static long stack_copied_n = 0;						  /* trees in stack_trees */
+static long stack_copied_changes = 0;				  /* changes to stack_copied when they were copied */
+static char pending_file[LVB_FNAMSIZE];			  /* where pending is going */
+static pthread_t writer;						  /* thread writing pending */
+static Lvb_bool writer_started = LVB_FALSE;		  /* writer not joined yet */
+static int writer_done = 0;						  /* writer has finished */
+
+static void put(Checkpoint_buffer *buf, const void *p, size_t bytes)
+/* append bytes bytes from p to buf */
+{
+	if (buf->used + bytes > buf->size)
+	{
+		buf->size = 2 * (buf->used + bytes);
+		buf->data = (unsigned char *)realloc(buf->data, buf->size);
+		if (buf->data == NULL)
+			crash("out of memory: cannot increase allocation for checkpoint to %lu bytes", (unsigned long)buf->size);
+	}
+	memcpy(buf->data + buf->used, p, bytes);
+	buf->used += bytes;
+
+} /* end put() */
+
+static void get(FILE *fp, void *p, size_t bytes, const char *file_name)
+/* read bytes bytes from checkpoint file fp, named file_name, into p */
+{
+	if (fread(p, 1, bytes, fp) != bytes)
+		crash("checkpoint file '%s' is incomplete or unreadable", file_name);
+
+} /* end get() */
+
+static void put_options(Checkpoint_buffer *buf, const Parameters *prms)
+/* append the seed and the options of *prms that change the course of the
+ * search to buf */
+{
+	put(buf, &prms->seed, sizeof(int));
+	put(buf, &prms->cooling_schedule, sizeof(int));
+	put(buf, &prms->algorithm_selection, sizeof(int));
+	put(buf, &prms->rng, sizeof(int));
+	put(buf, &prms->n_number_max_trees, sizeof(int));
+	put(buf, &prms->n_sample_trees, sizeof(long));
+	put(buf, &prms->treestack_memory, sizeof(long));
+	put(buf, &prms->compress_patterns, sizeof(Lvb_bool));
+	put(buf, &prms->indirect_scoring, sizeof(Lvb_bool));
+	put(buf, &prms->hillclimb, sizeof(int));
+	put(buf, &prms->batch_size, sizeof(int));
+
+} /* end put_options() */
+
+static void get_options(FILE *fp, Parameters *prms, const char *file_name)
+/* read the options written by put_options() from checkpoint file fp, named
+ * file_name, into *prms */
+{
+	get(fp, &prms->seed, sizeof(int), file_name);
+	get(fp, &prms->cooling_schedule, sizeof(int), file_name);
+	get(fp, &prms->algorithm_selection, sizeof(int), file_name);
+	get(fp, &prms->rng, sizeof(int), file_name);
+	get(fp, &prms->n_number_max_trees, sizeof(int), file_name);
+	get(fp, &prms->n_sample_trees, sizeof(long), file_name);
+	get(fp, &prms->treestack_memory, sizeof(long), file_name);
+	get(fp, &prms->compress_patterns, sizeof(Lvb_bool), file_name);
+	get(fp, &prms->indirect_scoring, sizeof(Lvb_bool), file_name);
+	get(fp, &prms->hillclimb, sizeof(int), file_name);
+	get(fp, &prms->batch_size, sizeof(int), file_name);
+
+} /* end get_options() */
+
+static FILE *open_checkpoint(const char *file_name)
+/* return checkpoint file file_name, open for reading after its first bytes */
+{
+	char magic[CHECKPOINT_MAGIC_BYTES]; /* first bytes of file */
+	FILE *fp;							/* checkpoint file */
+
+	fp = fopen(file_name, "rb");
+	if (fp == NULL)
+		crash("cannot open checkpoint file '%s' to resume the search", file_name);
+	get(fp, magic, CHECKPOINT_MAGIC_BYTES, file_name);
+	if (memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_BYTES) != 0)
+		crash("'%s' is not an LVB checkpoint file of this version", file_name);
+	return fp;
+
+} /* end open_checkpoint() */
+
+static void put_tree(Dataptr MSA, Checkpoint_buffer *buf, const TREESTACK_TREE_NODES *const tree)
+/* append the topology of tree to buf */
+{
+	long i; /* loop counter */
+
+	for (i = 0; i < MSA->numberofpossiblebranches; i++)
+	{
+		put(buf, &tree[i].parent, sizeof(long));
+		put(buf, &tree[i].left, sizeof(long));
+		put(buf, &tree[i].right, sizeof(long));
+	}
+
+} /* end put_tree() */
+
+static void get_tree(Dataptr MSA, FILE *fp, TREESTACK_TREE_NODES *const tree, const char *file_name)
+/* read a topology from checkpoint file fp, named file_name, into tree,
+ * leaving its stateset arrays alone */
+{
+	long i; /* loop counter */
+
+	for (i = 0; i < MSA->numberofpossiblebranches; i++)
+	{
+		get(fp, &tree[i].parent, sizeof(long), file_name);
+		get(fp, &tree[i].left, sizeof(long), file_name);
+		get(fp, &tree[i].right, sizeof(long), file_name);
+		if ((tree[i].left < UNSET) || (tree[i].left >= MSA->numberofpossiblebranches)
+			|| (tree[i].right < UNSET) || (tree[i].right >= MSA->numberofpossiblebranches))
+			crash("checkpoint file '%s' is corrupt", file_name);
+	}
+
+} /* end get_tree() */
+
+static void *checkpoint_write(void *arg)
+/* thread writing pending, stack_trees and pending_end to pending_file,
+ * through a temporary file */
+{
+	char tmp_file[LVB_FNAMSIZE + 4]; /* temporary file */
+	FILE *fp;						 /* temporary file */
+
+	(void)arg; /* all is in the buffers */
+	sprintf(tmp_file, "%s.tmp", pending_file);
+	fp = fopen(tmp_file, "wb");
+	if (fp == NULL)
+		crash("cannot open checkpoint file '%s' for writing", tmp_file);
+	if ((fwrite(pending.data, 1, pending.used, fp) != pending.used) ||
+		(fwrite(stack_trees.data, 1, stack_trees.used, fp) != stack_trees.used) ||
+		(fwrite(pending_end.data, 1, pending_end.used, fp) != pending_end.used) || (fflush(fp) != 0) ||
+		(fsync(fileno(fp)) != 0))
+		crash("cannot write checkpoint file '%s'", tmp_file);
+	if (fclose(fp) != 0)
+		crash("cannot close checkpoint file '%s'", tmp_file);
+	if (rename(tmp_file, pending_file) != 0)
+		crash("cannot rename checkpoint file '%s' to '%s'", tmp_file, pending_file);
+	__atomic_store_n(&writer_done, 1, __ATOMIC_RELEASE);
+	return NULL;
+
+} /* end checkpoint_write() */
+
+Lvb_bool checkpoint_save(Dataptr MSA, Parameters rcstruct, const Checkpoint_state *state,
+						 const TREESTACK_TREE_NODES *const tree, const TREESTACK *sp)
+/* start writing a checkpoint of the search state in *state, current tree
+ * tree and best trees *sp to the checkpoint file of rcstruct, and return
+ * LVB_TRUE; or return LVB_FALSE, doing nothing, if the last checkpoint is
+ * still being written; best trees copied for the last checkpoint are used
+ * again while sp->changes shows the stack has only gained trees since */
+{
+	static TREESTACK_TREE_NODES *stack_tree = NULL; /* best tree, maybe from spill file */
+	long n_stack = CountTreestack(*sp);				/* best trees */
+	long root;										/* root of best tree */
+	long i;											/* loop counter */
+
+	if (writer_started == LVB_TRUE)
+	{
+		if (__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE) == 0)
+			return LVB_FALSE;
+		checkpoint_finish();
+	}
+
+	pending.used = 0;
+	put(&pending, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_BYTES);
+	put_options(&pending, &rcstruct);
+	put(&pending, &MSA->n, sizeof(long));
+	put(&pending, &MSA->m, sizeof(long));
+	put(&pending, state, sizeof(Checkpoint_state));
+	put_tree(MSA, &pending, tree);
+	put(&pending, &n_stack, sizeof(long));
+
+	/* copy only the best trees stored since the last checkpoint, if the
+	 * ones before them are still there and in the same order */
+	if ((sp != stack_copied) || (sp->changes != stack_copied_changes) || (n_stack < stack_copied_n))
+	{
+		stack_trees.used = 0;
+		stack_copied = sp;
+		stack_copied_n = 0;
+		stack_copied_changes = sp->changes;
+	}
+	if (stack_tree == NULL)
+		stack_tree = treealloc(MSA, LVB_FALSE);
+	for (i = stack_copied_n; i < n_stack; i++)
+	{
+		root = GetTreeFromTreestack(MSA, sp, i, stack_tree);
+		put(&stack_trees, &root, sizeof(long));
+		put_tree(MSA, &stack_trees, stack_tree);
+	}
+	stack_copied_n = n_stack;
+
+	pending_end.used = 0;
+	if (sp->sample != NULL) /* trees found but not kept, and how to choose more */
+	{
+		long n_dropped = (long)sp->sample->dropped->size(); /* trees not kept */
+
+		put(&pending_end, sp->sample->rng, sizeof(Rng));
+		put(&pending_end, &n_dropped, sizeof(long));
+		for (const Lvb_fingerprint &fingerprint : *sp->sample->dropped)
+			put(&pending_end, &fingerprint, sizeof(Lvb_fingerprint));
+	}
+
+	strcpy(pending_file, rcstruct.file_name_checkpoint);
+	writer_done = 0;
+	if (pthread_create(&writer, NULL, checkpoint_write, NULL) != 0)
+		crash("cannot start thread to write checkpoint file '%s'", pending_file);
+	writer_started = LVB_TRUE;
+	return LVB_TRUE;
+
+} /* end checkpoint_save() */
+
+void checkpoint_finish(void)
+/* wait for any checkpoint still being written */
+{
+	if (writer_started == LVB_TRUE)
+	{
+		pthread_join(writer, NULL);
+		writer_started = LVB_FALSE;
+	}
+
+} /* end checkpoint_finish() */
+
+void checkpoint_options(Parameters *prms)
+/* put the seed and options that change the course of the search saved in
+ * the checkpoint file of *prms in place of those in *prms */
+{
+	FILE *fp = open_checkpoint(prms->file_name_checkpoint); /* checkpoint file */
+
+	get_options(fp, prms, prms->file_name_checkpoint);
+	fclose(fp);
+
+} /* end checkpoint_options() */
+
+void checkpoint_load(Dataptr MSA, Parameters rcstruct, Checkpoint_state *state, TREESTACK_TREE_NODES *const tree,
+					 TREESTACK *sp)
+/* read the checkpoint file of rcstruct, whose options must already be in
+ * rcstruct through checkpoint_options(), putting the search state in *state, the current tree in tree with its
+ * statesets marked "dirty", and the best trees in *sp in place of any there
+ * now */
+{
+	const char *file_name = rcstruct.file_name_checkpoint; /* checkpoint file */
+	Parameters made;									   /* options, already in rcstruct */
+	long n, m;											   /* size of data */
+	long stored;										   /* best trees in file */
+	long root;											   /* root of current best tree */
+	TREESTACK_TREE_NODES *stack_tree;					   /* current best tree */
+	FILE *fp;											   /* checkpoint file */
+	long i;												   /* loop counter */
+
+	fp = open_checkpoint(file_name);
+	get_options(fp, &made, file_name);
+	get(fp, &n, sizeof(long), file_name);
+	get(fp, &m, sizeof(long), file_name);
+	if ((n != MSA->n) || (m != MSA->m))
+		crash("checkpoint file '%s' is from a different search: the data must be as they were", file_name);
+	get(fp, state, sizeof(Checkpoint_state), file_name);
+	if (state->rng.kind != rcstruct.rng)
+		crash("checkpoint file '%s' is corrupt", file_name);
+
+	get_tree(MSA, fp, tree, file_name);
+	for (i = MSA->n; i < MSA->numberofpossiblebranches; i++)
+		tree[i].sitestate[0] = 0U; /* "dirty" */
+
+	ClearTreestack(sp);
+	stack_tree = treealloc(MSA, LVB_FALSE);
+	get(fp, &stored, sizeof(long), file_name);
+	for (i = 0; i < stored; i++)
+	{
+		get(fp, &root, sizeof(long), file_name);
+		get_tree(MSA, fp, stack_tree, file_name);
+		CompareTreeToTreestack(MSA, sp, stack_tree, root, LVB_FALSE);
+	}
+	if (sp->sample != NULL) /* trees above fit in the sample, so none was chosen at random */
+	{
+		long n_dropped;				 /* trees not kept */
+		Lvb_fingerprint fingerprint; /* of tree not kept */
+
+		get(fp, sp->sample->rng, sizeof(Rng), file_name);
+		get(fp, &n_dropped, sizeof(long), file_name);
+		for (i = 0; i < n_dropped; i++)
+		{
+			get(fp, &fingerprint, sizeof(Lvb_fingerprint), file_name);
+			sp->sample->dropped->insert(fingerprint);
+		}
+	}
+	free(stack_tree);
+	fclose(fp);
+
+} /* end checkpoint_load() */
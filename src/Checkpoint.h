@@ -0,0 +1,80 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro and Maximilian Strobl.
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* ========== Checkpoint.h - interface for Checkpoint.c ========== */
+
+#ifndef LVB_CHECKPOINT_H
+#define LVB_CHECKPOINT_H
+
+#include "LVB.h"
+
+/* where Anneal() has got to, apart from its trees */
+typedef struct
+{
+	double t0;				  /* initial temperature */
+	long current_iter;		  /* iterations of all searches so far */
+	long iter;				  /* iterations of this search */
+	long root;				  /* root of current tree */
+	long current_tree_length; /* length of current tree */
+	long best_tree_length;	  /* best length found so far */
+	double t;				  /* current temperature */
+	long t_n;				  /* ordinal number of current temperature */
+	long failedcnt;			  /* "failed count" for temperatures */
+	long accepted;			  /* changes accepted at this temperature */
+	long proposed;			  /* trees proposed at this temperature */
+	long unchanged;			  /* proposals since current tree changed */
+	double trops_counter[3];  /* counts of useful NNI, SPR and TBR */
+	double trops_probs[3];	  /* probabilities of NNI, SPR and TBR */
+	long trops_id;			  /* last rearrangement, for algorithm 2 */
+	Rng rng;				  /* random number generator */
+} Checkpoint_state;
+
+void checkpoint_options(Parameters *prms);
+Lvb_bool checkpoint_save(Dataptr MSA, Parameters rcstruct, const Checkpoint_state *state,
+						 const TREESTACK_TREE_NODES *const tree, const TREESTACK *sp);
+void checkpoint_load(Dataptr MSA, Parameters rcstruct, Checkpoint_state *state, TREESTACK_TREE_NODES *const tree,
+					 TREESTACK *sp);
+void checkpoint_finish(void);
+
+#endif /* LVB_CHECKPOINT_H */
@@ -69,6 +69,8 @@ int read_file(char *file_name, int n_file_type, Dataptr p_lvbmat)
 	/* it is used in tree compare */
 	p_lvbmat->nsets = p_lvbmat->n - 3; /* sets per tree */
 	p_lvbmat->mssz = p_lvbmat->n - 2;  /* maximum objects per set */
+	p_lvbmat->split_words = (p_lvbmat->n + NUMBER_OF_BITS - 1) / NUMBER_OF_BITS;
+	p_lvbmat->enc_rows = NULL; /* rows are encoded later */
 
 	/* array for row title strings */
 	p_lvbmat->rowtitle = (char **)malloc((p_lvbmat->n) * sizeof(char *));
@@ -88,12 +90,7 @@ int read_file(char *file_name, int n_file_type, Dataptr p_lvbmat)
 		p_lvbmat->rowtitle[i] = (char *)malloc(sizeof(char) * (readFiles.get_max_length_seq_name() + 1));
 		p_lvbmat->row[i] = (char *)malloc(sizeof(char) * (p_lvbmat->m + 1));
 	}
-	for (int i = 0; i < p_lvbmat->n; i++)
-	{
-		for (int j = 0; j < p_lvbmat->m; j++)
-			p_lvbmat->row[i][j] = readFiles.get_char_sequences(i, j);
-		p_lvbmat->row[i][p_lvbmat->m] = '\0';
-	}
+	readFiles.copy_sequences(p_lvbmat->row);
 	for (int i = 0; i < p_lvbmat->n; i++)
 	{
 		for (int j = 0; j < readFiles.get_length_seq_name(i); j++)
@@ -175,11 +172,29 @@ void usage(char *p_file_name)
 	printf("    Input file                        -i [FILE]           Input file name \n");
 	printf("    Input file format                 -f [STRING]         'phylip'|'fasta'|'nexus'|'clustal' \n");
 	printf("    Output file                       -o [FILE]           Output file name; default: 'outfile'\n");
+	printf("    Site pattern compression          -w                  Merge identical columns into weighted patterns; default: OFF\n");
+	printf("    Best tree memory                  --stack-memory [VALUE]\n"
+		   "                                                          Bytes (or k, M, G) of best trees kept in memory, the rest\n"
+		   "                                                          going to '<output file>.spill'; default: no limit\n");
+	printf("    Best tree sample                  --sample-trees [VALUE]\n"
+		   "                                                          Keep a random sample of VALUE best trees, still searching and\n"
+		   "                                                          counting all; each distinct best tree found still takes about\n"
+		   "                                                          60 bytes, for its fingerprint; default: keep all\n");
+	printf("    Alignment cache                   --cache             Keep the encoded alignment in '<input file>.lvbm' and use it\n"
+		   "                                                          while the input file is unchanged; default: OFF\n");
+	printf("    Shared alignment                  --shared-matrix [NAME]\n"
+		   "                                                          Hold the encoded alignment once, in shared memory segment NAME,\n"
+		   "                                                          for all LVB processes on this computer given NAME, until it is\n"
+		   "                                                          removed or the computer restarts; default: OFF\n");
+	printf("    Remove shared alignment           --remove-shared-matrix [NAME]\n"
+		   "                                                          Remove shared memory segment NAME, which processes using it\n"
+		   "                                                          keep, and stop\n");
 
 	printf("\n");
 
 	printf(" Search Origin Preferences: \n");
 	printf("    Starting seed                     -s [VALUE]          Specify a starting seed; default: generated from system clock\n");
+	printf("    Random number generator           --rng [uni|philox]  UNI, as in earlier versions, or counter-based Philox4x32-10; default: uni\n");
 
 	printf("\n");
 
@@ -192,27 +207,165 @@ void usage(char *p_file_name)
 
 	printf(" Simulated Annealing Preferences: \n");
 	printf("    Cooling schedule                  -c [G|L]            SA cooling schedule; GEOMETRIC (G) or LINEAR (L); default: G \n");
+	printf("    Indirect SPR/TBR scoring          -u                  Score SPR and TBR proposals without making them; default: OFF\n");
+	printf("    Final hill climbing               -H [SPR|TBR]        Make the best SPR (or TBR) rearrangement until none is shorter; default: OFF\n");
+	printf("    Annealing chains                  -m [VALUE]          Independent annealing chains run at once, one per thread; default: 1\n");
+	printf("    Replica exchange                  -R [VALUE]          Replicas at fixed temperatures, one per thread, exchanged instead of annealing; default: OFF\n");
+	printf("    Speculative batch                 -B [VALUE]          Proposals scored at once from the same tree, one per thread; default: 1\n");
+
+	printf("\n");
+
+	printf(" Checkpoint Preferences: \n");
+	printf("    Checkpoint file                   --checkpoint [FILE] Save the search state to FILE from time to time; default: OFF\n");
+	printf("    Checkpoint interval               --checkpoint-every [VALUE]\n"
+		   "                                                          Iterations between checkpoints\n");
+	printf("    Checkpoint interval               --checkpoint-seconds [VALUE]\n"
+		   "                                                          Seconds between checkpoints; default: %ld if neither is given\n",
+		   CHECKPOINT_SECONDS);
+	printf("    Resume search                     --resume [FILE]     Carry on from checkpoint FILE, checkpointing to FILE again, with\n"
+		   "                                                          the seed and -a, -c, -t, -u, -w, -B, -H, --rng, --sample-trees and\n"
+		   "                                                          --stack-memory it was made with, in place of any given\n");
 
 	printf("\n");
 
 	printf(" Parallelisation Preferences: \n");
 	printf("    Fine-grain multithreading         -p [VALUE]          Number of threads requested; default: one thread \n");
+	printf("    Fitch kernel                      -k [STRING]         'auto'|'scalar'|'sse42'|'avx2'|'avx512'; default: auto \n");
+	printf("    Subtree tasks                     --subtree-tasks [TAXA,BRANCHES]\n"
+		   "                                                          Share out subtrees among threads for alignments of at least\n"
+		   "                                                          TAXA taxa but too few columns to share out, in trees with at\n"
+		   "                                                          least BRANCHES branches to score; default: %d,%d\n",
+		   MINIMUM_TAXA_SUBTREE_TASKS, MINIMUM_BRANCHES_SUBTREE_TASKS);
 
 	printf("\n");
 
 	exit(0);
 }
 
+/* long options, which have no single-letter form */
+#define OPT_CHECKPOINT 256
+#define OPT_CHECKPOINT_EVERY 257
+#define OPT_CHECKPOINT_SECONDS 258
+#define OPT_RESUME 259
+#define OPT_RNG 260
+#define OPT_STACK_MEMORY 261
+#define OPT_SAMPLE_TREES 262
+#define OPT_CACHE 263
+#define OPT_SHARED_MATRIX 264
+#define OPT_SUBTREE_TASKS 265
+#define OPT_REMOVE_SHARED_MATRIX 266
+
+static const struct option long_options[] = {
+	{"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+	{"checkpoint-every", required_argument, NULL, OPT_CHECKPOINT_EVERY},
+	{"checkpoint-seconds", required_argument, NULL, OPT_CHECKPOINT_SECONDS},
+	{"resume", required_argument, NULL, OPT_RESUME},
+	{"rng", required_argument, NULL, OPT_RNG},
+	{"stack-memory", required_argument, NULL, OPT_STACK_MEMORY},
+	{"sample-trees", required_argument, NULL, OPT_SAMPLE_TREES},
+	{"cache", no_argument, NULL, OPT_CACHE},
+	{"shared-matrix", required_argument, NULL, OPT_SHARED_MATRIX},
+	{"subtree-tasks", required_argument, NULL, OPT_SUBTREE_TASKS},
+	{"remove-shared-matrix", required_argument, NULL, OPT_REMOVE_SHARED_MATRIX},
+	{NULL, 0, NULL, 0}};
+
 void read_parameters(Parameters *prms, int argc, char **argv)
 {
 
 	int c;
 	opterr = 0;
 
-	while ((c = getopt(argc, argv, "t:c:b:vs:i:o:f:a:p:N:SC:h?")) != -1)
+	while ((c = getopt_long(argc, argv, "t:c:b:vs:i:o:f:a:p:k:wuH:m:R:B:N:SC:h?", long_options, NULL)) != -1)
 	{
 		switch (c)
 		{
+		case OPT_CHECKPOINT: /* checkpoint file */
+		case OPT_RESUME:	 /* checkpoint file to resume from */
+			if (strlen(optarg) >= LVB_FNAMSIZE)
+			{
+				fprintf(stderr, "Error, the length file name greater than %d\n", LVB_FNAMSIZE);
+				exit(1);
+			}
+			strcpy(prms->file_name_checkpoint, optarg);
+			if (c == OPT_RESUME)
+				prms->resume = LVB_TRUE;
+			break;
+		case OPT_RNG: /* random number generator */
+			if (strcmp(optarg, "uni") == 0)
+				prms->rng = RNG_UNI;
+			else if (strcmp(optarg, "philox") == 0)
+				prms->rng = RNG_PHILOX;
+			else
+			{
+				fprintf(stderr, "Unknown random number generator '%s'\nPlease, choose between uni or philox.\n", optarg);
+				exit(1);
+			}
+			break;
+		case OPT_STACK_MEMORY: /* memory for best trees */
+		{
+			char *p_end; /* suffix of number */
+
+			prms->treestack_memory = strtol(optarg, &p_end, 10);
+			if ((*p_end == 'k') || (*p_end == 'K'))
+				prms->treestack_memory <<= 10;
+			else if ((*p_end == 'm') || (*p_end == 'M'))
+				prms->treestack_memory <<= 20;
+			else if ((*p_end == 'g') || (*p_end == 'G'))
+				prms->treestack_memory <<= 30;
+			else if (*p_end != '\0')
+				p_end = NULL;
+			if ((p_end == NULL) || (p_end == optarg) || ((*p_end != '\0') && (p_end[1] != '\0')) ||
+				(prms->treestack_memory <= 0))
+			{
+				fprintf(stderr, "Error, best tree memory must be a number of bytes, optionally followed by k, M or G\n");
+				exit(1);
+			}
+			break;
+		}
+		case OPT_SAMPLE_TREES: /* size of random sample of best trees */
+			prms->n_sample_trees = atol(optarg);
+			if (prms->n_sample_trees < 1)
+			{
+				fprintf(stderr, "Error, best tree sample must hold at least one tree\n");
+				exit(1);
+			}
+			break;
+		case OPT_CACHE: /* alignment cache */
+			prms->matrix_cache = LVB_TRUE;
+			break;
+		case OPT_SHARED_MATRIX:		   /* shared memory segment for alignment */
+		case OPT_REMOVE_SHARED_MATRIX: /* shared memory segment to remove */
+			if ((optarg[0] == '\0') || (strchr(optarg + 1, '/') != NULL) || (strlen(optarg) >= NAME_MAX))
+			{
+				fprintf(stderr, "Error, shared memory segment name must be a short name without '/'\n");
+				exit(1);
+			}
+			strcpy(prms->shared_matrix, optarg);
+			if (c == OPT_REMOVE_SHARED_MATRIX)
+				prms->remove_shared_matrix = LVB_TRUE;
+			break;
+		case OPT_SUBTREE_TASKS: /* when getplen threads share out subtrees */
+		{
+			char end; /* anything after the numbers */
+
+			if ((sscanf(optarg, "%ld,%ld%c", &prms->min_taxa_subtree_tasks, &prms->min_branches_subtree_tasks, &end) != 2) ||
+				(prms->min_taxa_subtree_tasks < 1) || (prms->min_branches_subtree_tasks < 1))
+			{
+				fprintf(stderr, "Error, subtree tasks need a number of taxa and a number of branches, as in 256,32\n");
+				exit(1);
+			}
+			break;
+		}
+		case OPT_CHECKPOINT_EVERY: /* iterations between checkpoints */
+			prms->checkpoint_every = atol(optarg);
+			if (prms->checkpoint_every < 0)
+				prms->checkpoint_every = 0;
+			break;
+		case OPT_CHECKPOINT_SECONDS: /* seconds between checkpoints */
+			prms->checkpoint_seconds = atol(optarg);
+			if (prms->checkpoint_seconds < 0)
+				prms->checkpoint_seconds = 0;
+			break;
 		case 'c': /* cooling schedule */
 			if (optarg == NULL)
 			{
@@ -245,6 +398,28 @@ void read_parameters(Parameters *prms, int argc, char **argv)
 				fprintf(stderr, "Unknown algorithm option\nPlease, choose between SN (0), SEQ-TNS (1), or PBS (2).");
 			}
 			break;
+		case 'w': /* site pattern compression */
+			prms->compress_patterns = LVB_TRUE;
+			break;
+		case 'u': /* indirect SPR/TBR scoring */
+			prms->indirect_scoring = LVB_TRUE;
+			break;
+		case 'H': /* final hill climbing */
+			if (optarg == NULL)
+			{
+				fprintf(stderr, "Option -%c requires an argument -H [SPR|TBR]\n", optopt);
+				usage(argv[0]);
+			}
+			if (strcmp(optarg, "spr") == 0 || strcmp(optarg, "SPR") == 0)
+				prms->hillclimb = HILLCLIMB_SPR;
+			else if (strcmp(optarg, "tbr") == 0 || strcmp(optarg, "TBR") == 0)
+				prms->hillclimb = HILLCLIMB_TBR;
+			else
+			{
+				fprintf(stderr, "Unknown hill climbing option '%s'\nPlease, choose between SPR or TBR.\n", optarg);
+				exit(1);
+			}
+			break;
 		case 'v': /* verbose */
 			prms->verbose = LVB_TRUE;
 			break;
@@ -318,6 +493,58 @@ void read_parameters(Parameters *prms, int argc, char **argv)
 			if (prms->n_processors_available < 1)
 				prms->n_processors_available = 1;
 			break;
+		case 'm': /* annealing chains */
+			if (optarg == NULL)
+			{
+				fprintf(stderr, "Option -%c requires an argument -m <int>\n", optopt);
+				usage(argv[0]);
+			}
+			prms->n_chains = atoi(optarg);
+			if (prms->n_chains < 1)
+				prms->n_chains = 1;
+			break;
+		case 'R': /* replica exchange */
+			if (optarg == NULL)
+			{
+				fprintf(stderr, "Option -%c requires an argument -R <int>\n", optopt);
+				usage(argv[0]);
+			}
+			prms->n_replicas = atoi(optarg);
+			if (prms->n_replicas < 2)
+				prms->n_replicas = 0;
+			break;
+		case 'B': /* speculative batch */
+			if (optarg == NULL)
+			{
+				fprintf(stderr, "Option -%c requires an argument -B <int>\n", optopt);
+				usage(argv[0]);
+			}
+			prms->batch_size = atoi(optarg);
+			if (prms->batch_size < 1)
+				prms->batch_size = 1;
+			break;
+		case 'k': /* Fitch kernel */
+			if (optarg == NULL)
+			{
+				fprintf(stderr, "Option -%c requires an argument -k [auto|scalar|sse42|avx2|avx512]\n", optopt);
+				usage(argv[0]);
+			}
+			if (strcmp(optarg, "auto") == 0)
+				prms->fitch_kernel = FITCH_KERNEL_AUTO;
+			else if (strcmp(optarg, "scalar") == 0)
+				prms->fitch_kernel = FITCH_KERNEL_SCALAR;
+			else if (strcmp(optarg, "sse42") == 0)
+				prms->fitch_kernel = FITCH_KERNEL_SSE42;
+			else if (strcmp(optarg, "avx2") == 0)
+				prms->fitch_kernel = FITCH_KERNEL_AVX2;
+			else if (strcmp(optarg, "avx512") == 0)
+				prms->fitch_kernel = FITCH_KERNEL_AVX512;
+			else
+			{
+				fprintf(stderr, "Unknown Fitch kernel '%s'\nPlease, choose between auto, scalar, sse42, avx2 or avx512.\n", optarg);
+				exit(1);
+			}
+			break;
 		case 't':
 			if (optarg == NULL)
 			{
@@ -45,64 +45,232 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* ========== DataOperations.c - MSA operations ========== */
 
 #include "DataOperations.h"
+#include "FitchKernel.h"
 
-static long constchar(Dataptr restrict MSA, Lvb_bool *const togo, const Lvb_bool verbose);
-static void cutcols(Dataptr MSA, const Lvb_bool *const tocut, long n_columns_to_change);
-static void logcut(const Lvb_bool *const cut, const long m);
+#if defined(__x86_64__) || defined(__i386__)
+#define LVB_DNA_X86
+#include <immintrin.h>
+#endif
 
-static char *getstatev(const Dataptr MSA, const long k)
-/* return pointer to string containing 1 instance of each character state in
- * column k of MSA, or NULL if more than MAXSTATES states are
- * found; does not include '-', '?', 'N' or 'X'; ignores the special meaning
- * of other (partial) ambiguity codes, so can return NULL if these are present;
- * N.B. string is static and will be overwritten by later calls */
+typedef struct /* what matchange() needs to know of a column */
+{
+	uint16_t symbols;	  /* states seen, one bit each, total ambiguity not counted */
+	unsigned char twice;  /* those of A, C, G and T seen in more than one row */
+	unsigned char varies; /* 1 if not every row holds the same character, else 0 */
+} Column_summary;
+
+#define SYMBOL_BASES 0x000F	 /* bits of A, C, G and T in Column_summary symbols */
+#define SYMBOL_OTHER 0x8000	 /* bit of characters that are not base symbols */
+#define COLUMN_SLICE 4096L /* columns summarised at a time, reading every row */
+
+static long constchar(const Column_summary *summary, const long m, Lvb_bool *const togo, const Lvb_bool verbose);
+static long informative(const Column_summary *summary, const long m, Lvb_bool *const tokeep, long *offset,
+						const Lvb_bool verbose);
+static void cutcols(Dataptr MSA, const Lvb_bool *const tocut, long n_columns_to_change, int n_threads);
+static void logcut(const Lvb_bool *const cut, const long m);
+static void single_block(Dataptr MSA);
+static void compress_patterns(Dataptr MSA, const Lvb_bool verbose, int n_threads);
+static void set_sizes(Dataptr MSA);
+
+static void state_symbols(uint16_t *symbol)
+/* fill symbol[256] with the bit standing for each text character in a
+ * Column_summary, or 0 for total ambiguity; partial ambiguity codes count
+ * as states of their own */
 {
-	static char statev[MAXSTATES + 1]; /* array of states */
-	long statec;					   /* number of states */
-	long i;							   /* loop counter */
+	static const char states[] = "ACGTUYRWSKMBDHV"; /* states, in order of bits */
+	long s;											/* loop counter */
+	int c;											/* loop counter */
+
+	for (c = 0; c < 256; c++)
+		symbol[c] = SYMBOL_OTHER; /* any other, so not allowed */
+	for (s = 0; states[s] != '\0'; s++)
+		symbol[(unsigned char)states[s]] = (uint16_t)(1U << s);
+	symbol['-'] = symbol['?'] = symbol['N'] = symbol['X'] = 0;
+
+} /* end state_symbols() */
+
+static void summarise_columns(const Dataptr MSA, Column_summary *summary, int n_threads)
+/* fill MSA->m-element array summary with what each column of MSA holds;
+ * every row is read in order over a slice of COLUMN_SLICE columns at a
+ * time, rather than down each column, and slices are shared out among up
+ * to n_threads threads */
+{
+	uint16_t symbol[256]; /* bit of each character */
+	long start;			  /* first column of slice */
 
-	/* clear record of states */
-	statev[0] = '\0';
-	statec = 0;
+	state_symbols(symbol);
 
-	/* update record of states for column k */
-	for (i = 0; i < MSA->n; ++i)
+#pragma omp parallel for num_threads(n_threads) schedule(static) if (MSA->n * MSA->m >= MINIMUM_CELLS_TO_THREAD_COLUMNS)
+	for (start = 0; start < MSA->m; start += COLUMN_SLICE)
 	{
-		if (strchr(statev, (int)MSA->row[i][k]) == NULL)
-		{ /* new state */
-			if ((MSA->row[i][k] != '-') && (MSA->row[i][k] != '?') && (MSA->row[i][k] != 'N') && (MSA->row[i][k] != 'X'))
+		const long end = (start + COLUMN_SLICE < MSA->m) ? start + COLUMN_SLICE : MSA->m; /* end of slice */
+		const char *first = MSA->row[0];												/* first row */
+		const char *row;																/* current row */
+		uint16_t bit;																	/* bit of current character */
+		long i;																			/* loop counter */
+		long k;																			/* loop counter */
+
+		memset(summary + start, 0, (end - start) * sizeof(Column_summary));
+		for (i = 0; i < MSA->n; ++i)
+		{
+			row = MSA->row[i];
+			for (k = start; k < end; ++k)
 			{
-				statev[statec++] = MSA->row[i][k];
+				bit = symbol[(unsigned char)row[k]];
+				summary[k].twice |= (unsigned char)(summary[k].symbols & bit & SYMBOL_BASES);
+				summary[k].symbols |= bit;
+				summary[k].varies |= (unsigned char)(row[k] != first[k]);
 			}
-			if (statec > MAXSTATES)
-				return NULL;
-			statev[statec] = '\0'; /* for strchr() */
 		}
 	}
 
-	return statev;
+} /* end summarise_columns() */
+
+static void check_symbols(const Dataptr MSA, const Column_summary *summary)
+/* crash if a column of MSA, as read, holds a character that is not a base
+ * symbol, naming the first such character by its row and column, before
+ * any column is cut; summary holds what each column holds */
+{
+	uint16_t symbol[256]; /* bit of each character */
+	long i;				  /* loop counter */
+	long k;				  /* loop counter */
+
+	for (k = 0; k < MSA->m; k++)
+	{
+		if ((summary[k].symbols & SYMBOL_OTHER) != 0)
+		{
+			state_symbols(symbol);
+			for (i = 0; symbol[(unsigned char)MSA->row[i][k]] != SYMBOL_OTHER; i++)
+				;
+			crash("bad base symbol '%c' in data MSA, row %ld ('%s'), column %ld", MSA->row[i][k], i + 1,
+				  MSA->rowtitle[i], k + 1);
+		}
+	}
 
-} /* end getstatev() */
+} /* end check_symbols() */
 
-long MinimumTreeLength(const Dataptr MSA)
-/* return minimum length of any tree based on MSA; FIXME not quite right
- * with ambiguity codes */
+static long column_length(const Column_summary *summary)
+/* return the least length any tree has in the column with summary: one
+ * less than the number of states, or MAXSTATES if there are more than
+ * MAXSTATES; FIXME not quite right with ambiguity codes */
 {
-	long minlen = 0; /* return value */
-	char *statev;	 /* list of states in current character */
-	long k;			 /* loop counter */
+	long states = __builtin_popcount(summary->symbols); /* states in column */
 
-	for (k = 0; k < MSA->m; ++k)
+	return (states > MAXSTATES) ? MAXSTATES : states - 1;
+
+} /* end column_length() */
+
+static void base_statesets(unsigned char *stateset)
+/* fill stateset[256] with the binary-encoded state set of each text
+ * character, or 0 for characters not allowed */
+{
+	memset(stateset, 0, 256);
+
+	/* unambiguous bases */
+	stateset['A'] = A_BIT;
+	stateset['C'] = C_BIT;
+	stateset['G'] = G_BIT;
+	stateset['T'] = T_BIT;
+	stateset['U'] = T_BIT; /* treat the same as 'T' */
+
+	/* ambiguous bases */
+	stateset['Y'] = C_BIT | T_BIT;
+	stateset['R'] = A_BIT | G_BIT;
+	stateset['W'] = A_BIT | T_BIT;
+	stateset['S'] = C_BIT | G_BIT;
+	stateset['K'] = T_BIT | G_BIT;
+	stateset['M'] = C_BIT | A_BIT;
+	stateset['B'] = C_BIT | G_BIT | T_BIT;
+	stateset['D'] = A_BIT | G_BIT | T_BIT;
+	stateset['H'] = A_BIT | C_BIT | T_BIT;
+	stateset['V'] = A_BIT | C_BIT | G_BIT;
+	stateset['N'] = A_BIT | C_BIT | G_BIT | T_BIT;
+	stateset['X'] = A_BIT | C_BIT | G_BIT | T_BIT;
+
+	/* total ambiguity or deletion - now always the same as 'N' */
+	stateset['?'] = A_BIT | C_BIT | G_BIT | T_BIT;
+	stateset['-'] = A_BIT | C_BIT | G_BIT | T_BIT;
+
+} /* end base_statesets() */
+
+static long encode_words(const char *restrict text, Lvb_bit_length *restrict enc, long nwords,
+						 const unsigned char *restrict stateset)
+/* encode nwords * LENGTH_WORD characters of text to enc using stateset,
+ * and return -1, or the first word holding a character not allowed */
+{
+	long j;						   /* loop counter */
+	long k;						   /* loop counter */
+	unsigned char bad;			   /* character not allowed in word */
+	unsigned char sitestate;	   /* binary-encoded single state set */
+	Lvb_bit_length enc_sitestates; /* set of binary-encoded state sets */
+
+	for (j = 0; j < nwords; j++, text += LENGTH_WORD)
 	{
-		statev = getstatev(MSA, k);
-		if (statev == NULL)
-			minlen += MAXSTATES;
-		else
-			minlen += strlen(statev) - 1;
+		enc_sitestates = 0U;
+		bad = 0;
+		for (k = 0; k < LENGTH_WORD; k++)
+		{
+			sitestate = stateset[(unsigned char)text[k]];
+			bad |= (sitestate == 0);
+			enc_sitestates |= (Lvb_bit_length)sitestate << (k << NIBBLE_WIDTH_BITS);
+		}
+		if (bad != 0)
+			return j;
+		enc[j] = enc_sitestates;
 	}
-	return minlen;
+	return -1;
 
-} /* end MinimumTreeLength() */
+} /* end encode_words() */
+
+#ifdef LVB_DNA_X86
+
+__attribute__((target("avx2"))) static long encode_words_avx2(const char *restrict text, Lvb_bit_length *restrict enc,
+															  long nwords, const unsigned char *restrict stateset)
+/* as encode_words(), LENGTH_WORD * 2 characters at a time */
+{
+	/* all characters allowed are in 0x20 to 0x5F, so four 16-entry tables
+	 * chosen by the high half of each character cover them */
+	const __m256i table_2 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(stateset + 0x20)));
+	const __m256i table_3 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(stateset + 0x30)));
+	const __m256i table_4 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(stateset + 0x40)));
+	const __m256i table_5 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(stateset + 0x50)));
+	const __m256i low_half = _mm256_set1_epi8(0x0F);
+	const __m256i pair_weights = _mm256_set1_epi16(0x1001); /* first of pair times 1, second times 16 */
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i chars, high, low, sitestates, pairs; /* 32 characters and their state sets */
+	long j;										 /* loop counter */
+
+	for (j = 0; j + 1 < nwords; j += 2, text += 2 * LENGTH_WORD)
+	{
+		chars = _mm256_loadu_si256((const __m256i *)text);
+		high = _mm256_and_si256(_mm256_srli_epi16(chars, 4), low_half);
+		low = _mm256_and_si256(chars, low_half);
+		sitestates = _mm256_and_si256(_mm256_shuffle_epi8(table_2, low), _mm256_cmpeq_epi8(high, _mm256_set1_epi8(2)));
+		sitestates = _mm256_or_si256(
+			sitestates, _mm256_and_si256(_mm256_shuffle_epi8(table_3, low), _mm256_cmpeq_epi8(high, _mm256_set1_epi8(3))));
+		sitestates = _mm256_or_si256(
+			sitestates, _mm256_and_si256(_mm256_shuffle_epi8(table_4, low), _mm256_cmpeq_epi8(high, _mm256_set1_epi8(4))));
+		sitestates = _mm256_or_si256(
+			sitestates, _mm256_and_si256(_mm256_shuffle_epi8(table_5, low), _mm256_cmpeq_epi8(high, _mm256_set1_epi8(5))));
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(sitestates, zero)) != 0)
+			return j + encode_words(text, enc + j, 2, stateset); /* find which word */
+
+		/* pack pairs of state sets into bytes, 16 bytes to a 128-bit lane */
+		pairs = _mm256_maddubs_epi16(sitestates, pair_weights);
+		pairs = _mm256_packus_epi16(pairs, pairs);
+		enc[j] = (Lvb_bit_length)_mm256_extract_epi64(pairs, 0);
+		enc[j + 1] = (Lvb_bit_length)_mm256_extract_epi64(pairs, 2);
+	}
+	if (j < nwords) /* odd word out */
+	{
+		if (encode_words(text, enc + j, 1, stateset) != -1)
+			return j;
+	}
+	return -1;
+
+} /* end encode_words_avx2() */
+
+#endif /* LVB_DNA_X86 */
 
 /**********
 
@@ -110,16 +278,18 @@ long MinimumTreeLength(const Dataptr MSA)
 
 =head2 SYNOPSIS
 
-	void DNAToBinary(const Dataptr mat, Lvb_bool fifthstate,
-	 unsigned char **enc_mat);
+	void DNAToBinary(Dataptr mat, Lvb_bit_length **enc_mat, int n_threads);
 
 =head2 DESCRIPTION
 
 Converts a MSA of sequence strings to a MSA of binary-encoded
-statesets, where each of A, C, T, G and O (deletion) is represented by
-a different bit. Ambiguous bases are converted to the union of all the
-bases they may represent. C<?> is treated as totally ambiguous and
-C<-> is either treated as <?> or as <O>.
+statesets, where each of A, C, T and G is represented by a different
+bit. Ambiguous bases are converted to the union of all the bases they
+may represent. C<?> and C<-> are treated as totally ambiguous. Crashes,
+naming the row and column, on any other character.
+
+Each character is looked up in a table. Where the Fitch kernel in use is
+AVX2 or AVX-512, 32 characters at a time are looked up with AVX2.
 
 =head2 PARAMETERS
 
@@ -134,10 +304,10 @@ each sequence and the number of sequences, respectively. Member
 C<mat>C<->E<gt>C<row> points to the first element in an array of
 pointers, each of which points to a sequence stored as a text string.
 
-=item fifthstate
+=item n_threads
 
-If C<LVB_TRUE>, treat gaps indicated by C<-> as identical to C<O>. Otherwise,
-treat gaps indicated by C<-> as identical to <?>, i.e., totally ambiguous.
+Rows are shared out among up to C<n_threads> threads, if there are at
+least C<MINIMUM_WORDS_TO_THREAD_ENCODING> words in all.
 
 =back
 
@@ -149,11 +319,12 @@ treat gaps indicated by C<-> as identical to <?>, i.e., totally ambiguous.
 
 C<enc_mat> must point to the first element in an array of
 C<mat>C<->E<gt>C<n> pointers, each of which points to an allocated
-array of C<mat>C<->E<gt>C<n> elements. On return,
-C<enc_mat>[I<i>][I<j>] will give the binary-encoded stateset for
-C<mat>C<->E<gt>C<row>[I<i>][I<j>], where I<i> is in the interval
-[0..C<mat>C<->E<gt>C<n>-1] and I<j> is in the interval
-[0..C<mat>C<->E<gt>C<m>-1].
+array of C<mat>C<->E<gt>C<nwords> elements. On return,
+C<enc_mat>[I<i>] will give the binary-encoded statesets for
+C<mat>C<->E<gt>C<row>[I<i>], where I<i> is in the interval
+[0..C<mat>C<->E<gt>C<n>-1]. Columns are packed in the order of the
+blocks described by C<mat>C<->E<gt>C<block_col> and
+C<mat>C<->E<gt>C<block_word>, each block starting on a new word.
 
 =back
 
@@ -161,91 +332,81 @@ C<mat>C<->E<gt>C<row>[I<i>][I<j>], where I<i> is in the interval
 
 **********/
 
-void DNAToBinary(Dataptr restrict mat, Lvb_bit_length **enc_mat)
+void DNAToBinary(Dataptr restrict mat, Lvb_bit_length **enc_mat, int n_threads)
 /* convert MSA from string form to binary-encoded form, in which each
  * biological character occupies half a byte; the MSA is padded with
  * ambiguous data as required to ensure all bytes are initialised, but padding
  * will not contribute to tree length - allowing the optimization of White and
  * Holland (2011) */
 {
-	long i;						   /* loop counter */
-	long j;						   /* loop counter */
-	long k;						   /* loop counter */
-	long mat_offset;			   /* current position within MSA row */
-	char base;					   /* current base as text character */
-	Lvb_bit_length sitestate = 0U; /* binary-encoded single state set */
-	Lvb_bit_length enc_sitestates; /* set of four binary-encoded state sets */
-
+	long (*encode)(const char *restrict, Lvb_bit_length *restrict, long, const unsigned char *restrict) = encode_words;
+	unsigned char stateset[256]; /* state set of each character, or 0 */
+	long bad_row = mat->n;		 /* first row with a character not allowed */
+	long bad_col = 0;			 /* and its column */
+	long i;						 /* loop counter */
+
+	base_statesets(stateset);
+#ifdef LVB_DNA_X86
+	if (((fitch_kernel_current() == FITCH_KERNEL_AVX2) || (fitch_kernel_current() == FITCH_KERNEL_AVX512))
+		&& (fitch_kernel_supported(FITCH_KERNEL_AVX2) == LVB_TRUE))
+		encode = encode_words_avx2;
+#endif
+
+#pragma omp parallel for num_threads(n_threads) schedule(static) if (mat->n * mat->nwords >= MINIMUM_WORDS_TO_THREAD_ENCODING)
 	for (i = 0; i < mat->n; i++)
 	{
-		for (j = 0; j < mat->nwords; j++)
+		const char *row = mat->row[i];		/* text of row */
+		Lvb_bit_length *enc = enc_mat[i];	/* encoded row */
+		Lvb_bit_length enc_sitestates;		/* set of binary-encoded state sets */
+		long b;								/* current block of columns */
+		long k;								/* loop counter */
+		long col;							/* first column of word */
+		long full;							/* words of block without padding */
+		long bad = -1;						/* word holding a character not allowed */
+
+		/* each block of equal-weight columns starts on a new word, and only
+		 * its last word may need padding */
+		for (b = 0; (b < mat->n_blocks) && (bad == -1); b++)
 		{
-			enc_sitestates = 0U;
-			for (k = 0; k < LENGTH_WORD; k++)
+			full = (mat->block_col[b + 1] - mat->block_col[b]) >> LENGTH_WORD_BITS_MULTIPLY;
+			bad = encode(row + mat->block_col[b], enc + mat->block_word[b], full, stateset);
+			if (bad != -1)
+				col = mat->block_col[b] + (bad << LENGTH_WORD_BITS_MULTIPLY);
+			else if (mat->block_word[b] + full < mat->block_word[b + 1])
 			{
-				mat_offset = (j << LENGTH_WORD_BITS_MULTIPLY) + k;
-				if (mat_offset >= mat->m) /* padding required */
-					base = 'N';
-				else
-					base = mat->row[i][(j << LENGTH_WORD_BITS_MULTIPLY) + k]; /* observed base required */
-
-				/* unambiguous bases */
-				if (base == 'A')
-					sitestate = A_BIT;
-				else if (base == 'C')
-					sitestate = C_BIT;
-				else if (base == 'G')
-					sitestate = G_BIT;
-				else if (base == 'T')
-					sitestate = T_BIT;
-				else if (base == 'U') /* treat the same as 'U' */
-					sitestate = T_BIT;
-
-				/* ambiguous bases */
-				else if (base == 'Y')
-					sitestate = C_BIT | T_BIT;
-				else if (base == 'R')
-					sitestate = A_BIT | G_BIT;
-				else if (base == 'W')
-					sitestate = A_BIT | T_BIT;
-				else if (base == 'S')
-					sitestate = C_BIT | G_BIT;
-				else if (base == 'K')
-					sitestate = T_BIT | G_BIT;
-				else if (base == 'M')
-					sitestate = C_BIT | A_BIT;
-				else if (base == 'B')
-					sitestate = C_BIT | G_BIT | T_BIT;
-				else if (base == 'D')
-					sitestate = A_BIT | G_BIT | T_BIT;
-				else if (base == 'H')
-					sitestate = A_BIT | C_BIT | T_BIT;
-				else if (base == 'V')
-					sitestate = A_BIT | C_BIT | G_BIT;
-				else if (base == 'N')
-					sitestate = A_BIT | C_BIT | G_BIT | T_BIT;
-				else if (base == 'X')
-					sitestate = A_BIT | C_BIT | G_BIT | T_BIT;
-
-				/* total ambiguity or deletion - now always the same as 'N' */
-				else if ((base == '?') || (base == '-'))
-					sitestate = A_BIT | C_BIT | G_BIT | T_BIT;
-
-				/* all other bases are not allowed */
-				else
+				col = mat->block_col[b] + (full << LENGTH_WORD_BITS_MULTIPLY);
+				enc_sitestates = 0U;
+				for (k = 0; k < LENGTH_WORD; k++)
 				{
-					fprintf(stderr, "bad base symbol in data MSA: ");
-					fputc(base, stderr);
-					fputc('\n', stderr);
-					crash("cannot read data MSA");
+					if (col + k >= mat->block_col[b + 1]) /* padding required */
+						enc_sitestates |= (Lvb_bit_length)stateset['N'] << (k << NIBBLE_WIDTH_BITS);
+					else if (stateset[(unsigned char)row[col + k]] == 0)
+						bad = 0;
+					else
+						enc_sitestates |= (Lvb_bit_length)stateset[(unsigned char)row[col + k]]
+										  << (k << NIBBLE_WIDTH_BITS);
 				}
+				enc[mat->block_word[b] + full] = enc_sitestates;
+			}
+		}
 
-				lvb_assert(sitestate != 0U);
-				enc_sitestates |= sitestate << (k << NIBBLE_WIDTH_BITS);
+		if (bad != -1) /* find the character in the word, keeping the first row */
+		{
+			while (stateset[(unsigned char)row[col]] != 0)
+				col++;
+#pragma omp critical
+			if (i < bad_row)
+			{
+				bad_row = i;
+				bad_col = col;
 			}
-			enc_mat[i][j] = enc_sitestates;
 		}
 	}
+
+	if (bad_row < mat->n)
+		crash("bad base symbol '%c' in data MSA, row %ld ('%s'), column %ld of the columns kept",
+			  mat->row[bad_row][bad_col], bad_row + 1, mat->rowtitle[bad_row], bad_col + 1);
+
 } /* end DNAToBinary() */
 
 void rowfree(Dataptr MSA)
@@ -266,32 +427,45 @@ void rowfree(Dataptr MSA)
 		free(MSA->rowtitle);
 		MSA->row = NULL;
 	}
+	else if (MSA->rowtitle != NULL) /* set up from an alignment cache, titles only */
+	{
+		for (i = 0; i < MSA->n; ++i)
+			free(MSA->rowtitle[i]);
+		free(MSA->rowtitle);
+	}
+	MSA->rowtitle = NULL;
 
 } /* end rowfree() */
 
-static long constchar(Dataptr restrict MSA, Lvb_bool *const togo, const Lvb_bool verbose)
-/* Make sure MSA->m-element array togo is LVB_TRUE where MSA column
- * contains only one character state;
+void blockfree(Dataptr MSA)
+/* free memory used for the description of blocks of columns in MSA */
+{
+	free(MSA->block_col);
+	free(MSA->block_word);
+	free(MSA->block_weight);
+	MSA->block_col = NULL;
+	MSA->block_word = NULL;
+	MSA->block_weight = NULL;
+	MSA->n_blocks = 0;
+
+} /* end blockfree() */
+
+static long constchar(const Column_summary *summary, const long m, Lvb_bool *const togo, const Lvb_bool verbose)
+/* Make sure m-element array togo is LVB_TRUE where the column with the
+ * corresponding element of summary holds more than one character;
  * log details of new columns to ignore if verbose is LVB_TRUE.
- * scratch must point to the first element of an array of at least MSA->m
- * elements or arbitrary (even uninitialised) contents. It will be left with
- * arbitrary contents on return. */
+ * Return the number of such columns. */
 {
 	long k; /* loop counter */
-	long i; /* loop counter */
 	long n_columns = 0;
 
 	/* discover variable columns */
-	for (k = 0; k < MSA->m; ++k)
+	for (k = 0; k < m; ++k)
 	{
-		for (i = 1; i < MSA->n; ++i)
+		if (summary[k].varies != 0)
 		{
-			if (MSA->row[i][k] != MSA->row[0][k])
-			{
-				togo[k] = LVB_TRUE;
-				n_columns += 1;
-				break;
-			}
+			togo[k] = LVB_TRUE;
+			n_columns += 1;
 		}
 	}
 
@@ -301,108 +475,360 @@ static long constchar(Dataptr restrict MSA, Lvb_bool *const togo, const Lvb_bool
 		if (n_columns == 0)
 			printf(" none found.\n");
 		else
-			logcut(togo, MSA->m);
+			logcut(togo, m);
 	}
 	return n_columns;
 } /* end constchar() */
 
+static long informative(const Column_summary *summary, const long m, Lvb_bool *const tokeep, long *offset,
+						const Lvb_bool verbose)
+/* Make sure m-element array tokeep is LVB_TRUE where the column with the
+ * corresponding element of summary may help to tell one topology from
+ * another, and set *offset to the length of the other columns, which is
+ * the same on every tree; log details of new columns to ignore if verbose
+ * is LVB_TRUE.
+ * A column is uninformative if it holds only A, C, G or T and total
+ * ambiguity, and no more than one state appears more than once; its
+ * length is then one less than the number of states, as column_length()
+ * counts it. At least MIN_M columns are kept, informative or not.
+ * Return the number of columns to keep. */
+{
+	long n_columns = 0; /* number of columns to keep */
+	long n_spare;		/* uninformative columns still to keep */
+	long k;				/* loop counter */
+
+	*offset = 0;
+	for (k = 0; k < m; ++k)
+	{
+		if (((summary[k].symbols & ~SYMBOL_BASES) == 0) && (summary[k].symbols != 0)
+			&& (__builtin_popcount(summary[k].twice) <= 1))
+			*offset += column_length(&summary[k]);
+		else
+		{
+			tokeep[k] = LVB_TRUE;
+			n_columns += 1;
+		}
+	}
+
+	/* keep enough uninformative columns to make up the minimum, uncounted */
+	for (k = 0, n_spare = MIN_M - n_columns; (k < m) && (n_spare > 0); ++k)
+	{
+		if (tokeep[k] == LVB_FALSE)
+		{
+			*offset -= column_length(&summary[k]);
+			tokeep[k] = LVB_TRUE;
+			n_columns += 1;
+			n_spare -= 1;
+		}
+	}
+
+	if (verbose == LVB_TRUE)
+	{
+		printf("Uninformative columns excluded from analysis: ");
+		if (n_columns == m)
+			printf(" none found.\n");
+		else
+			logcut(tokeep, m);
+	}
+	return n_columns;
+} /* end informative() */
+
 void matchange(Dataptr MSA, const Parameters rcstruct)
 /* change and remove columns in MSA, partly in response to rcstruct,
- * verbosely or not according to value of verbose */
+ * verbosely or not according to value of verbose; what each column holds
+ * is found in one pass over MSA, and columns are cut in place */
 {
-	Lvb_bool *togo; /* LVB_TRUE where column must go */
+	Column_summary *summary; /* what each column holds */
+	Lvb_bool *togo;			 /* LVB_TRUE where column must stay, of all columns */
+	Lvb_bool *tokeep;		 /* LVB_TRUE where column must stay, of variable columns */
+	long *variable;			 /* column of each variable column */
+	long n_variable;		 /* number of variable columns */
 	long n_columns_to_change = 0;
+	long min_len = 0; /* least length of columns kept on any tree */
+	long k;			  /* loop counter */
 	/* Allocate memory: this will be free'd just before we return.
 	 * Dynamic allocation is used because otherwise, each of the
 	 * arrays would have to have MAX_M elements. That would either
 	 * limit the program too much, or causes massive waste of
 	 * address space. */
 
+	summary = (Column_summary *)alloc(MSA->m * sizeof(Column_summary), "column summaries");
 	togo = (Lvb_bool *)alloc(MSA->m * sizeof(Lvb_bool), "'togo' array");
+	summarise_columns(MSA, summary, rcstruct.n_processors_available);
+	check_symbols(MSA, summary);
 
 	/* initialize all elements to LVB_FALSE ('don't ignore') */
 	for (n_columns_to_change = 0; n_columns_to_change < MSA->m; n_columns_to_change++)
 		*(togo + n_columns_to_change) = LVB_FALSE;
 
-	n_columns_to_change = constchar(MSA, togo, (Lvb_bool)rcstruct.verbose); /* compuslory cut */
+	n_variable = constchar(summary, MSA->m, togo, (Lvb_bool)rcstruct.verbose); /* compuslory cut */
 
-	/* N.B. a function to mark autapomorphic characters for cutting
-	 * could be called at this point. The effect would be more noticeable
-	 * with unrealistically small test matrices than with real data */
-
-	/* cut the cols as indicated, and crash verbosely if too few remain */
-	if (n_columns_to_change != MSA->m)
-	{
-		cutcols(MSA, togo, n_columns_to_change); /* make changes to MSA */
-	}
-	else
-	{
-		MSA->bytes = bytes_per_row(MSA->m);
-		MSA->nwords = words_per_row(MSA->m);
-		MSA->tree_bytes = tree_bytes(MSA);
-		MSA->tree_bytes_without_sitestate = tree_bytes_without_sitestate(MSA);
-		MSA->min_len_tree = MinimumTreeLength(MSA);
-	}
-	if (MSA->m < MIN_M)
+	/* crash verbosely if too few columns remain */
+	if (n_variable < MIN_M)
 		crash("after constant columns are ignored, data MSA has\n"
 			  "%ld columns, which is less than LVB's lower limit of\n"
 			  "%ld columns.\n",
-			  MSA->m, MIN_M);
-	else
+			  n_variable, MIN_M);
+
+	/* cut autapomorphic and other uninformative columns too, remembering
+	 * their length, which is the same on every tree; they are numbered
+	 * among the variable columns, as if those had been cut already */
+	variable = (long *)alloc(n_variable * sizeof(long), "variable columns");
+	tokeep = (Lvb_bool *)alloc(n_variable * sizeof(Lvb_bool), "'tokeep' array");
+	for (k = 0, n_variable = 0; k < MSA->m; k++)
+	{
+		if (togo[k] == LVB_TRUE)
+		{
+			summary[n_variable] = summary[k];
+			variable[n_variable] = k;
+			tokeep[n_variable++] = LVB_FALSE;
+		}
+	}
+	n_columns_to_change = informative(summary, n_variable, tokeep, &MSA->length_offset, (Lvb_bool)rcstruct.verbose);
+	for (k = 0; k < n_variable; k++)
 	{
-		if (rcstruct.verbose == LVB_TRUE)
-			printf("\nIn total, %ld columns are excluded from the analysis\n\n", MSA->original_m - MSA->m);
+		if (tokeep[k] == LVB_TRUE)
+			min_len += column_length(&summary[k]);
+		else
+			togo[variable[k]] = LVB_FALSE;
 	}
+	if (n_columns_to_change != MSA->m)
+		cutcols(MSA, togo, n_columns_to_change, rcstruct.n_processors_available);
+	if (rcstruct.verbose == LVB_TRUE)
+		printf("\nIn total, %ld columns are excluded from the analysis\n\n", MSA->original_m - MSA->m);
+
+	/* optionally keep only one copy of each column pattern, with a weight,
+	 * which leaves the least length the same */
+	if (rcstruct.compress_patterns == LVB_TRUE)
+		compress_patterns(MSA, (Lvb_bool)rcstruct.verbose, rcstruct.n_processors_available);
+	else
+		single_block(MSA);
+	set_sizes(MSA);
+	MSA->min_len_tree = MSA->length_offset + min_len;
 
 	/* free "local" dynamic heap memory */
+	free(summary);
 	free(togo);
+	free(tokeep);
+	free(variable);
 
 } /* end matchange() */
 
-static void cutcols(Dataptr MSA, const Lvb_bool *const tocut, long n_columns_to_change)
+static void cutcols(Dataptr MSA, const Lvb_bool *const tocut, long n_columns_to_change, int n_threads)
 /* remove columns in MSA for which the corresponding element of
-MSA->m-element array tocut is LVB_TRUE, and update MSA->m;
-return the number of columns cut */
+MSA->m-element array tocut is LVB_FALSE, in place, sharing rows out among
+up to n_threads threads, and update MSA->m to n_columns_to_change, the
+number of columns left */
 {
-	char **newrow; /* rows of reduced MSA */
-	long i;		   /* loop counter */
-	long k;		   /* loop counter */
-	long newk;	   /* current column of reduced MSA */
-
-	long uun = MSA->n;
-	long uum = MSA->m;
-	/* memory for new MSA row array */
-	newrow = (char **)alloc((size_t)uun * sizeof(char *), "pointers to new row strings");
-	for (i = 0; i < uun; ++i)
-		newrow[i] = (char *)alloc(sizeof(char) * (n_columns_to_change + 1), "new row strings");
-
-	newk = 0;
-	for (k = 0; k < uum; ++k)
-	{ /* for every column */
+	long *kept; /* column of each column left */
+	long i;		/* loop counter */
+	long k;		/* loop counter */
+	long newk;	/* current column of reduced MSA */
+
+	kept = (long *)alloc(n_columns_to_change * sizeof(long), "columns kept");
+	for (k = 0, newk = 0; k < MSA->m; ++k)
+	{
 		if (tocut[k] == LVB_TRUE)
-		{							  /* keep this column */
-			for (i = 0; i < uun; ++i) /* fill for ea. row */
-				newrow[i][newk] = MSA->row[i][k];
-			++newk; /* fill next row next time */
-		}
+			kept[newk++] = k;
 	}
 
 	/* trap impossible condition */
 	lvb_assert(newk == n_columns_to_change);
 
-	/* terminate new row strings */
-	for (i = 0; i < uun; ++i)
-		newrow[i][newk] = '\0';
+	/* columns only move left, so each row can be done in place */
+#pragma omp parallel for num_threads(n_threads) schedule(static) private(newk) if (MSA->n * MSA->m >= MINIMUM_CELLS_TO_THREAD_COLUMNS)
+	for (i = 0; i < MSA->n; ++i)
+	{
+		for (newk = 0; newk < n_columns_to_change; ++newk)
+			MSA->row[i][newk] = MSA->row[i][kept[newk]];
+		MSA->row[i][newk] = '\0';
+	}
 
 	/* update MSA structure */
-	MSA->row = newrow;
 	MSA->m = n_columns_to_change;
-	MSA->bytes = bytes_per_row(MSA->m);
-	MSA->nwords = words_per_row(MSA->m);
+	free(kept);
+} /* end cutcols() */
+
+static void single_block(Dataptr MSA)
+/* describe the columns of MSA as one block, each column of weight 1 */
+{
+	MSA->n_blocks = 1;
+	MSA->block_col = (long *)alloc(2 * sizeof(long), "block columns");
+	MSA->block_word = (long *)alloc(2 * sizeof(long), "block words");
+	MSA->block_weight = (long *)alloc(sizeof(long), "block weights");
+	MSA->block_col[0] = 0;
+	MSA->block_col[1] = MSA->m;
+	MSA->block_word[0] = 0;
+	MSA->block_word[1] = words_per_row(MSA->m);
+	MSA->block_weight[0] = 1;
+
+} /* end single_block() */
+
+static void set_sizes(Dataptr MSA)
+/* set sizes of encoded rows and trees to suit the columns and blocks of
+ * MSA */
+{
+	MSA->nwords = MSA->block_word[MSA->n_blocks];
+	MSA->bytes = MSA->nwords * sizeof(Lvb_bit_length);
 	MSA->tree_bytes = tree_bytes(MSA);
 	MSA->tree_bytes_without_sitestate = tree_bytes_without_sitestate(MSA);
-	MSA->min_len_tree = MinimumTreeLength(MSA);
-} /* end cutcols() */
+
+} /* end set_sizes() */
+
+typedef struct /* column and hash of its contents */
+{
+	uint64_t hash;
+	long col;
+} Column_hash;
+
+typedef struct /* distinct column pattern */
+{
+	long weight; /* number of columns with this pattern */
+	long col;	 /* first column with this pattern */
+} Pattern;
+
+static int column_hash_cmp(const void *a, const void *b)
+/* order Column_hash by hash, then by column */
+{
+	const Column_hash *x = (const Column_hash *)a;
+	const Column_hash *y = (const Column_hash *)b;
+
+	if (x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+	return (x->col > y->col) - (x->col < y->col);
+
+} /* end column_hash_cmp() */
+
+static int pattern_cmp(const void *a, const void *b)
+/* order Pattern by weight, then by first column */
+{
+	const Pattern *x = (const Pattern *)a;
+	const Pattern *y = (const Pattern *)b;
+
+	if (x->weight != y->weight)
+		return (x->weight > y->weight) - (x->weight < y->weight);
+	return (x->col > y->col) - (x->col < y->col);
+
+} /* end pattern_cmp() */
+
+static Lvb_bool same_column(const Dataptr MSA, const long k1, const long k2)
+/* return LVB_TRUE if columns k1 and k2 of MSA are identical */
+{
+	long i; /* loop counter */
+
+	for (i = 0; i < MSA->n; ++i)
+	{
+		if (MSA->row[i][k1] != MSA->row[i][k2])
+			return LVB_FALSE;
+	}
+	return LVB_TRUE;
+
+} /* end same_column() */
+
+static void compress_patterns(Dataptr MSA, const Lvb_bool verbose, int n_threads)
+/* replace the columns of MSA by one copy of each distinct column pattern,
+ * sorted by the number of columns sharing it, and describe runs of patterns
+ * with the same count as blocks of that weight; each block starts on a new
+ * word, so the blocks can be scored separately and multiplied up; rows are
+ * changed in place, shared out among up to n_threads threads */
+{
+	Column_hash *colhash; /* hash of every column */
+	Pattern *pattern;	  /* distinct patterns */
+	long n_patterns = 0;  /* number of distinct patterns */
+	long run;			  /* first entry of run of equal hashes */
+	long first;			  /* first pattern found in current run */
+	long i;				  /* loop counter */
+	long k;				  /* loop counter */
+	long p;				  /* loop counter */
+	long b;				  /* current block */
+
+	/* FNV-1a hash of every column, reading the rows in order */
+	colhash = (Column_hash *)alloc(MSA->m * sizeof(Column_hash), "column hashes");
+	for (k = 0; k < MSA->m; ++k)
+	{
+		colhash[k].hash = 0xCBF29CE484222325U;
+		colhash[k].col = k;
+	}
+	for (i = 0; i < MSA->n; ++i)
+	{
+		for (k = 0; k < MSA->m; ++k)
+			colhash[k].hash = (colhash[k].hash ^ (unsigned char)MSA->row[i][k]) * 0x100000001B3U;
+	}
+	qsort(colhash, MSA->m, sizeof(Column_hash), column_hash_cmp);
+
+	/* group identical columns; columns with equal hashes are checked in full,
+	 * in case of collisions */
+	pattern = (Pattern *)alloc(MSA->m * sizeof(Pattern), "column patterns");
+	for (run = 0; run < MSA->m; run = k)
+	{
+		first = n_patterns;
+		for (k = run; (k < MSA->m) && (colhash[k].hash == colhash[run].hash); ++k)
+		{
+			for (p = first; p < n_patterns; ++p)
+			{
+				if (same_column(MSA, pattern[p].col, colhash[k].col) == LVB_TRUE)
+					break;
+			}
+			if (p == n_patterns)
+			{ /* new pattern */
+				pattern[n_patterns].col = colhash[k].col;
+				pattern[n_patterns++].weight = 0;
+			}
+			pattern[p].weight++;
+		}
+	}
+	free(colhash);
+	qsort(pattern, n_patterns, sizeof(Pattern), pattern_cmp);
+
+	/* blocks of equal weight */
+	MSA->n_blocks = 0;
+	for (p = 0; p < n_patterns; ++p)
+	{
+		if ((p == 0) || (pattern[p].weight != pattern[p - 1].weight))
+			MSA->n_blocks++;
+	}
+	MSA->block_col = (long *)alloc((MSA->n_blocks + 1) * sizeof(long), "block columns");
+	MSA->block_word = (long *)alloc((MSA->n_blocks + 1) * sizeof(long), "block words");
+	MSA->block_weight = (long *)alloc(MSA->n_blocks * sizeof(long), "block weights");
+	for (b = -1, p = 0; p < n_patterns; ++p)
+	{
+		if ((p == 0) || (pattern[p].weight != pattern[p - 1].weight))
+		{
+			b++;
+			MSA->block_col[b] = p;
+			MSA->block_weight[b] = pattern[p].weight;
+			MSA->block_word[b] = (b == 0) ? 0 : MSA->block_word[b - 1] + words_per_row(p - MSA->block_col[b - 1]);
+		}
+	}
+	MSA->block_col[MSA->n_blocks] = n_patterns;
+	MSA->block_word[MSA->n_blocks] = MSA->block_word[MSA->n_blocks - 1] + words_per_row(n_patterns - MSA->block_col[MSA->n_blocks - 1]);
+
+	/* rows hold one column per pattern, gathered in place through a row
+	 * of scratch for each thread */
+#pragma omp parallel num_threads(n_threads) if (MSA->n * MSA->m >= MINIMUM_CELLS_TO_THREAD_COLUMNS)
+	{
+		char *scratch = (char *)alloc(n_patterns, "row of patterns"); /* row being gathered */
+		long i;														  /* loop counter */
+		long p;														  /* loop counter */
+
+#pragma omp for schedule(static)
+		for (i = 0; i < MSA->n; ++i)
+		{
+			for (p = 0; p < n_patterns; ++p)
+				scratch[p] = MSA->row[i][pattern[p].col];
+			memcpy(MSA->row[i], scratch, n_patterns);
+			MSA->row[i][n_patterns] = '\0';
+		}
+		free(scratch);
+	}
+	free(pattern);
+
+	if (verbose == LVB_TRUE)
+		printf("Site pattern compression: %ld columns merged into %ld weighted patterns in %ld blocks\n\n",
+			   MSA->m, n_patterns, MSA->n_blocks);
+	MSA->m = n_patterns;
+
+} /* end compress_patterns() */
 
 static void logcut(const Lvb_bool *const cut, const long m)
 /* log message saying columns for which m-element array cut is LVB_TRUE are
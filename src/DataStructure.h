@@ -52,6 +52,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define FORMAT_NEXUS 2
 #define FORMAT_CLUSTAL 3
 
+#define FITCH_KERNEL_AUTO 0
+#define FITCH_KERNEL_SCALAR 1
+#define FITCH_KERNEL_SSE42 2
+#define FITCH_KERNEL_AVX2 3
+#define FITCH_KERNEL_AVX512 4
+
+#define HILLCLIMB_NONE 0
+#define HILLCLIMB_SPR 1
+#define HILLCLIMB_TBR 2
+
 typedef enum
 {
     LVB_FALSE,
@@ -64,6 +74,8 @@ typedef struct data
 {
     int n_threads_getplen;         /* number of possible threads in getplen function */
     int n_slice_size_getplen;      /* slice size in getplen function, usually m/n_threads_getplen  */
+    int getplen_strategy;          /* GETPLEN_SLICES or GETPLEN_SUBTREES */
+    long min_branches_subtree_tasks; /* dirty branches needed for one getplen call to use subtree tasks */
     long m;                        /* number of columns */
     long original_m;               /* number of columns read from MSA*/
     long n;                        /* number of rows */
@@ -74,8 +86,15 @@ typedef struct data
     long tree_bytes_without_sitestate; /* length the tree in bytes without sitestate */
     long nwords;
     long min_len_tree; /*  minimum length of any tree based on MSA */
+    long length_offset; /* length of uninformative columns, the same on any tree */
     long nsets;        /* sets per tree */
     long mssz;         /* maximum objects per set */
+    long split_words;  /* words in the bitset of one split, one bit per object */
+    long n_blocks;     /* number of blocks of columns of equal weight */
+    long *block_col;   /* first column of each block, then m */
+    long *block_word;  /* first word of each block, then nwords */
+    long *block_weight; /* weight of every column in each block */
+    const uint64_t *enc_rows; /* encoded rows (Lvb_bit_length) from an alignment cache, nwords each, or NULL */
     char **row;        /* array of row strings */
     char **rowtitle;   /* array of row title strings */
 } *Dataptr, DataStructure;
@@ -94,6 +113,25 @@ typedef struct
     char file_name_in[LVB_FNAMSIZE];  /* input file name */
     char file_name_out[LVB_FNAMSIZE]; /* output file name */
     int n_number_max_trees;           /* number of EPT to be saved */
+    long n_sample_trees;              /* EPT kept as a random sample, or 0 to keep all */
+    int fitch_kernel;                 /* Fitch kernel, must be one of FITCH_KERNEL_* */
+    Lvb_bool compress_patterns;       /* merge identical columns into weighted patterns */
+    Lvb_bool indirect_scoring;        /* score SPR and TBR proposals without making them */
+    int hillclimb;                    /* final hill climbing, must be one of HILLCLIMB_* */
+    int n_chains;                     /* annealing chains run at once, one per thread */
+    int n_replicas;                   /* replicas for replica exchange, one per thread, or 0 if none */
+    int batch_size;                   /* proposals scored at once in Anneal(), one per thread */
+    char file_name_checkpoint[LVB_FNAMSIZE]; /* checkpoint file name, or empty if none */
+    long checkpoint_every;            /* iterations between checkpoints, or 0 if not counted */
+    long checkpoint_seconds;          /* seconds between checkpoints, or 0 if not timed */
+    Lvb_bool resume;                  /* carry on from the checkpoint file */
+    int rng;                          /* random number generator, RNG_UNI or RNG_PHILOX */
+    long treestack_memory;            /* bytes of best trees kept in memory, or 0 for no limit */
+    Lvb_bool matrix_cache;            /* keep the encoded alignment in a cache beside it */
+    char shared_matrix[LVB_FNAMSIZE]; /* shared memory segment for the encoded alignment, or empty if none */
+    Lvb_bool remove_shared_matrix;    /* only remove shared_matrix, then stop */
+    long min_taxa_subtree_tasks;      /* taxa needed to thread getplen by subtrees */
+    long min_branches_subtree_tasks;  /* dirty branches needed for one getplen call to use subtree tasks */
 } Parameters;
 
 #endif // SRC_DATASTRUCTURE_H_
@@ -0,0 +1,518 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro and Maximilian Strobl.
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* ========== FitchKernel.c - vectorised Fitch state-set kernels ========== */
+
+/*
+
+Provides the inner loop of getplen() in several instruction-set variants:
+portable scalar, SSE4.2 (POPCNT), AVX2 and AVX-512 (VPOPCNTQ). All variants
+give bit-identical state sets and change counts. The variant is chosen once
+by CPUID, or forced by the user, and is then called through fitch_pair and
+fitch_root.
+
+Each 64-bit word holds 16 nibble-packed state sets. For x and y, bit 3 of
+each nibble of
+    u = (((x & y & MASK_SEVEN) + MASK_SEVEN) | (x & y)) & MASK_EIGHT
+is set where the intersection is not empty, so the word costs
+LENGTH_WORD - popcount(u) changes.
+
+**********/
+
+#include "FitchKernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LVB_FITCH_X86
+#include <immintrin.h>
+#endif
+
+static int current_kernel = FITCH_KERNEL_AUTO; /* kernel in use, AUTO if none yet */
+
+/* --- scalar ------------------------------------------------------------ */
+
+static inline long nibble_flag_count(Lvb_bit_length u)
+/* return number of nibbles with bit 3 set, u having no other bits set */
+{
+	u >>= 3;
+	u = (u + (u >> 4)) & 0x0F0F0F0F0F0F0F0FU;
+	return (long)((u * 0x0101010101010101U) >> 56);
+
+} /* end nibble_flag_count() */
+
+static long fitch_pair_scalar(const Lvb_bit_length *restrict l, const Lvb_bit_length *restrict r,
+							  Lvb_bit_length *restrict dest, long nwords)
+{
+	long changes = 0; /* changes in these words */
+	long j;			  /* loop counter */
+	Lvb_bit_length x, y, xy, u;
+
+	for (j = 0; j < nwords; j++)
+	{
+		x = l[j];
+		y = r[j];
+		xy = x & y;
+		u = (((xy & MASK_SEVEN) + MASK_SEVEN) | xy) & MASK_EIGHT;
+		changes += LENGTH_WORD - nibble_flag_count(u);
+		u >>= 3;
+		dest[j] = xy | ((x | y) & ((u + MASK_SEVEN) ^ MASK_EIGHT));
+	}
+	return changes;
+
+} /* end fitch_pair_scalar() */
+
+static long fitch_root_scalar(const Lvb_bit_length *restrict l, const Lvb_bit_length *restrict r,
+							  const Lvb_bit_length *restrict rootset, long nwords)
+{
+	long changes = 0; /* changes in these words */
+	long j;			  /* loop counter */
+	Lvb_bit_length x, y, xy, u;
+
+	for (j = 0; j < nwords; j++)
+	{
+		x = l[j];
+		y = r[j];
+		xy = x & y;
+		u = (((xy & MASK_SEVEN) + MASK_SEVEN) | xy) & MASK_EIGHT;
+		changes += LENGTH_WORD - nibble_flag_count(u);
+		u >>= 3;
+		x = xy | ((x | y) & ((u + MASK_SEVEN) ^ MASK_EIGHT));
+		xy = x & rootset[j];
+		u = (((xy & MASK_SEVEN) + MASK_SEVEN) | xy) & MASK_EIGHT;
+		changes += LENGTH_WORD - nibble_flag_count(u);
+	}
+	return changes;
+
+} /* end fitch_root_scalar() */
+
+#ifdef LVB_FITCH_X86
+
+/* --- SSE4.2 ------------------------------------------------------------ */
+
+__attribute__((target("sse4.2,popcnt"))) static long fitch_pair_sse42(const Lvb_bit_length *restrict l,
+																		const Lvb_bit_length *restrict r,
+																		Lvb_bit_length *restrict dest, long nwords)
+{
+	const __m128i seven = _mm_set1_epi64x((long long)MASK_SEVEN);
+	const __m128i eight = _mm_set1_epi64x((long long)MASK_EIGHT);
+	long changes = 0; /* changes in these words */
+	long j = 0;		  /* loop counter */
+	__m128i x, y, xy, u;
+	Lvb_bit_length sx, sy, sxy, su;
+
+	for (; j + 2 <= nwords; j += 2)
+	{
+		x = _mm_loadu_si128((const __m128i *)(l + j));
+		y = _mm_loadu_si128((const __m128i *)(r + j));
+		xy = _mm_and_si128(x, y);
+		u = _mm_and_si128(_mm_or_si128(_mm_add_epi64(_mm_and_si128(xy, seven), seven), xy), eight);
+		changes += 2 * LENGTH_WORD - (long)_mm_popcnt_u64((unsigned long long)_mm_cvtsi128_si64(u)) -
+				   (long)_mm_popcnt_u64((unsigned long long)_mm_extract_epi64(u, 1));
+		u = _mm_srli_epi64(u, 3);
+		_mm_storeu_si128((__m128i *)(dest + j),
+						 _mm_or_si128(xy, _mm_and_si128(_mm_or_si128(x, y), _mm_xor_si128(_mm_add_epi64(u, seven), eight))));
+	}
+	for (; j < nwords; j++)
+	{
+		sx = l[j];
+		sy = r[j];
+		sxy = sx & sy;
+		su = (((sxy & MASK_SEVEN) + MASK_SEVEN) | sxy) & MASK_EIGHT;
+		changes += LENGTH_WORD - (long)_mm_popcnt_u64(su);
+		su >>= 3;
+		dest[j] = sxy | ((sx | sy) & ((su + MASK_SEVEN) ^ MASK_EIGHT));
+	}
+	return changes;
+
+} /* end fitch_pair_sse42() */
+
+__attribute__((target("sse4.2,popcnt"))) static long fitch_root_sse42(const Lvb_bit_length *restrict l,
+																		const Lvb_bit_length *restrict r,
+																		const Lvb_bit_length *restrict rootset, long nwords)
+{
+	const __m128i seven = _mm_set1_epi64x((long long)MASK_SEVEN);
+	const __m128i eight = _mm_set1_epi64x((long long)MASK_EIGHT);
+	long changes = 0; /* changes in these words */
+	long j = 0;		  /* loop counter */
+	__m128i x, y, xy, u;
+	Lvb_bit_length sx, sy, sxy, su;
+
+	for (; j + 2 <= nwords; j += 2)
+	{
+		x = _mm_loadu_si128((const __m128i *)(l + j));
+		y = _mm_loadu_si128((const __m128i *)(r + j));
+		xy = _mm_and_si128(x, y);
+		u = _mm_and_si128(_mm_or_si128(_mm_add_epi64(_mm_and_si128(xy, seven), seven), xy), eight);
+		changes += 2 * LENGTH_WORD - (long)_mm_popcnt_u64((unsigned long long)_mm_cvtsi128_si64(u)) -
+				   (long)_mm_popcnt_u64((unsigned long long)_mm_extract_epi64(u, 1));
+		u = _mm_srli_epi64(u, 3);
+		x = _mm_or_si128(xy, _mm_and_si128(_mm_or_si128(x, y), _mm_xor_si128(_mm_add_epi64(u, seven), eight)));
+		xy = _mm_and_si128(x, _mm_loadu_si128((const __m128i *)(rootset + j)));
+		u = _mm_and_si128(_mm_or_si128(_mm_add_epi64(_mm_and_si128(xy, seven), seven), xy), eight);
+		changes += 2 * LENGTH_WORD - (long)_mm_popcnt_u64((unsigned long long)_mm_cvtsi128_si64(u)) -
+				   (long)_mm_popcnt_u64((unsigned long long)_mm_extract_epi64(u, 1));
+	}
+	for (; j < nwords; j++)
+	{
+		sx = l[j];
+		sy = r[j];
+		sxy = sx & sy;
+		su = (((sxy & MASK_SEVEN) + MASK_SEVEN) | sxy) & MASK_EIGHT;
+		changes += LENGTH_WORD - (long)_mm_popcnt_u64(su);
+		su >>= 3;
+		sx = sxy | ((sx | sy) & ((su + MASK_SEVEN) ^ MASK_EIGHT));
+		sxy = sx & rootset[j];
+		su = (((sxy & MASK_SEVEN) + MASK_SEVEN) | sxy) & MASK_EIGHT;
+		changes += LENGTH_WORD - (long)_mm_popcnt_u64(su);
+	}
+	return changes;
+
+} /* end fitch_root_sse42() */
+
+/* --- AVX2 -------------------------------------------------------------- */
+
+/* AVX2 has no 64-bit popcount, but u only has bit 3 of each nibble set: fold
+ * the flags into bytes and sum bytes per 64-bit lane with VPSADBW */
+__attribute__((target("avx2"))) static inline __m256i nibble_flag_count_avx2(__m256i u)
+{
+	const __m256i low = _mm256_set1_epi8(0x0F);
+	__m256i t = _mm256_srli_epi64(u, 3);
+
+	t = _mm256_add_epi8(_mm256_and_si256(t, low), _mm256_and_si256(_mm256_srli_epi64(t, 4), low));
+	return _mm256_sad_epu8(t, _mm256_setzero_si256());
+
+} /* end nibble_flag_count_avx2() */
+
+__attribute__((target("avx2"))) static inline long hsum_avx2(__m256i v)
+/* return sum of the four 64-bit lanes of v */
+{
+	__m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	return (long)(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+
+} /* end hsum_avx2() */
+
+__attribute__((target("avx2"))) static long fitch_pair_avx2(const Lvb_bit_length *restrict l,
+															  const Lvb_bit_length *restrict r,
+															  Lvb_bit_length *restrict dest, long nwords)
+{
+	const __m256i seven = _mm256_set1_epi64x((long long)MASK_SEVEN);
+	const __m256i eight = _mm256_set1_epi64x((long long)MASK_EIGHT);
+	__m256i acc = _mm256_setzero_si256(); /* per-lane count of non-empty intersections */
+	long j = 0;							  /* loop counter */
+	__m256i x, y, xy, u;
+
+	for (; j + 4 <= nwords; j += 4)
+	{
+		x = _mm256_loadu_si256((const __m256i *)(l + j));
+		y = _mm256_loadu_si256((const __m256i *)(r + j));
+		xy = _mm256_and_si256(x, y);
+		u = _mm256_and_si256(_mm256_or_si256(_mm256_add_epi64(_mm256_and_si256(xy, seven), seven), xy), eight);
+		acc = _mm256_add_epi64(acc, nibble_flag_count_avx2(u));
+		u = _mm256_srli_epi64(u, 3);
+		_mm256_storeu_si256((__m256i *)(dest + j),
+							_mm256_or_si256(xy, _mm256_and_si256(_mm256_or_si256(x, y),
+																 _mm256_xor_si256(_mm256_add_epi64(u, seven), eight))));
+	}
+	return j * LENGTH_WORD - hsum_avx2(acc) + fitch_pair_scalar(l + j, r + j, dest + j, nwords - j);
+
+} /* end fitch_pair_avx2() */
+
+__attribute__((target("avx2"))) static long fitch_root_avx2(const Lvb_bit_length *restrict l,
+															  const Lvb_bit_length *restrict r,
+															  const Lvb_bit_length *restrict rootset, long nwords)
+{
+	const __m256i seven = _mm256_set1_epi64x((long long)MASK_SEVEN);
+	const __m256i eight = _mm256_set1_epi64x((long long)MASK_EIGHT);
+	__m256i acc = _mm256_setzero_si256(); /* per-lane count of non-empty intersections */
+	long j = 0;							  /* loop counter */
+	__m256i x, y, xy, u;
+
+	for (; j + 4 <= nwords; j += 4)
+	{
+		x = _mm256_loadu_si256((const __m256i *)(l + j));
+		y = _mm256_loadu_si256((const __m256i *)(r + j));
+		xy = _mm256_and_si256(x, y);
+		u = _mm256_and_si256(_mm256_or_si256(_mm256_add_epi64(_mm256_and_si256(xy, seven), seven), xy), eight);
+		acc = _mm256_add_epi64(acc, nibble_flag_count_avx2(u));
+		u = _mm256_srli_epi64(u, 3);
+		x = _mm256_or_si256(xy, _mm256_and_si256(_mm256_or_si256(x, y), _mm256_xor_si256(_mm256_add_epi64(u, seven), eight)));
+		xy = _mm256_and_si256(x, _mm256_loadu_si256((const __m256i *)(rootset + j)));
+		u = _mm256_and_si256(_mm256_or_si256(_mm256_add_epi64(_mm256_and_si256(xy, seven), seven), xy), eight);
+		acc = _mm256_add_epi64(acc, nibble_flag_count_avx2(u));
+	}
+	return 2 * j * LENGTH_WORD - hsum_avx2(acc) + fitch_root_scalar(l + j, r + j, rootset + j, nwords - j);
+
+} /* end fitch_root_avx2() */
+
+/* --- AVX-512 ----------------------------------------------------------- */
+
+/* the plain forms of _mm512_srli_epi64() and _mm512_extracti64x4_epi64(),
+ * and the casts and reductions built on them, merge into an undefined
+ * vector, which GCC warns of; the zero-masked forms with every lane kept
+ * give the same result from an explicit zero vector */
+#define ALL_LANES_512 ((__mmask8)0xFF)
+
+__attribute__((target("avx512f"))) static inline long hsum_avx512(__m512i v)
+/* return sum of the eight 64-bit lanes of v */
+{
+	return hsum_avx2(_mm256_add_epi64(_mm512_maskz_extracti64x4_epi64(ALL_LANES_512, v, 0),
+									  _mm512_maskz_extracti64x4_epi64(ALL_LANES_512, v, 1)));
+
+} /* end hsum_avx512() */
+
+__attribute__((target("avx512f,avx512vpopcntdq"))) static long fitch_pair_avx512(const Lvb_bit_length *restrict l,
+																				   const Lvb_bit_length *restrict r,
+																				   Lvb_bit_length *restrict dest, long nwords)
+{
+	const __m512i seven = _mm512_set1_epi64((long long)MASK_SEVEN);
+	const __m512i eight = _mm512_set1_epi64((long long)MASK_EIGHT);
+	__m512i acc = _mm512_setzero_si512(); /* per-lane count of non-empty intersections */
+	long j = 0;							  /* loop counter */
+	__m512i x, y, xy, u;
+
+	for (; j + 8 <= nwords; j += 8)
+	{
+		x = _mm512_loadu_si512((const void *)(l + j));
+		y = _mm512_loadu_si512((const void *)(r + j));
+		xy = _mm512_and_si512(x, y);
+		u = _mm512_and_si512(_mm512_or_si512(_mm512_add_epi64(_mm512_and_si512(xy, seven), seven), xy), eight);
+		acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(u));
+		u = _mm512_maskz_srli_epi64(ALL_LANES_512, u, 3);
+		_mm512_storeu_si512((void *)(dest + j),
+							_mm512_or_si512(xy, _mm512_and_si512(_mm512_or_si512(x, y),
+																 _mm512_xor_si512(_mm512_add_epi64(u, seven), eight))));
+	}
+	return j * LENGTH_WORD - hsum_avx512(acc) + fitch_pair_scalar(l + j, r + j, dest + j, nwords - j);
+
+} /* end fitch_pair_avx512() */
+
+__attribute__((target("avx512f,avx512vpopcntdq"))) static long fitch_root_avx512(const Lvb_bit_length *restrict l,
+																				   const Lvb_bit_length *restrict r,
+																				   const Lvb_bit_length *restrict rootset, long nwords)
+{
+	const __m512i seven = _mm512_set1_epi64((long long)MASK_SEVEN);
+	const __m512i eight = _mm512_set1_epi64((long long)MASK_EIGHT);
+	__m512i acc = _mm512_setzero_si512(); /* per-lane count of non-empty intersections */
+	long j = 0;							  /* loop counter */
+	__m512i x, y, xy, u;
+
+	for (; j + 8 <= nwords; j += 8)
+	{
+		x = _mm512_loadu_si512((const void *)(l + j));
+		y = _mm512_loadu_si512((const void *)(r + j));
+		xy = _mm512_and_si512(x, y);
+		u = _mm512_and_si512(_mm512_or_si512(_mm512_add_epi64(_mm512_and_si512(xy, seven), seven), xy), eight);
+		acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(u));
+		u = _mm512_maskz_srli_epi64(ALL_LANES_512, u, 3);
+		x = _mm512_or_si512(xy, _mm512_and_si512(_mm512_or_si512(x, y), _mm512_xor_si512(_mm512_add_epi64(u, seven), eight)));
+		xy = _mm512_and_si512(x, _mm512_loadu_si512((const void *)(rootset + j)));
+		u = _mm512_and_si512(_mm512_or_si512(_mm512_add_epi64(_mm512_and_si512(xy, seven), seven), xy), eight);
+		acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(u));
+	}
+	return 2 * j * LENGTH_WORD - hsum_avx512(acc) +
+		   fitch_root_scalar(l + j, r + j, rootset + j, nwords - j);
+
+} /* end fitch_root_avx512() */
+
+#endif /* LVB_FITCH_X86 */
+
+/* --- dispatch ---------------------------------------------------------- */
+
+/* until a kernel is selected, the function pointers point at these, which
+ * select the best available kernel on first use */
+static long fitch_pair_resolve(const Lvb_bit_length *restrict l, const Lvb_bit_length *restrict r,
+							   Lvb_bit_length *restrict dest, long nwords)
+{
+	fitch_kernel_select(FITCH_KERNEL_AUTO);
+	return fitch_pair(l, r, dest, nwords);
+
+} /* end fitch_pair_resolve() */
+
+static long fitch_root_resolve(const Lvb_bit_length *restrict l, const Lvb_bit_length *restrict r,
+							   const Lvb_bit_length *restrict rootset, long nwords)
+{
+	fitch_kernel_select(FITCH_KERNEL_AUTO);
+	return fitch_root(l, r, rootset, nwords);
+
+} /* end fitch_root_resolve() */
+
+Fitch_pair_fn fitch_pair = fitch_pair_resolve;
+Fitch_root_fn fitch_root = fitch_root_resolve;
+
+long fitch_pair_bounded(const Lvb_bit_length *restrict l, const Lvb_bit_length *restrict r,
+						Lvb_bit_length *restrict dest, long nwords, long limit)
+/* as fitch_pair(), but stop early once the changes exceed limit, in which
+ * case dest is only partly written and the changes so far are returned */
+{
+	long changes = 0; /* changes so far */
+	long j;			  /* first word of current chunk */
+	long chunk;		  /* words in current chunk */
+
+	for (j = 0; j < nwords; j += chunk)
+	{
+		/* no need to check again if even the worst case stays in limit */
+		if (changes + (nwords - j) * LENGTH_WORD <= limit)
+			return changes + fitch_pair(l + j, r + j, dest + j, nwords - j);
+		chunk = nwords - j < FITCH_BOUND_CHUNK_WORDS ? nwords - j : FITCH_BOUND_CHUNK_WORDS;
+		changes += fitch_pair(l + j, r + j, dest + j, chunk);
+		if (changes > limit)
+			break;
+	}
+	return changes;
+
+} /* end fitch_pair_bounded() */
+
+long fitch_root_bounded(const Lvb_bit_length *restrict l, const Lvb_bit_length *restrict r,
+						const Lvb_bit_length *restrict rootset, long nwords, long limit)
+/* as fitch_root(), but stop early once the changes exceed limit, in which
+ * case the changes so far are returned */
+{
+	long changes = 0; /* changes so far */
+	long j;			  /* first word of current chunk */
+	long chunk;		  /* words in current chunk */
+
+	for (j = 0; j < nwords; j += chunk)
+	{
+		if (changes + (nwords - j) * 2 * LENGTH_WORD <= limit)
+			return changes + fitch_root(l + j, r + j, rootset + j, nwords - j);
+		chunk = nwords - j < FITCH_BOUND_CHUNK_WORDS ? nwords - j : FITCH_BOUND_CHUNK_WORDS;
+		changes += fitch_root(l + j, r + j, rootset + j, chunk);
+		if (changes > limit)
+			break;
+	}
+	return changes;
+
+} /* end fitch_root_bounded() */
+
+Lvb_bool fitch_kernel_supported(int kernel)
+/* return LVB_TRUE if this CPU can run kernel, LVB_FALSE otherwise */
+{
+	if (kernel == FITCH_KERNEL_AUTO || kernel == FITCH_KERNEL_SCALAR)
+		return LVB_TRUE;
+#ifdef LVB_FITCH_X86
+	__builtin_cpu_init();
+	if (kernel == FITCH_KERNEL_SSE42)
+		return (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) ? LVB_TRUE : LVB_FALSE;
+	if (kernel == FITCH_KERNEL_AVX2)
+		return __builtin_cpu_supports("avx2") ? LVB_TRUE : LVB_FALSE;
+	if (kernel == FITCH_KERNEL_AVX512)
+		return (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")) ? LVB_TRUE : LVB_FALSE;
+#endif
+	return LVB_FALSE;
+
+} /* end fitch_kernel_supported() */
+
+int fitch_kernel_select(int kernel)
+/* point fitch_pair and fitch_root at kernel, or at the fastest kernel this
+ * CPU supports if kernel is FITCH_KERNEL_AUTO; crash verbosely if kernel is
+ * not supported; return the kernel selected */
+{
+	if (kernel == FITCH_KERNEL_AUTO)
+	{
+		if (fitch_kernel_supported(FITCH_KERNEL_AVX512))
+			kernel = FITCH_KERNEL_AVX512;
+		else if (fitch_kernel_supported(FITCH_KERNEL_AVX2))
+			kernel = FITCH_KERNEL_AVX2;
+		else if (fitch_kernel_supported(FITCH_KERNEL_SSE42))
+			kernel = FITCH_KERNEL_SSE42;
+		else
+			kernel = FITCH_KERNEL_SCALAR;
+	}
+	else if (fitch_kernel_supported(kernel) == LVB_FALSE)
+		crash("Fitch kernel '%s' is not supported on this CPU", fitch_kernel_name(kernel));
+
+	switch (kernel)
+	{
+#ifdef LVB_FITCH_X86
+	case FITCH_KERNEL_SSE42:
+		fitch_pair = fitch_pair_sse42;
+		fitch_root = fitch_root_sse42;
+		break;
+	case FITCH_KERNEL_AVX2:
+		fitch_pair = fitch_pair_avx2;
+		fitch_root = fitch_root_avx2;
+		break;
+	case FITCH_KERNEL_AVX512:
+		fitch_pair = fitch_pair_avx512;
+		fitch_root = fitch_root_avx512;
+		break;
+#endif
+	default:
+		kernel = FITCH_KERNEL_SCALAR;
+		fitch_pair = fitch_pair_scalar;
+		fitch_root = fitch_root_scalar;
+	}
+	current_kernel = kernel;
+	return kernel;
+
+} /* end fitch_kernel_select() */
+
+int fitch_kernel_current(void)
+/* return kernel in use, selecting one first if necessary */
+{
+	if (current_kernel == FITCH_KERNEL_AUTO)
+		fitch_kernel_select(FITCH_KERNEL_AUTO);
+	return current_kernel;
+
+} /* end fitch_kernel_current() */
+
+const char *fitch_kernel_name(int kernel)
+/* return name of kernel, as used on the command line */
+{
+	switch (kernel)
+	{
+	case FITCH_KERNEL_AUTO:
+		return "auto";
+	case FITCH_KERNEL_SCALAR:
+		return "scalar";
+	case FITCH_KERNEL_SSE42:
+		return "sse42";
+	case FITCH_KERNEL_AVX2:
+		return "avx2";
+	case FITCH_KERNEL_AVX512:
+		return "avx512";
+	default:
+		return "unknown";
+	}
+
+} /* end fitch_kernel_name() */
@@ -0,0 +1,79 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro and Maximilian Strobl.
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* ========== FitchKernel.h - interface for FitchKernel.c ========== */
+
+#ifndef LVB_FITCHKERNEL_H
+#define LVB_FITCHKERNEL_H
+
+#include "LVB.h"
+
+/* Fitch step over nwords words: write the state sets of the parent of l and
+ * r to dest and return the number of changes */
+typedef long (*Fitch_pair_fn)(const Lvb_bit_length *restrict l, const Lvb_bit_length *restrict r,
+							  Lvb_bit_length *restrict dest, long nwords);
+
+/* Fitch step at the root: changes for joining l and r, plus changes for
+ * joining the result with the root leaf's state sets, without storing
+ * anything */
+typedef long (*Fitch_root_fn)(const Lvb_bit_length *restrict l, const Lvb_bit_length *restrict r,
+							  const Lvb_bit_length *restrict rootset, long nwords);
+
+extern Fitch_pair_fn fitch_pair;
+extern Fitch_root_fn fitch_root;
+
+/* words done between checks against the limit in the bounded kernels */
+#define FITCH_BOUND_CHUNK_WORDS 256
+
+long fitch_pair_bounded(const Lvb_bit_length *restrict l, const Lvb_bit_length *restrict r,
+						Lvb_bit_length *restrict dest, long nwords, long limit);
+long fitch_root_bounded(const Lvb_bit_length *restrict l, const Lvb_bit_length *restrict r,
+						const Lvb_bit_length *restrict rootset, long nwords, long limit);
+
+int fitch_kernel_select(int kernel);
+Lvb_bool fitch_kernel_supported(int kernel);
+int fitch_kernel_current(void);
+const char *fitch_kernel_name(int kernel);
+
+#endif /* LVB_FITCHKERNEL_H */
@@ -46,70 +46,138 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Hash.h"
 
-long CompareHashTreeToHashstack(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NODES *const BranchArray, const long root, Lvb_bool b_with_sitestate)
+static void canonical_children(Dataptr MSA, TREESTACK_TREE_NODES *const BranchArray, const long root, long *p_todo_arr,
+                               long *p_least)
+/* swap children in the tree in BranchArray (of root root) so that, at every
+ * branch, the left subtree has the leaf of lowest number; p_todo_arr and
+ * p_least are scratch arrays of MSA->numberofpossiblebranches elements */
 {
-  long i = 0, new_root = 0;
-  static TREESTACK_TREE_NODES *copy_2 = NULL;
-  Lvb_bool b_First = LVB_TRUE;
-  std::string current_site_states;
-  unsigned long long current_site_states_hash = 0;
-  static std::unordered_set<unsigned long long> hashSet;
-  unsigned long long HashKey = 0;
-
-  /* allocate "local" static heap memory - static - do not free! */
-  if (copy_2 == NULL)
-    copy_2 = treealloc(MSA, b_with_sitestate);
-  treecopy(MSA, copy_2, BranchArray, b_with_sitestate);
-  if (root != 0)
+  long n_todo = 0; /* branches on p_todo_arr */
+  long i;          /* loop counter */
+  long branch;     /* current branch */
+  long swap;       /* child being swapped */
+
+  /* list the branches parents first, then take them children first */
+  p_todo_arr[n_todo++] = root;
+  for (i = 0; i < n_todo; i++)
   {
-    lvb_reroot(MSA, copy_2, root, new_root, b_with_sitestate);
+    branch = p_todo_arr[i];
+    if ((branch == root) || (branch >= MSA->n))
+    {
+      p_todo_arr[n_todo++] = BranchArray[branch].left;
+      p_todo_arr[n_todo++] = BranchArray[branch].right;
+    }
   }
-
-  /* if treestack is empty, add current config */
-  if (sp->next == 0)
+  for (i = n_todo - 1; i >= 0; i--)
   {
-    current_site_states = MakeHashSet(MSA, copy_2, new_root);
-    current_site_states_hash = HashSiteSet(current_site_states);
-    hashSet.clear();
-    HashKey = HashSiteSet(current_site_states);
+    branch = p_todo_arr[i];
+    if ((branch != root) && (branch < MSA->n))
+      p_least[branch] = branch;
+    else
+    {
+      if (p_least[BranchArray[branch].left] > p_least[BranchArray[branch].right])
+      {
+        swap = BranchArray[branch].left;
+        BranchArray[branch].left = BranchArray[branch].right;
+        BranchArray[branch].right = swap;
+      }
+      p_least[branch] = p_least[BranchArray[branch].left];
+    }
   }
-  else
-  {
-    current_site_states = MakeHashSet(MSA, copy_2, 0);
-    HashKey = HashSiteSet(current_site_states);
+} /* end canonical_children() */
 
-    if (hashSet.find(HashKey) != hashSet.end())
-      return 0;
+void SharedTreestackInit(Shared_treestack *shared, TREESTACK *sp)
+/* make shared an empty store of best trees, kept in the tree stack *sp */
+{
+  ClearTreestack(sp);
+  shared->stack = sp;
+  shared->length = LONG_MAX;
+  if (pthread_mutex_init(&shared->lock, NULL) != 0)
+    crash("cannot create lock for best tree stack");
+} /* end SharedTreestackInit() */
+
+void SharedTreestackFree(Shared_treestack *shared)
+/* free what SharedTreestackInit() made; the tree stack itself is kept */
+{
+  pthread_mutex_destroy(&shared->lock);
+} /* end SharedTreestackFree() */
+
+long CompareTreeToSharedTreestack(Dataptr MSA, Shared_treestack *shared, Fingerprint_set *seen,
+                                  const TREESTACK_TREE_NODES *const BranchArray, const long root, const long length)
+/* offer the tree in BranchArray (of root root), of length length, to the
+ * best trees in shared: if it is shorter than them they are discarded for
+ * it, and if it is as short it is added unless its topology is there
+ * already; seen holds the fingerprints of topologies offered by the caller
+ * since its own best length last fell, and is updated; return 1 if the
+ * topology was not in seen, or 0 if it was; may be called by several
+ * threads at once */
+{
+  static thread_local TREESTACK_TREE_NODES *copy_2 = NULL; /* possibly re-rooted tree */
+  static thread_local long *p_todo_arr = NULL;             /* scratch for canonical_children() */
+  static thread_local long *p_least = NULL;                /* scratch for canonical_children() */
+  const Lvb_fingerprint HashKey = TreeFingerprint(MSA, BranchArray, root); /* of topology */
+  const long val = seen->insert(HashKey).second ? 1 : 0;                   /* return value */
+  Lvb_bool fresh;                                                          /* to be added to best trees */
+
+  /* only the best trees themselves are locked, so threads fingerprint
+   * and put trees in canonical form side by side */
+  pthread_mutex_lock(&shared->lock);
+  if (length < shared->length)
+  {
+    ClearTreestack(shared->stack); /* discard old bests */
+    shared->length = length;
   }
-  hashSet.insert(HashKey);
-
-  lvb_assert(root < MSA->n);
-  PushCurrentTreeToStack(MSA, sp, BranchArray, root, b_with_sitestate);
-
-  return 1;
-} /* end CompareHashTreeToHashstack() */
+  fresh = (Lvb_bool)((length == shared->length) &&
+                     (FindFingerprintedTreeInTreestack(MSA, shared->stack, BranchArray, root, HashKey) < 0));
+  pthread_mutex_unlock(&shared->lock);
+  if (fresh == LVB_FALSE)
+    return val;
 
-long TopologicalHashComparison(Dataptr MSA, unsigned long long stored_hash, const TREESTACK_TREE_NODES *const tree_2, Lvb_bool b_First,
-                               std::string current_site_states, unsigned long long &current_site_states_hash)
-{
-  if (b_First == LVB_TRUE)
+  /* allocate "local" static heap memory - static - do not free! */
+  if (copy_2 == NULL)
   {
-    current_site_states = MakeHashSet(MSA, tree_2, 0);
-    current_site_states_hash = HashSiteSet(current_site_states);
+    copy_2 = treealloc(MSA, LVB_FALSE);
+    p_todo_arr = (long *)alloc(MSA->numberofpossiblebranches * sizeof(long), "branch list");
+    p_least = (long *)alloc(MSA->numberofpossiblebranches * sizeof(long), "least leaf by branch");
   }
-  return HashComparison(stored_hash, current_site_states_hash);
-} /* end TopologicalHashComparison() */
 
-long HashComparison(unsigned long long stored_hash, unsigned long long current_site_states_hash)
+  /* which thread offers a topology first varies, so it is kept in a
+   * form that does not depend on how it was found */
+  treecopy(MSA, copy_2, BranchArray, LVB_FALSE);
+  if (root != 0)
+    lvb_reroot(MSA, copy_2, root, 0, LVB_FALSE);
+  canonical_children(MSA, copy_2, 0, p_todo_arr, p_least);
+
+  /* another thread may have added the topology, or found a shorter tree,
+   * while the lock was free */
+  pthread_mutex_lock(&shared->lock);
+  if ((length == shared->length) &&
+      (FindFingerprintedTreeInTreestack(MSA, shared->stack, copy_2, 0, HashKey) < 0))
+    PushFingerprintedTreeToStack(MSA, shared->stack, copy_2, 0, HashKey);
+  pthread_mutex_unlock(&shared->lock);
+  return val;
+} /* end CompareTreeToSharedTreestack() */
+
+long CountSharedTreestack(Shared_treestack *shared)
+/* return the number of trees in shared */
 {
-  if (stored_hash == current_site_states_hash)
-    return 0;
-
-  return 1;
-} /* end HashComparison() */
-
-unsigned long long HashSiteSet(std::string currentsiteset)
+  long n; /* return value */
+
+  pthread_mutex_lock(&shared->lock);
+  n = shared->stack->next;
+  pthread_mutex_unlock(&shared->lock);
+  return n;
+} /* end CountSharedTreestack() */
+
+void SortSharedTreestack(Shared_treestack *shared)
+/* put the trees in shared in order of fingerprint, so that their order does
+ * not depend on the order in which threads found them; no thread may be
+ * using shared */
 {
-  unsigned long long str_hash = std::hash<std::string>{}(currentsiteset);
-  return str_hash;
-} /* end HashSiteSet() */
+  lvb_assert(shared->stack->spill == NULL); /* all trees in memory */
+  std::sort(shared->stack->stack, shared->stack->stack + shared->stack->next,
+            [](const TREESTACK_TREES &a, const TREESTACK_TREES &b)
+            { return (a.fingerprint.hi < b.fingerprint.hi) ||
+                     ((a.fingerprint.hi == b.fingerprint.hi) && (a.fingerprint.lo < b.fingerprint.lo)); });
+  ReindexTreestack(shared->stack);
+} /* end SortSharedTreestack() */
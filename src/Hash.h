@@ -56,12 +56,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "LVB.h"
 
-long TopologicalHashComparison(Dataptr restrict, unsigned long long, const TREESTACK_TREE_NODES *const, Lvb_bool, std::string, unsigned long long &);
-long HashComparison(unsigned long long, unsigned long long);
-long CompareHashTreeToHashstack(Dataptr, TREESTACK *, const TREESTACK_TREE_NODES *const, const long, Lvb_bool);
-std::string ConvertSiteSetToString(Dataptr MSA, Objset *oset_1);
-std::string MakeHashSet(Dataptr restrict, const TREESTACK_TREE_NODES *const tree_2, const long);
-unsigned long long HashSiteSet(std::string);
-long CollisionResolution(Dataptr restrict, TREESTACK *, const TREESTACK_TREE_NODES *const, Lvb_bool);
+void SharedTreestackInit(Shared_treestack *, TREESTACK *);
+void SharedTreestackFree(Shared_treestack *);
+void SortSharedTreestack(Shared_treestack *);
+long CompareTreeToSharedTreestack(Dataptr, Shared_treestack *, Fingerprint_set *,
+								  const TREESTACK_TREE_NODES *const, const long, const long);
+long CountSharedTreestack(Shared_treestack *);
 
 #endif // SRC_HASH_H_
@@ -47,6 +47,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef LVB_LVB_H
 #define LVB_LVB_H
 
+#include <unordered_set>
 #include <vector>
 
 #include <ctype.h>
@@ -54,6 +55,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <limits.h>
 #include <math.h>
 #include <omp.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -85,6 +87,12 @@ typedef uint64_t Lvb_bit_length; /* define 64 bits */
 #define LENGTH_WORD_BITS_MULTIPLY 4						   /* multiply of number packed bases */
 #define MINIMUM_WORDS_PER_SLICE_GETPLEN 30				   /* minimum words per slice that run gplen threading */
 #define MINIMUM_SIZE_NUMBER_WORDS_TO_ACTIVATE_THREADING 60 /* need to have this size to activate the threading */
+#define MINIMUM_TAXA_SUBTREE_TASKS 256					   /* default taxa needed to thread getplen by subtrees instead */
+#define MINIMUM_WORDS_TO_THREAD_ENCODING 65536			   /* words of encoded MSA needed to thread DNAToBinary */
+#define MINIMUM_CELLS_TO_THREAD_COLUMNS 1048576		   /* characters of MSA needed to thread matchange() */
+#define MINIMUM_BRANCHES_SUBTREE_TASKS 32				   /* default dirty branches needed for one call to use them */
+#define GETPLEN_SLICES 0								   /* threads of getplen share out columns */
+#define GETPLEN_SUBTREES 1								   /* threads of getplen share out branches */
 #define MASK_SEVEN 0x7777777777777777U
 #define MASK_EIGHT 0x8888888888888888U
 
@@ -97,6 +105,9 @@ typedef uint64_t Lvb_bit_length; /* define 64 bits */
 #define LVB_INPUTSTRING_SIZE 2000 /* max. bytes for interactive input */
 #define STAT_LOG_INTERVAL 50000	  /* min. interval for progress log */
 #define REROOT_INTERVAL 1000	  /* change root every ... updates */
+#define CHAIN_SEED_STEP 7919L	  /* seeds of successive annealing chains differ by this */
+#define CHECKPOINT_SECONDS 600L	  /* default interval between checkpoints */
+#define SAMPLE_STREAM 1000000L	  /* random number stream choosing best trees kept, beyond any chain's */
 
 /* implementation-independent limits */
 #define LVB_EPS 1E-11					  /* 0.0 < DBL_EPSILON < LVB_EPS */
@@ -110,6 +121,10 @@ typedef uint64_t Lvb_bit_length; /* define 64 bits */
 
 /* limits that could be changed but are likely to be OK */
 #define FROZEN_T 0.0001 /* consider system frozen if temp < FROZEN_T */
+#define ACCEPTANCE_CEILING_MARGIN 1E-6 /* relative slack in acceptance_ceiling() */
+#define UPPASS_SCRATCH_SETS 5			/* statesets of scratch for spr_length() and tbr_length() */
+#define UPPASS_REFILL_INTERVAL 16		/* unchanged proposals before up-pass statesets are found again */
+#define TREESTACK_INDEX_MIN 64			/* smallest tree stack index, in entries */
 
 typedef struct /* object set derived from a cladogram */
 {
@@ -124,24 +139,112 @@ typedef struct
 	long left;				   /* index of first child in tree array */
 	long right;				   /* index of second child in tree array */
 	long changes;			   /* changes associated with this branch */
+	long sum_changes;		   /* changes for this branch and all below it */
 	Lvb_bit_length *sitestate; /* statesets for all sites */
 } TREESTACK_TREE_NODES;		   // node
 
+/* record of branches changed by a rearrangement made in place, so that it
+ * can be undone */
+typedef struct
+{
+	long n;						 /* branches recorded since undo_begin() */
+	long proposal;				 /* number of the current rearrangement */
+	long *stamp;				 /* by branch: rearrangement it was last recorded in */
+	long *entry;				 /* by branch: where it is recorded, if stamped */
+	long *branch;				 /* by entry: branch number */
+	Lvb_bool *sitestate_saved;	 /* by entry: statesets recorded too */
+	Lvb_bool *was_dirty;		 /* by entry: statesets were "dirty" */
+	TREESTACK_TREE_NODES *node;	 /* by entry: scalars as they were */
+	Lvb_bit_length *sitestate;	 /* by entry: statesets as they were */
+} Undo_log;
+
+/* statesets of the rest of the tree seen from each branch (up-pass or
+ * pre-order statesets), with which the length of a tree after an SPR or
+ * TBR rearrangement can be found without making it */
+typedef struct
+{
+	Lvb_bool valid;			   /* sets describe the current tree */
+	long mark;				   /* number of the current rearrangement scored */
+	long *stamp;			   /* by branch: rearrangement it was last marked in */
+	long *path;				   /* branches on the path to the destination */
+	Lvb_bool shared;		   /* upset belongs to other up-pass statesets */
+	Lvb_bit_length *upset;	   /* by branch: statesets of the rest of the tree */
+	Lvb_bit_length *scratch;   /* UPPASS_SCRATCH_SETS statesets for paths */
+} Uppass_sets;
+
+/* topology fingerprint, see TreeFingerprint() */
+typedef struct
+{
+	uint64_t lo; /* low 64 bits */
+	uint64_t hi; /* high 64 bits */
+} Lvb_fingerprint;
+
+inline bool operator==(const Lvb_fingerprint &a, const Lvb_fingerprint &b)
+{
+	return (a.lo == b.lo) && (a.hi == b.hi);
+}
+
+struct Lvb_fingerprint_hash /* for unordered containers of fingerprints */
+{
+	size_t operator()(const Lvb_fingerprint &f) const { return (size_t)f.lo; }
+};
+
+typedef std::unordered_set<Lvb_fingerprint, Lvb_fingerprint_hash> Fingerprint_set;
+
+/* trees of a tree stack beyond its memory limit, see TreestackLimitMemory() */
+typedef struct
+{
+	long max_trees;				  /* trees kept in memory, the rest go to file */
+	char *file_name;			  /* name of spill file */
+	FILE *fp;					  /* spill file, NULL until first needed */
+	long n;						  /* trees in spill file */
+	long size;					  /* fingerprints allocated for */
+	Lvb_fingerprint *fingerprint; /* by tree in spill file: its fingerprint */
+	long tree_bytes;			  /* bytes of root and branches per tree in file */
+	long record_bytes;			  /* bytes per tree in file, splits included */
+	long *record;				  /* scratch for the root and branches of one tree */
+	Lvb_bit_length *splits;		  /* scratch for the splits of one tree */
+} Treestack_spill;
+
+struct Rng; /* random number generator, see RandomNumberGenerator.h */
+
+/* best trees of a tree stack kept as a random sample, see TreestackSample() */
+typedef struct
+{
+	long max_trees;			  /* trees kept */
+	struct Rng *rng;		  /* chooses which trees are kept */
+	Fingerprint_set *dropped; /* fingerprints of trees found but not kept, unbounded */
+} Treestack_sample;
+
 /* tree stacks */
 typedef struct
 {
-	TREESTACK_TREE_NODES *tree; /* pointer to first branch in tree array */
-	long root;					/* root of tree */
-	Objset *p_sitestate;		/* array with sitestate with the root always on zero */
+	TREESTACK_TREE_NODES *tree;	 /* pointer to first branch in tree array */
+	long root;					 /* root of tree */
+	Lvb_bit_length *splits;		 /* split bitsets, see makesets() */
+	Lvb_fingerprint fingerprint; /* see TreeFingerprint() */
 } TREESTACK_TREES;
 
 typedef struct
 {
-	long size;				/* number of trees currently allocated for */
-	long next;				/* next unused element of stack */
-	TREESTACK_TREES *stack; /* pointer to first element in stack */
+	long size;					/* number of trees currently allocated for */
+	long next;					/* next unused element of stack */
+	TREESTACK_TREES *stack;		/* pointer to first element in stack */
+	long *index;				/* open-addressing table of trees by fingerprint, -1 where empty */
+	long index_size;			/* entries in index, 0 or a power of two */
+	Treestack_spill *spill;		/* trees beyond memory limit, NULL if no limit */
+	Treestack_sample *sample;	/* random sample of trees kept, NULL if all kept */
+	long changes;				/* times trees were removed, replaced or moved, see checkpoint_save() */
 } TREESTACK;
 
+/* best trees of several annealing chains run at once */
+typedef struct
+{
+	TREESTACK *stack;	  /* trees of length length, each topology once */
+	long length;		  /* length of trees on stack, LONG_MAX if none */
+	pthread_mutex_t lock; /* held while using any of the above */
+} Shared_treestack;
+
 /* simulated annealing parameters */
 #define MAXACCEPT_MIN 5L	  /* minimum value for maxaccept */
 #define MAXACCEPT_MAX 5L	  /* maximum value for maxaccept */
@@ -149,6 +252,16 @@ typedef struct
 #define MAXPROPOSE_SLOW 2000L /* maxpropose for "slow" searches */
 #define MAXFAIL_SLOW 40L	  /* maxfail for "slow" searches */
 
+/* rearrangements made by Anneal() */
+#define REARRANGE_NNI 0
+#define REARRANGE_SPR 1
+#define REARRANGE_TBR 2
+
+/* replica exchange parameters */
+#define REPLICA_SWAP_INTERVAL 1000L /* proposals by each replica between exchanges */
+#define REPLICA_MAXFAIL 40L			/* exchanges without a shorter tree before stopping */
+#define REPLICA_COLDEST_T 1E-6		/* temperature of the coldest replica */
+
 /* fixed file names */
 #define MATFNAM "infile"	  /* MSA file name */
 #define OUTTREEFNAM "outtree" /* overall best trees */
@@ -184,9 +297,18 @@ void dnapars_wrapper(void);
 char *f2str(FILE *const);
 Lvb_bool file_exists(const char *const);
 void getparam(Parameters *, int argc, char **argv);
-long getplen(Dataptr restrict, TREESTACK_TREE_NODES *, Parameters rcstruct, const long, long *restrict p_todo_arr, long *p_todo_arr_sum_changes, int *p_runs);
-void alloc_memory_to_getplen(Dataptr MSA, long **p_todo_arr, long **p_todo_arr_sum_changes, int **p_runs);
-void free_memory_to_getplen(long **p_todo_arr, long **p_todo_arr_sum_changes, int **p_runs);
+long getplen(Dataptr restrict, TREESTACK_TREE_NODES *, Parameters rcstruct, const long, long *restrict p_todo_arr, long *p_todo_arr_sum_changes);
+long getplen_bounded(Dataptr restrict, TREESTACK_TREE_NODES *, Parameters rcstruct, const long, long *restrict p_todo_arr, long *p_todo_arr_sum_changes, const long ceiling);
+long acceptance_ceiling(const double tree_minimum_length, const long current_tree_length, const double t);
+Uppass_sets *uppass_alloc(Dataptr restrict, Uppass_sets *);
+void uppass_free(Uppass_sets *);
+void uppass_fill(Dataptr restrict, const TREESTACK_TREE_NODES *, const long, Uppass_sets *);
+long spr_length(Dataptr restrict, const TREESTACK_TREE_NODES *, Uppass_sets *, const long, const long, const long, const long,
+				const long);
+long tbr_length(Dataptr restrict, const TREESTACK_TREE_NODES *, Uppass_sets *, const long, const long, const long, const long,
+				const long, const long);
+void alloc_memory_to_getplen(Dataptr MSA, long **p_todo_arr, long **p_todo_arr_sum_changes);
+void free_memory_to_getplen(long **p_todo_arr, long **p_todo_arr_sum_changes);
 double get_predicted_length(double, double, long, long, long, long);
 double get_predicted_trees(double, double, long, long, long, long);
 long getroot(const TREESTACK_TREE_NODES *const);
@@ -198,10 +320,14 @@ void lvb_treeprint(Dataptr, FILE *const, const TREESTACK_TREE_NODES *const, cons
 
 void matchange(Dataptr, const Parameters);
 Dataptr matrin(const char *const);
-void mutate_deterministic(Dataptr restrict, TREESTACK_TREE_NODES *const, const TREESTACK_TREE_NODES *const, long, long, Lvb_bool);
-void mutate_spr(Dataptr restrict, TREESTACK_TREE_NODES *const, const TREESTACK_TREE_NODES *const, long);
-void mutate_nni(Dataptr restrict, TREESTACK_TREE_NODES *const, const TREESTACK_TREE_NODES *const, long);
-void mutate_tbr(Dataptr restrict, TREESTACK_TREE_NODES *const, const TREESTACK_TREE_NODES *const, long);
+void mutate_deterministic(Dataptr restrict, TREESTACK_TREE_NODES *const, long, long, Lvb_bool, Undo_log *);
+void mutate_spr(Dataptr restrict, TREESTACK_TREE_NODES *const, long, Undo_log *);
+void mutate_nni(Dataptr restrict, TREESTACK_TREE_NODES *const, long, Undo_log *);
+void mutate_tbr(Dataptr restrict, TREESTACK_TREE_NODES *const, long, Undo_log *);
+void spr_choose(Dataptr restrict, TREESTACK_TREE_NODES *const, long, long *, long *);
+void spr_apply(Dataptr restrict, TREESTACK_TREE_NODES *const, long, long, long, Undo_log *);
+void tbr_choose(Dataptr restrict, TREESTACK_TREE_NODES *const, long, long *, long *, long *);
+void tbr_apply(Dataptr restrict, TREESTACK_TREE_NODES *const, long, long, long, long, Undo_log *);
 char *nextnonwspc(const char *);
 void nodeclear(TREESTACK_TREE_NODES *const, const long);
 long objreroot(TREESTACK_TREE_NODES *const, const long, const long);
@@ -211,6 +337,7 @@ void phylip_mat_dims_in(char *, int, long *, long *, int *);
 void PullRandomTree(Dataptr, TREESTACK_TREE_NODES *const);
 long randpint(const long);
 void rowfree(Dataptr);
+void blockfree(Dataptr);
 void scream(const char *const, ...);
 void ss_init(Dataptr, TREESTACK_TREE_NODES *, Lvb_bit_length **);
 char *supper(char *const s);
@@ -221,26 +348,44 @@ void treeclear(Dataptr, TREESTACK_TREE_NODES *const);
 void treecopy(Dataptr restrict, TREESTACK_TREE_NODES *const, const TREESTACK_TREE_NODES *const, Lvb_bool b_with_sitestate);
 void treedump(Dataptr, FILE *const, const TREESTACK_TREE_NODES *const, Lvb_bool b_with_sitestate);
 void treedump_screen(Dataptr MSA, const TREESTACK_TREE_NODES *const tree);
+Undo_log *undo_alloc(Dataptr restrict);
+void undo_free(Undo_log *);
+void undo_begin(Undo_log *);
+void undo_save(Dataptr restrict, Undo_log *, const TREESTACK_TREE_NODES *const, const long);
+void undo_save_sitestate(Dataptr restrict, Undo_log *, const TREESTACK_TREE_NODES *const, const long);
+void undo_commit(Undo_log *);
+void undo_rollback(Dataptr restrict, Undo_log *, TREESTACK_TREE_NODES *const);
+void undo_copy(Dataptr restrict, const Undo_log *, const TREESTACK_TREE_NODES *const, TREESTACK_TREE_NODES *const);
 void ClearTreestack(TREESTACK *);
 long CountTreestack(TREESTACK);
 void FreeTreestackMemory(Dataptr restrict MSA, TREESTACK *);
 TREESTACK CreateNewTreestack(void);
 long PullTreefromTreestack(Dataptr, TREESTACK_TREE_NODES *, long *, TREESTACK *, Lvb_bool b_with_sitestate);
 long CompareTreeToTreestack(Dataptr, TREESTACK *, const TREESTACK_TREE_NODES *const, const long, Lvb_bool b_with_sitestate);
+long FindTreeInTreestack(Dataptr, TREESTACK *, const TREESTACK_TREE_NODES *const, const long);
+long FindFingerprintedTreeInTreestack(Dataptr, TREESTACK *, const TREESTACK_TREE_NODES *const, const long,
+									  const Lvb_fingerprint);
+void ReindexTreestack(TREESTACK *);
+void TreestackLimitMemory(Dataptr, TREESTACK *, const long, const char *);
+long GetTreeFromTreestack(Dataptr, const TREESTACK *, const long, TREESTACK_TREE_NODES *const);
+void TreestackSample(TREESTACK *, const long, const struct Rng *);
+long CountTreestackFound(TREESTACK);
 int PrintTreestack(Dataptr, TREESTACK *, FILE *const, Lvb_bool onerandom);
 void SwapTrees(TREESTACK_TREE_NODES **const, long *const, TREESTACK_TREE_NODES **const, long *const);
 long words_per_row(const long);
 int count(TREESTACK_TREE_NODES *const, int);
 int addtoarray(TREESTACK_TREE_NODES *const, int, int *, int);
-void copy_sitestate(Dataptr restrict MSA, Objset *p_sitestate_1);
-void DNAToBinary(Dataptr restrict, Lvb_bit_length **);
+void copy_splits(Dataptr restrict MSA, Lvb_bit_length *splits);
+void DNAToBinary(Dataptr restrict, Lvb_bit_length **, int);
 void makesets(Dataptr restrict, const TREESTACK_TREE_NODES *const tree_2, const long root);
-long setstcmp_with_sitestate2(Dataptr MSA, Objset *const oset_1);
-long TopologyComparison(Dataptr restrict, Objset *, const TREESTACK_TREE_NODES *const, Lvb_bool b_first);
+long splitscmp(Dataptr MSA, const Lvb_bit_length *const splits_1);
+long TopologyComparison(Dataptr restrict, const Lvb_bit_length *const, const TREESTACK_TREE_NODES *const, Lvb_bool b_first);
+Lvb_fingerprint TreeFingerprint(Dataptr, const TREESTACK_TREE_NODES *const, const long);
 double StartingTemperature(Dataptr, const TREESTACK_TREE_NODES *const, Parameters rcstruct, long, Lvb_bool);
 long PushCurrentTreeToStack(Dataptr, TREESTACK *, const TREESTACK_TREE_NODES *const, const long, Lvb_bool b_with_sitestate);
+void PushFingerprintedTreeToStack(Dataptr, TREESTACK *, const TREESTACK_TREE_NODES *const, const long, const Lvb_fingerprint);
 long Anneal(Dataptr restrict, TREESTACK *, TREESTACK *, const TREESTACK_TREE_NODES *const, Parameters rcstruct, long, const double,
-			const long, const long, const long, FILE *const, long *, Lvb_bool);
+			const long, const long, const long, FILE *const, long *, Lvb_bool, Shared_treestack *);
 
 void defaults_params(Parameters *const prms);
 long deterministic_hillclimb(Dataptr, TREESTACK *, const TREESTACK_TREE_NODES *const, Parameters rcstruct,
@@ -46,6 +46,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "MSAInput.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 CReadFiles::CReadFiles()
 {
 
@@ -64,11 +69,23 @@ CReadFiles::CReadFiles()
 	sz_accept_chars = "ACGTUYRWSKMBDHVNX?O-";
 	n_max_length_name_seq = 0;
 	b_debug = false; /// print some messages
+
+	/// filter and upper case at once, for mapped files
+	memset(ach_accept_upper, 0, sizeof(ach_accept_upper));
+	for (unsigned int i = 0; i < sz_accept_chars.length(); i++)
+	{
+		ach_accept_upper[(unsigned char)sz_accept_chars[i]] = sz_accept_chars[i];
+		ach_accept_upper[(unsigned char)tolower(sz_accept_chars[i])] = sz_accept_chars[i];
+	}
+	b_mapped = false;
+	p_mapped = NULL;
+	n_mapped_bytes = 0;
+	n_mapped_length = 0;
 }
 
 CReadFiles::~CReadFiles()
 {
-	// TODO Auto-generated destructor stub
+	unmap_fasta();
 }
 
 bool CReadFiles::is_file_exist(string file_name)
@@ -576,6 +593,173 @@ int CReadFiles::read_fasta()
 	return 0;
 }
 
+/// map a fasta file into memory, so it is read in place; false if it
+/// cannot be, as for a pipe or an empty file, when it is read line by line
+bool CReadFiles::map_fasta()
+{
+	struct stat file_stat;
+	void *p_map;
+	int fd = open(sz_file_name.c_str(), O_RDONLY);
+
+	if (fd == -1)
+		return false;
+	if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	p_map = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); /// the mapping stays
+	if (p_map == MAP_FAILED)
+		return false;
+	madvise(p_map, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+	p_mapped = (const char *)p_map;
+	n_mapped_bytes = (size_t)file_stat.st_size;
+	b_mapped = true;
+	return true;
+}
+
+void CReadFiles::unmap_fasta()
+{
+	if (p_mapped != NULL)
+	{
+		munmap((void *)p_mapped, n_mapped_bytes);
+		p_mapped = NULL;
+		n_mapped_bytes = 0;
+	}
+}
+
+/// get the next line of the mapped file from n_pos on, without the spaces
+/// and carriage returns round it, and move n_pos to the line after; false
+/// at the end of the file
+bool CReadFiles::next_mapped_line(size_t &n_pos, const char *&p_line, size_t &n_length)
+{
+	const char *p_end_line;
+	size_t n_end;
+
+	if (n_pos >= n_mapped_bytes)
+		return false;
+	p_end_line = (const char *)memchr(p_mapped + n_pos, '\n', n_mapped_bytes - n_pos);
+	n_end = (p_end_line == NULL) ? n_mapped_bytes : (size_t)(p_end_line - p_mapped);
+	p_line = p_mapped + n_pos;
+	n_length = n_end - n_pos;
+	n_pos = n_end + 1;
+	while (n_length > 0 && (p_line[0] == ' ' || p_line[0] == '\r'))
+	{
+		p_line++;
+		n_length--;
+	}
+	while (n_length > 0 && (p_line[n_length - 1] == ' ' || p_line[n_length - 1] == '\r'))
+		n_length--;
+	return true;
+}
+
+/// get the names and the length of the sequences in the mapped fasta file,
+/// and test them, as read_file() does for the other files
+int CReadFiles::check_mapped_fasta()
+{
+	string error;
+	vector<size_t> lst_lengths;
+	const char *p_line;
+	size_t n_length, n_pos = 0;
+
+	while (next_mapped_line(n_pos, p_line, n_length))
+	{
+		if (n_length == 0)
+			continue;
+		if (p_line[0] == '>')
+		{
+			lst_names_seq.push_back(string(p_line + 1, n_length - 1));
+			lst_lengths.push_back(0);
+			continue;
+		}
+		if (lst_names_seq.size() == 0)
+		{
+			error = "Something wrong with the file.\nThere is a sequence before the first sequence name in the file: " + sz_file_name;
+			return exit_error(1, error);
+		}
+		for (size_t x = 0; x < n_length; x++)
+		{
+			if (ach_accept_upper[(unsigned char)p_line[x]] == 0)
+			{
+				string a = "This char is not allowed (";
+				a += p_line[x];
+				a += ")\nThe char is in this line: ";
+				a += lst_names_seq.back();
+				a += ": ";
+				a += string(p_line, n_length);
+				a += "\n";
+				return exit_error(1, a.c_str());
+			}
+		}
+		lst_lengths.back() += n_length;
+	}
+
+	if (lst_names_seq.size() < 2)
+	{
+		if (lst_names_seq.size() == 0)
+		{
+			error = "Zero sequences were read from the file: " + sz_file_name;
+			return exit_error(1, error);
+		}
+		error = "Only one sequence was read from the file: " + sz_file_name;
+		return exit_error(1, error);
+	}
+	for (unsigned int i = 1; i < lst_lengths.size(); i++)
+	{
+		if (lst_lengths[i] != lst_lengths[0])
+		{
+			error = "Something wrong with the file.\nThe sequence lengths are different in the file: " + sz_file_name;
+			return exit_error(1, error);
+		}
+	}
+	n_mapped_length = (unsigned int)lst_lengths[0];
+
+	n_max_length_name_seq = 0;
+	for (unsigned int i = 0; i < lst_names_seq.size(); i++)
+	{
+		if ((int)lst_names_seq[i].length() > n_max_length_name_seq)
+			n_max_length_name_seq = (int)lst_names_seq[i].length();
+	}
+	return EXIT_SUCCESS;
+}
+
+/// copy the sequences, in upper case, to p_rows, each of which must have
+/// room for get_length_sequences() chars and a null; a mapped file is
+/// copied straight from the mapping, which is then let go
+void CReadFiles::copy_sequences(char **p_rows)
+{
+	if (!b_mapped)
+	{
+		for (unsigned int i = 0; i < lst_sequences.size(); i++)
+			memcpy(p_rows[i], lst_sequences[i].c_str(), lst_sequences[i].length() + 1);
+		return;
+	}
+
+	const char *p_line;
+	size_t n_length, n_pos = 0;
+	int n_seq = -1;
+	char *p_row = NULL;
+
+	while (next_mapped_line(n_pos, p_line, n_length))
+	{
+		if (n_length == 0)
+			continue;
+		if (p_line[0] == '>')
+		{
+			if (p_row != NULL)
+				*p_row = '\0';
+			p_row = p_rows[++n_seq];
+			continue;
+		}
+		for (size_t x = 0; x < n_length; x++)
+			p_row[x] = ach_accept_upper[(unsigned char)p_line[x]];
+		p_row += n_length;
+	}
+	*p_row = '\0';
+	unmap_fasta();
+}
+
 /// get the dimensions of nexus files...
 // dimensions ntax=10 nchar=705;
 void CReadFiles::get_dimensions_nexus_format(string sz_line, int &n_seqs, int &n_length_seq)
@@ -717,6 +901,8 @@ int CReadFiles::clean_data()
 	lst_sequences.clear();
 	lst_names_seq.clear();
 	n_max_length_name_seq = 0;
+	unmap_fasta();
+	b_mapped = false;
 
 	/// get the extension from the file name
 	// linux and mac
@@ -760,7 +946,9 @@ int CReadFiles::read_file(string sz_file_name_temp, int n_file_type)
 			return n_error_code;
 	}
 	else if (n_file_type == CReadFiles::FORMAT_FASTA_)
-	{ // Fasta format
+	{ // Fasta format, read in place if it can be mapped into memory
+		if (map_fasta())
+			return check_mapped_fasta();
 		n_error_code = read_fasta();
 		if (n_error_code != EXIT_SUCCESS)
 			return n_error_code;
@@ -801,7 +989,7 @@ int CReadFiles::read_file(string sz_file_name_temp, int n_file_type)
 
 	/// get the max length of size name
 	n_max_length_name_seq = 0;
-	for (unsigned int i = 1; i < lst_names_seq.size(); i++)
+	for (unsigned int i = 0; i < lst_names_seq.size(); i++)
 	{
 		if ((int)lst_names_seq[i].length() > n_max_length_name_seq)
 			n_max_length_name_seq = (int)lst_names_seq[i].length();
@@ -89,6 +89,8 @@ public:
 	int read_file(string file_name_out, int n_file_type);
 	unsigned int get_length_sequences()
 	{
+		if (b_mapped)
+			return n_mapped_length;
 		if ((int)lst_sequences.size() > 0)
 			return lst_sequences[0].length();
 		return 0;
@@ -98,6 +100,7 @@ public:
 	int get_length_seq_name(int n_seq) { return (int)lst_names_seq[n_seq].length(); }
 	char get_char_seq_name(int n_seq, int n_pos_char) { return (char)lst_names_seq[n_seq].at(n_pos_char); }
 	char get_char_sequences(int n_seq, int n_pos_char) { return (char)lst_sequences[n_seq].at(n_pos_char); }
+	void copy_sequences(char **p_rows);
 
 	/// data structure
 private:
@@ -141,6 +144,17 @@ private:
 
 	/// members for nexus format
 	void get_dimensions_nexus_format(string sz_line, int &n_seqs, int &n_length_seq);
+
+	/// members for fasta files mapped into memory, read without a string per sequence
+	bool map_fasta();
+	void unmap_fasta();
+	int check_mapped_fasta();
+	bool next_mapped_line(size_t &n_pos, const char *&p_line, size_t &n_length);
+	bool b_mapped;				   /// file is mapped, sequences are not in lst_sequences
+	const char *p_mapped;		   /// start of mapped file, or NULL
+	size_t n_mapped_bytes;		   /// length of mapped file
+	unsigned int n_mapped_length;  /// length of every sequence in mapped file
+	char ach_accept_upper[256];	   /// upper case of each char to pass on filter, 0 if it does not pass
 };
 
 #endif /* LVB_MSAINPUT_H_ */
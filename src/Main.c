@@ -50,6 +50,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Hash.h"
 #include "Print.h"
 #include "LogFile.h"
+#include "MatrixCache.h"
 #include "LVB.h"
 #include "MemoryOperations.h"
 #include "SearchParameters.h"
@@ -65,10 +66,12 @@ int main(int argc, char **argv)
 	long iter;					  /* iterations of annealing algorithm */
 	long trees_output_total = 0L; /* number of trees output, overall */
 	long trees_output;			  /* number of trees output for current rep. */
+	long trees_found;			  /* number of trees found, output or not */
 	long final_length;			  /* length of shortest tree(s) found */
 	FILE *outtreefp;			  /* best trees found overall */
 	outtreefp = (FILE *)alloc(sizeof(FILE), "alloc FILE");
 	Lvb_bool log_progress; /* whether or not to log Anneal search */
+	Rng rng;			   /* random number generator */
 
 	/* entitle standard output */
 	PrintLVBCopyright();
@@ -86,22 +89,43 @@ int main(int argc, char **argv)
 
 	/* read and alloc space to the data structure */
 	MSA = (data *)alloc(sizeof(DataStructure), "alloc data structure");
-	phylip_dna_matrin(rcstruct.file_name_in, rcstruct.n_file_format, MSA);
+	if (matrix_cache_load(MSA, rcstruct) == LVB_FALSE)
+	{
+		phylip_dna_matrin(rcstruct.file_name_in, rcstruct.n_file_format, MSA);
+		matchange(MSA, rcstruct); /* cut columns */
+		if (rcstruct.matrix_cache == LVB_TRUE)
+			matrix_cache_save(MSA, rcstruct);
+	}
+	matrix_shared_publish(MSA, rcstruct);
 
 	/* "file-local" dynamic heap memory: set up best tree stacks, need to be by thread */
 	treestack = CreateNewTreestack();
 	if (rcstruct.algorithm_selection == 2)
 		stack_treevo = CreateNewTreestack();
 
-	matchange(MSA, rcstruct); /* cut columns */
 	writeinf(rcstruct, MSA, argc, argv);
 	calc_distribution_processors(MSA, rcstruct);
 
 	if (rcstruct.verbose == LVB_TRUE)
 	{
-		printf("MinimumTreeLength: %ld\n\n", MinimumTreeLength(MSA));
+		printf("MinimumTreeLength: %ld\n\n", MSA->min_len_tree);
+	}
+	if (rcstruct.treestack_memory > 0)
+	{
+		char spill_file_name[LVB_FNAMSIZE + 7]; /* best trees beyond memory limit */
+
+		sprintf(spill_file_name, "%s.spill", rcstruct.file_name_out);
+		TreestackLimitMemory(MSA, &treestack, rcstruct.treestack_memory, spill_file_name);
+	}
+	rng_init(&rng, rcstruct.rng, rcstruct.seed);
+	if (rcstruct.n_sample_trees > 0)
+	{
+		Rng sample_rng; /* chooses best trees kept, apart from the search */
+
+		rng_split(&sample_rng, &rng, SAMPLE_STREAM);
+		TreestackSample(&treestack, rcstruct.n_sample_trees, &sample_rng);
 	}
-	rinit(rcstruct.seed);
+	uni_set(&rng);
 	log_progress = LVB_TRUE;
 
 	outtreefp = clnopen(rcstruct.file_name_out, "w");
@@ -112,6 +136,7 @@ int main(int argc, char **argv)
 	iter = 0;
 	final_length = GetSoln(MSA, rcstruct, &iter, log_progress);
 	trees_output = PrintTreestack(MSA, &treestack, outtreefp, LVB_FALSE);
+	trees_found = CountTreestackFound(treestack);
 
 	trees_output_total += trees_output;
 	if (rcstruct.algorithm_selection == 2)
@@ -130,19 +155,23 @@ int main(int argc, char **argv)
 
 	PrintLogFile(iter, trees_output_total, final_length, overall_time_taken);
 
-	double consistency_index = MinimumTreeLength(MSA);
+	double consistency_index = MSA->min_len_tree;
 	double homoplasy_index = 0;
 
 	consistency_index = consistency_index / final_length;
 	homoplasy_index = 1 - consistency_index;
 
-	PrintOutput(iter, trees_output_total, final_length, consistency_index, homoplasy_index, overall_time_taken, rcstruct.file_name_out);
+	PrintOutput(iter, trees_output_total, trees_found, final_length, consistency_index, homoplasy_index, overall_time_taken,
+				rcstruct.file_name_out);
 
 	/* "file-local" dynamic heap memory */
 	if (rcstruct.algorithm_selection == 2)
 		FreeTreestackMemory(MSA, &stack_treevo);
 	FreeTreestackMemory(MSA, &treestack);
+	pool_destroy();
+	matrix_cache_free(MSA);
 	rowfree(MSA);
+	blockfree(MSA);
 	free(MSA);
 
 	if (cleanup() == LVB_TRUE)
@@ -0,0 +1,618 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro and Maximilian Strobl.
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* ========== MatrixCache.c - keep the data matrix ready for the search ========== */
+
+/*
+
+An alignment cache holds the data matrix as matchange() leaves it, with
+its rows already encoded as state sets, so that later runs on the same
+alignment need not read, cut or encode it again. The cache is mapped into
+memory rather than read, and the encoded rows are used in place. As for
+checkpoints, numbers are written as they are held in memory, so a cache
+is only good for the same build of LVB on the same kind of computer.
+
+The header records the size and modification time of the alignment the
+cache was made from, its format and whether site patterns were merged. A
+cache that does not match all of these, or whose checksums are wrong, is
+ignored and made afresh. Given as the input file, a cache is used as it
+is.
+
+The same image may instead be kept in a named POSIX shared memory
+segment, for many LVB processes on one computer that search the same
+alignment. The first process to create the segment reads the alignment
+and fills the segment, holding a lock on it meanwhile and writing the
+header last. Later processes wait for the lock and then map the segment,
+so that only one copy of the encoded alignment is held in memory, however
+many processes use it. If the lock comes free with no header written, the
+process filling the segment has died, so the segment is removed and made
+afresh.
+
+A segment outlives the processes that use it, so that later runs attach
+to it too, until it is removed with --remove-shared-matrix, or the
+computer is restarted. Removing it does not disturb processes using it,
+which keep their mappings.
+
+*/
+
+#include "MatrixCache.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define SHARED_MATRIX_GRACE 100	  /* hundredths of a second a shared segment may be unfilled and unlocked */
+#define SHARED_MATRIX_ATTEMPTS 3 /* times to try making afresh a shared segment that cannot be used */
+
+#define MATRIX_CACHE_MAGIC "LVBMAT01" /* first bytes of an alignment cache */
+#define MATRIX_CACHE_MAGIC_BYTES 8	  /* bytes of MATRIX_CACHE_MAGIC, without its terminator */
+
+typedef struct /* start of an alignment cache */
+{
+	char magic[MATRIX_CACHE_MAGIC_BYTES]; /* MATRIX_CACHE_MAGIC */
+	long source_bytes;					  /* size of alignment */
+	long source_sec;					  /* modification time of alignment, seconds */
+	long source_nsec;					  /* and nanoseconds */
+	long file_format;					  /* format alignment was read in */
+	long compress_patterns;				  /* LVB_TRUE if site patterns were merged */
+	long n;								  /* rows */
+	long m;								  /* columns kept */
+	long original_m;					  /* columns read */
+	long nwords;						  /* words per encoded row */
+	long n_blocks;						  /* blocks of columns of equal weight */
+	long length_offset;					  /* length of columns cut as uninformative */
+	long min_len_tree;					  /* minimum length of any tree */
+	long max_length_seq_name;			  /* length of longest row title */
+	long titles_bytes;					  /* bytes of row titles, terminators included */
+	uint64_t payload_checksum;			  /* of everything after the header */
+	uint64_t header_checksum;			  /* of the header before this field */
+} Matrix_cache_header;
+
+/* then block_col, block_word and block_weight, the encoded rows and the
+ * row titles */
+
+static void *mapping = NULL;	/* cache in use, if any */
+static size_t mapping_bytes = 0; /* its size */
+static int shared_fd = -1;		 /* shared segment this process must fill, or -1 */
+static const char *shared_use = "not used"; /* what became of the shared segment */
+
+static uint64_t checksum(uint64_t h, const void *p, size_t bytes)
+/* return checksum h carried on over bytes bytes from p, a word at a time
+ * while it can be, so that a checksum made in pieces agrees with one made
+ * at once as long as only the last piece is not a whole number of words */
+{
+	const unsigned char *byte = (const unsigned char *)p; /* next byte */
+	uint64_t word;										  /* next word */
+
+	for (; bytes >= sizeof(uint64_t); bytes -= sizeof(uint64_t), byte += sizeof(uint64_t))
+	{
+		memcpy(&word, byte, sizeof(uint64_t));
+		h = (h ^ word) * 0x100000001B3U;
+	}
+	for (; bytes > 0; bytes--)
+		h = (h ^ *byte++) * 0x100000001B3U;
+	return h;
+
+} /* end checksum() */
+
+#define CHECKSUM_START 0xCBF29CE484222325U /* checksum of nothing */
+
+static size_t payload_bytes(const Matrix_cache_header *header)
+/* return the bytes that should follow header */
+{
+	return (3 * header->n_blocks + 2) * sizeof(long) + header->n * header->nwords * sizeof(Lvb_bit_length) +
+		   header->titles_bytes;
+
+} /* end payload_bytes() */
+
+static Lvb_bool map_cache_fd(Dataptr MSA, int fd, const struct stat *source, const Parameters rcstruct)
+/* set up MSA from the alignment cache open as fd and return LVB_TRUE, or
+ * return LVB_FALSE, leaving MSA alone, if the file is not a whole cache or
+ * if source is not NULL and the cache was not made from the alignment of
+ * status *source with the options of rcstruct; the mapping replaces any
+ * made before, which must no longer be in use */
+{
+	const Matrix_cache_header *header; /* start of cache */
+	const long *block;				   /* next block description */
+	const char *title;				   /* next row title */
+	struct stat cache;				   /* status of cache */
+	void *p;						   /* mapped cache */
+	long i;							   /* loop counter */
+
+	if ((fstat(fd, &cache) != 0) || ((size_t)cache.st_size < sizeof(Matrix_cache_header)))
+		return LVB_FALSE;
+	p = mmap(NULL, (size_t)cache.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return LVB_FALSE;
+
+	header = (const Matrix_cache_header *)p;
+	if ((memcmp(header->magic, MATRIX_CACHE_MAGIC, MATRIX_CACHE_MAGIC_BYTES) != 0)
+		|| (header->header_checksum != checksum(CHECKSUM_START, header, offsetof(Matrix_cache_header, header_checksum)))
+		|| ((source != NULL)
+			&& ((header->source_bytes != (long)source->st_size) || (header->source_sec != (long)source->st_mtim.tv_sec)
+				|| (header->source_nsec != (long)source->st_mtim.tv_nsec)
+				|| (header->file_format != rcstruct.n_file_format)
+				|| (header->compress_patterns != rcstruct.compress_patterns)))
+		|| (header->n < MIN_N) || (header->n > MAX_N) || (header->n_blocks < 1)
+		|| ((size_t)cache.st_size != sizeof(Matrix_cache_header) + payload_bytes(header))
+		|| (header->payload_checksum != checksum(CHECKSUM_START, header + 1, payload_bytes(header))))
+	{
+		munmap(p, (size_t)cache.st_size);
+		return LVB_FALSE;
+	}
+#ifdef MADV_HUGEPAGE
+	madvise(p, (size_t)cache.st_size, MADV_HUGEPAGE); /* fewer TLB misses, where the system allows */
+#endif
+
+	MSA->n = header->n;
+	MSA->m = header->m;
+	MSA->original_m = header->original_m;
+	MSA->max_length_seq_name = header->max_length_seq_name;
+	MSA->numberofpossiblebranches = 2 * MSA->n - 3; /* as brcnt() */
+	MSA->nsets = MSA->n - 3;
+	MSA->mssz = MSA->n - 2;
+	MSA->split_words = (MSA->n + NUMBER_OF_BITS - 1) / NUMBER_OF_BITS;
+	MSA->length_offset = header->length_offset;
+
+	MSA->n_blocks = header->n_blocks;
+	MSA->block_col = (long *)alloc((MSA->n_blocks + 1) * sizeof(long), "block columns");
+	MSA->block_word = (long *)alloc((MSA->n_blocks + 1) * sizeof(long), "block words");
+	MSA->block_weight = (long *)alloc(MSA->n_blocks * sizeof(long), "block weights");
+	block = (const long *)(header + 1);
+	memcpy(MSA->block_col, block, (MSA->n_blocks + 1) * sizeof(long));
+	block += MSA->n_blocks + 1;
+	memcpy(MSA->block_word, block, (MSA->n_blocks + 1) * sizeof(long));
+	block += MSA->n_blocks + 1;
+	memcpy(MSA->block_weight, block, MSA->n_blocks * sizeof(long));
+	block += MSA->n_blocks;
+
+	MSA->nwords = header->nwords;
+	lvb_assert(MSA->nwords == MSA->block_word[MSA->n_blocks]);
+	MSA->bytes = MSA->nwords * sizeof(Lvb_bit_length);
+	MSA->tree_bytes = tree_bytes(MSA);
+	MSA->tree_bytes_without_sitestate = tree_bytes_without_sitestate(MSA);
+	MSA->min_len_tree = header->min_len_tree;
+	MSA->enc_rows = (const Lvb_bit_length *)block;
+
+	/* no text rows; titles are copied, as rowfree() frees them */
+	MSA->row = NULL;
+	MSA->rowtitle = (char **)alloc(MSA->n * sizeof(char *), "row title pointers");
+	title = (const char *)(MSA->enc_rows + MSA->n * MSA->nwords);
+	for (i = 0; i < MSA->n; i++)
+	{
+		MSA->rowtitle[i] = (char *)alloc(strlen(title) + 1, "row title");
+		strcpy(MSA->rowtitle[i], title);
+		title += strlen(title) + 1;
+	}
+
+	mapping = p;
+	mapping_bytes = (size_t)cache.st_size;
+	return LVB_TRUE;
+
+} /* end map_cache_fd() */
+
+static Lvb_bool map_cache(Dataptr MSA, const char *file_name, const struct stat *source, const Parameters rcstruct)
+/* set up MSA from the alignment cache file_name, as map_cache_fd() */
+{
+	Lvb_bool mapped;					/* set up from cache */
+	int fd = open(file_name, O_RDONLY); /* cache */
+
+	if (fd == -1)
+		return LVB_FALSE;
+	mapped = map_cache_fd(MSA, fd, source, rcstruct);
+	close(fd); /* the mapping stays */
+	return mapped;
+
+} /* end map_cache() */
+
+static Lvb_bool write_cache(FILE *fp, const Dataptr MSA, const Parameters rcstruct, const struct stat *source)
+/* write MSA, as left by matchange(), as an alignment cache to fp, which
+ * must be at its start, recording the alignment of status *source and the
+ * options of rcstruct; write the header last, so that the cache cannot be
+ * taken as whole before it is; return LVB_TRUE if all was written, else
+ * LVB_FALSE */
+{
+	Matrix_cache_header header;	   /* start of cache */
+	Lvb_bit_length **enc_mat;	   /* encoded rows */
+	char *titles;				   /* row titles, one after another */
+	char *title;				   /* next row title */
+	uint64_t h = CHECKSUM_START;   /* checksum of payload */
+	Lvb_bool ok;				   /* written so far */
+	long i;						   /* loop counter */
+
+	memset(&header, 0, sizeof(header)); /* no stray bytes in checksum */
+	header.source_bytes = (long)source->st_size;
+	header.source_sec = (long)source->st_mtim.tv_sec;
+	header.source_nsec = (long)source->st_mtim.tv_nsec;
+	header.file_format = rcstruct.n_file_format;
+	header.compress_patterns = rcstruct.compress_patterns;
+	header.n = MSA->n;
+	header.m = MSA->m;
+	header.original_m = MSA->original_m;
+	header.nwords = MSA->nwords;
+	header.n_blocks = MSA->n_blocks;
+	header.length_offset = MSA->length_offset;
+	header.min_len_tree = MSA->min_len_tree;
+	header.max_length_seq_name = MSA->max_length_seq_name;
+	header.titles_bytes = 0;
+	for (i = 0; i < MSA->n; i++)
+		header.titles_bytes += strlen(MSA->rowtitle[i]) + 1;
+	titles = (char *)alloc(header.titles_bytes, "row titles");
+	for (i = 0, title = titles; i < MSA->n; i++)
+	{
+		strcpy(title, MSA->rowtitle[i]);
+		title += strlen(title) + 1;
+	}
+
+	/* rows encoded already if MSA is itself from a cache */
+	enc_mat = (Lvb_bit_length **)alloc(MSA->n * sizeof(Lvb_bit_length *), "encoded row pointers");
+	if (MSA->enc_rows != NULL)
+	{
+		for (i = 0; i < MSA->n; i++)
+			enc_mat[i] = (Lvb_bit_length *)(MSA->enc_rows + i * MSA->nwords);
+	}
+	else
+	{
+		for (i = 0; i < MSA->n; i++)
+			enc_mat[i] = (Lvb_bit_length *)alloc(MSA->bytes, "state sets");
+		DNAToBinary(MSA, enc_mat, rcstruct.n_processors_available);
+	}
+
+	h = checksum(h, MSA->block_col, (MSA->n_blocks + 1) * sizeof(long));
+	h = checksum(h, MSA->block_word, (MSA->n_blocks + 1) * sizeof(long));
+	h = checksum(h, MSA->block_weight, MSA->n_blocks * sizeof(long));
+	for (i = 0; i < MSA->n; i++)
+		h = checksum(h, enc_mat[i], MSA->bytes);
+	h = checksum(h, titles, header.titles_bytes); /* at once, not being whole words */
+	header.payload_checksum = h;
+
+	/* header without its magic first, to keep the space */
+	ok = (Lvb_bool)((fwrite(&header, sizeof(header), 1, fp) == 1)
+					&& (fwrite(MSA->block_col, sizeof(long), MSA->n_blocks + 1, fp) == (size_t)MSA->n_blocks + 1)
+					&& (fwrite(MSA->block_word, sizeof(long), MSA->n_blocks + 1, fp) == (size_t)MSA->n_blocks + 1)
+					&& (fwrite(MSA->block_weight, sizeof(long), MSA->n_blocks, fp) == (size_t)MSA->n_blocks));
+	for (i = 0; (i < MSA->n) && (ok == LVB_TRUE); i++)
+		ok = (Lvb_bool)(fwrite(enc_mat[i], 1, MSA->bytes, fp) == (size_t)MSA->bytes);
+	if (ok == LVB_TRUE)
+		ok = (Lvb_bool)(fwrite(titles, 1, header.titles_bytes, fp) == (size_t)header.titles_bytes);
+	if (ok == LVB_TRUE)
+	{
+		memcpy(header.magic, MATRIX_CACHE_MAGIC, MATRIX_CACHE_MAGIC_BYTES);
+		header.header_checksum = checksum(CHECKSUM_START, &header, offsetof(Matrix_cache_header, header_checksum));
+		ok = (Lvb_bool)((fflush(fp) == 0) && (fseek(fp, 0L, SEEK_SET) == 0)
+						&& (fwrite(&header, sizeof(header), 1, fp) == 1) && (fflush(fp) == 0));
+	}
+
+	if (MSA->enc_rows == NULL)
+	{
+		for (i = 0; i < MSA->n; i++)
+			free(enc_mat[i]);
+	}
+	free(enc_mat);
+	free(titles);
+	return ok;
+
+} /* end write_cache() */
+
+static void shared_name(char *name, const char *segment)
+/* put the name of shared segment segment in name, which must have room
+ * for LVB_FNAMSIZE + 1 chars, with the '/' that shm_open() wants */
+{
+	if (segment[0] == '/')
+		strcpy(name, segment);
+	else
+		sprintf(name, "/%s", segment);
+
+} /* end shared_name() */
+
+static void unlink_shared(const char *name, int fd)
+/* remove shared segment name, if it is still the one open on fd rather
+ * than one made since by another process */
+{
+	struct stat open_status;  /* status of segment open on fd */
+	struct stat named_status; /* status of segment called name */
+	int named_fd;			  /* segment called name */
+
+	named_fd = shm_open(name, O_RDONLY, 0);
+	if (named_fd == -1)
+		return; /* removed already */
+	if ((fstat(fd, &open_status) == 0) && (fstat(named_fd, &named_status) == 0)
+		&& (open_status.st_dev == named_status.st_dev) && (open_status.st_ino == named_status.st_ino))
+		shm_unlink(name);
+	close(named_fd);
+
+} /* end unlink_shared() */
+
+static Lvb_bool shared_filled(int fd)
+/* return LVB_TRUE once the process filling the shared segment open on fd
+ * has written its header, or LVB_FALSE if that process has died first;
+ * the lock it holds while filling shows whether it is still at work */
+{
+	Matrix_cache_header header; /* start of segment */
+	Lvb_bool filled;			/* header written */
+	long unlocked = 0;			/* hundredths of a second found unlocked and unfilled */
+
+	for (;;)
+	{
+		if (flock(fd, LOCK_SH) != 0) /* wait for the process filling it */
+			return LVB_TRUE;		 /* cannot tell, so let the header be checked */
+		filled = (Lvb_bool)((pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header))
+							&& (memcmp(header.magic, MATRIX_CACHE_MAGIC, MATRIX_CACHE_MAGIC_BYTES) == 0));
+		flock(fd, LOCK_UN);
+		if (filled == LVB_TRUE)
+			return LVB_TRUE;
+
+		/* the process that made it may not have locked it yet */
+		if (++unlocked == SHARED_MATRIX_GRACE)
+			return LVB_FALSE;
+		usleep(10000);
+	}
+
+} /* end shared_filled() */
+
+static Lvb_bool attach_shared(Dataptr MSA, const Parameters rcstruct)
+/* set up MSA from rcstruct's shared segment and return LVB_TRUE once
+ * another process has filled it; or return LVB_FALSE, having made the
+ * segment for this process to fill if no other has, or having warned that
+ * the segment cannot be used */
+{
+	char name[LVB_FNAMSIZE + 1]; /* name of segment */
+	struct stat source;			 /* status of alignment */
+	Lvb_bool told = LVB_FALSE;	 /* user told of wait */
+	int attempt;				 /* loop counter */
+	int fd;						 /* segment */
+
+	if (stat(rcstruct.file_name_in, &source) != 0)
+		return LVB_FALSE; /* for the reader to report */
+	shared_name(name, rcstruct.shared_matrix);
+
+	for (attempt = 0; attempt < SHARED_MATRIX_ATTEMPTS; attempt++)
+	{
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+		if (fd != -1)
+		{
+			flock(fd, LOCK_EX); /* held until filled, see shared_filled() */
+			shared_fd = fd;		/* first, so fill it */
+			return LVB_FALSE;
+		}
+		if (errno != EEXIST)
+			break;
+		fd = shm_open(name, O_RDONLY, 0);
+		if (fd == -1)
+			continue; /* removed meanwhile */
+
+		if ((told == LVB_FALSE) && (flock(fd, LOCK_SH | LOCK_NB) != 0))
+		{
+			printf("Waiting for another process to fill shared memory segment '%s'\n", name);
+			fflush(stdout);
+			told = LVB_TRUE;
+		}
+		else
+			flock(fd, LOCK_UN);
+		if ((shared_filled(fd) == LVB_TRUE) && (map_cache_fd(MSA, fd, &source, rcstruct) == LVB_TRUE))
+		{
+			close(fd); /* the mapping stays */
+			shared_use = "attached";
+			return LVB_TRUE;
+		}
+
+		/* left unfilled, made from another alignment or damaged, so make it
+		 * afresh; any process using it keeps its mapping */
+		unlink_shared(name, fd);
+		close(fd);
+	}
+
+	scream("cannot use shared memory segment '%s', carrying on with a private copy of the alignment", name);
+	return LVB_FALSE;
+
+} /* end attach_shared() */
+
+static void cache_file_name(char *file_name, const Parameters rcstruct)
+/* put the name of the cache of rcstruct's alignment in file_name, which
+ * must have room for LVB_FNAMSIZE + sizeof(MATRIX_CACHE_SUFFIX) chars */
+{
+	sprintf(file_name, "%s" MATRIX_CACHE_SUFFIX, rcstruct.file_name_in);
+
+} /* end cache_file_name() */
+
+Lvb_bool matrix_cache_load(Dataptr MSA, const Parameters rcstruct)
+/* set up MSA from rcstruct's shared segment if another process has filled
+ * it, or else from rcstruct's input file if it is an alignment cache, or
+ * else from the cache beside it if rcstruct asks for one and it is up to
+ * date, and return LVB_TRUE; or return LVB_FALSE if MSA must be read and
+ * changed as usual */
+{
+	char file_name[LVB_FNAMSIZE + sizeof(MATRIX_CACHE_SUFFIX)]; /* cache beside alignment */
+	char magic[MATRIX_CACHE_MAGIC_BYTES];						/* first bytes of input */
+	struct stat source;											/* status of alignment */
+	FILE *fp;													/* input file */
+
+	if ((rcstruct.shared_matrix[0] != '\0') && (attach_shared(MSA, rcstruct) == LVB_TRUE))
+		return LVB_TRUE;
+
+	fp = fopen(rcstruct.file_name_in, "rb");
+	if (fp != NULL)
+	{
+		if ((fread(magic, 1, MATRIX_CACHE_MAGIC_BYTES, fp) == MATRIX_CACHE_MAGIC_BYTES)
+			&& (memcmp(magic, MATRIX_CACHE_MAGIC, MATRIX_CACHE_MAGIC_BYTES) == 0))
+		{
+			fclose(fp);
+			if (map_cache(MSA, rcstruct.file_name_in, NULL, rcstruct) == LVB_FALSE)
+				crash("alignment cache '%s' is damaged", rcstruct.file_name_in);
+			return LVB_TRUE;
+		}
+		fclose(fp);
+	}
+
+	if ((rcstruct.matrix_cache == LVB_FALSE) || (stat(rcstruct.file_name_in, &source) != 0))
+		return LVB_FALSE;
+	cache_file_name(file_name, rcstruct);
+	return map_cache(MSA, file_name, &source, rcstruct);
+
+} /* end matrix_cache_load() */
+
+void matrix_cache_save(Dataptr MSA, const Parameters rcstruct)
+/* write MSA, as left by matchange(), to the cache beside rcstruct's input
+ * file, warning rather than stopping if it cannot be written */
+{
+	char file_name[LVB_FNAMSIZE + sizeof(MATRIX_CACHE_SUFFIX)];	   /* cache */
+	char tmp_file[LVB_FNAMSIZE + sizeof(MATRIX_CACHE_SUFFIX) + 4]; /* cache being written */
+	struct stat source;											   /* status of alignment */
+	Lvb_bool ok;												   /* written */
+	FILE *fp;													   /* cache being written */
+
+	if (stat(rcstruct.file_name_in, &source) != 0)
+		return;
+	cache_file_name(file_name, rcstruct);
+	sprintf(tmp_file, "%s.tmp", file_name);
+
+	fp = fopen(tmp_file, "wb");
+	ok = (fp != NULL) ? LVB_TRUE : LVB_FALSE;
+	if (ok == LVB_TRUE)
+	{
+		ok = write_cache(fp, MSA, rcstruct, &source);
+		if (fclose(fp) != 0)
+			ok = LVB_FALSE;
+		if ((ok == LVB_TRUE) && (rename(tmp_file, file_name) != 0))
+			ok = LVB_FALSE;
+		if (ok == LVB_FALSE)
+			remove(tmp_file);
+	}
+	if (ok == LVB_FALSE)
+		scream("cannot write alignment cache '%s', carrying on without it", file_name);
+
+} /* end matrix_cache_save() */
+
+void matrix_shared_publish(Dataptr MSA, const Parameters rcstruct)
+/* if this process made rcstruct's shared segment, fill it from MSA, as
+ * left by matchange(), and set MSA up from the segment instead, so that
+ * this process too holds no copy of its own; if the segment cannot be
+ * filled, remove it and warn */
+{
+	char name[LVB_FNAMSIZE + 1];   /* name of segment */
+	DataStructure built;		   /* MSA as read, to free once replaced */
+	void *built_mapping = mapping; /* cache MSA was read from, if any */
+	size_t built_bytes = mapping_bytes; /* and its size */
+	struct stat source; /* status of alignment */
+	Lvb_bool ok;		/* segment filled */
+	FILE *fp;			/* segment being filled */
+	int fd;				/* filled segment */
+
+	if (shared_fd == -1)
+		return;
+	shared_name(name, rcstruct.shared_matrix);
+	ok = (stat(rcstruct.file_name_in, &source) == 0) ? LVB_TRUE : LVB_FALSE;
+	fp = fdopen(shared_fd, "wb");
+	if (fp == NULL)
+	{
+		close(shared_fd);
+		ok = LVB_FALSE;
+	}
+	else
+	{
+		if (ok == LVB_TRUE)
+			ok = write_cache(fp, MSA, rcstruct, &source);
+		if (fclose(fp) != 0)
+			ok = LVB_FALSE;
+	}
+	shared_fd = -1;
+
+	built = *MSA;
+	if (ok == LVB_TRUE)
+	{
+		fd = shm_open(name, O_RDONLY, 0);
+		mapping = NULL; /* not to be replaced yet */
+		ok = (Lvb_bool)((fd != -1) && (map_cache_fd(MSA, fd, &source, rcstruct) == LVB_TRUE));
+		if (fd != -1)
+			close(fd); /* the mapping stays */
+	}
+	if (ok == LVB_FALSE)
+	{
+		mapping = built_mapping;
+		mapping_bytes = built_bytes;
+		shm_unlink(name);
+		scream("cannot fill shared memory segment '%s', carrying on with a private copy of the alignment", name);
+		return;
+	}
+
+	shared_use = "filled";
+	rowfree(&built);
+	blockfree(&built);
+	if (built_mapping != NULL)
+		munmap(built_mapping, built_bytes);
+
+} /* end matrix_shared_publish() */
+
+const char *matrix_shared_use(void)
+/* return what became of the shared segment: "filled" by this process,
+ * "attached" after another filled it, or "not used" */
+{
+	return shared_use;
+
+} /* end matrix_shared_use() */
+
+Lvb_bool matrix_shared_remove(const char *segment)
+/* remove shared segment segment, which processes using it keep, and return
+ * LVB_TRUE; or return LVB_FALSE, with errno set, if it cannot be removed */
+{
+	char name[LVB_FNAMSIZE + 1]; /* name of segment */
+
+	shared_name(name, segment);
+	return (shm_unlink(name) == 0) ? LVB_TRUE : LVB_FALSE;
+
+} /* end matrix_shared_remove() */
+
+void matrix_cache_free(Dataptr MSA)
+/* let go of the alignment cache or shared segment MSA was set up from, if
+ * any */
+{
+	if (mapping != NULL)
+	{
+		munmap(mapping, mapping_bytes);
+		mapping = NULL;
+		mapping_bytes = 0;
+	}
+	MSA->enc_rows = NULL;
+
+} /* end matrix_cache_free() */
@@ -117,24 +117,30 @@ void *alloc(const size_t bytes, const char *const msg)
 
 } /* end alloc() */
 
-void alloc_memory_to_getplen(Dataptr MSA, long **p_todo_arr, long **p_todo_arr_sum_changes, int **p_runs)
+void alloc_memory_to_getplen(Dataptr MSA, long **p_todo_arr, long **p_todo_arr_sum_changes)
 {
 	*p_todo_arr = (long *)alloc((MSA->numberofpossiblebranches - MSA->n) * sizeof(long), "alloc to count runs");
-	*p_todo_arr_sum_changes = (long *)alloc(MSA->n_threads_getplen * (1 + MSA->numberofpossiblebranches - MSA->n) * sizeof(long), "alloc to count runs");
-	*p_runs = (int *)alloc(MSA->n_threads_getplen * (MSA->numberofpossiblebranches - MSA->n) * sizeof(int), "alloc to count runs");
+	/* per thread: changes for each branch and the root, then a running total */
+	long n_longs = MSA->n_threads_getplen * (2 + MSA->numberofpossiblebranches - MSA->n);
+
+	/* or, for subtree tasks, children to wait for by branch, then a queue */
+	if (MSA->getplen_strategy == GETPLEN_SUBTREES)
+		n_longs = 2 * MSA->numberofpossiblebranches - MSA->n;
+	*p_todo_arr_sum_changes = (long *)alloc(n_longs * sizeof(long), "alloc to count runs");
 }
 
-void free_memory_to_getplen(long **p_todo_arr, long **p_todo_arr_sum_changes, int **p_runs)
+void free_memory_to_getplen(long **p_todo_arr, long **p_todo_arr_sum_changes)
 {
 	free(*p_todo_arr);
 	free(*p_todo_arr_sum_changes);
-	free(*p_runs);
 }
 
-/* set the number of processors to use */
+/* set the number of processors to use, and how getplen shares out work */
 void calc_distribution_processors(Dataptr MSA, Parameters rcstruct)
 {
 	int n_threads_temp = 0;
+	MSA->getplen_strategy = GETPLEN_SLICES;
+	MSA->min_branches_subtree_tasks = rcstruct.min_branches_subtree_tasks;
 	if (MSA->nwords > MINIMUM_SIZE_NUMBER_WORDS_TO_ACTIVATE_THREADING)
 	{
 		do
@@ -154,6 +160,12 @@ void calc_distribution_processors(Dataptr MSA, Parameters rcstruct)
 			MSA->n_slice_size_getplen = MSA->nwords / MSA->n_threads_getplen;
 		}
 	}
+	else if (MSA->n >= rcstruct.min_taxa_subtree_tasks && rcstruct.n_processors_available > 1)
+	{ /* too few words to slice, but enough branches to share out */
+		MSA->getplen_strategy = GETPLEN_SUBTREES;
+		MSA->n_threads_getplen = rcstruct.n_processors_available;
+		MSA->n_slice_size_getplen = MSA->nwords;
+	}
 	else
 	{
 		MSA->n_threads_getplen = 1; /* need to pass for 1 thread because the number of words is to low */
@@ -161,4 +173,7 @@ void calc_distribution_processors(Dataptr MSA, Parameters rcstruct)
 	// only to protect
 	if (MSA->n_threads_getplen < 1)
 		MSA->n_threads_getplen = 1;
+
+	/* threads for getplen() are started once, here, and reused by every call */
+	pool_create(MSA->n_threads_getplen);
 }
@@ -48,6 +48,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define LVB_MEMORYOPERATIONS_H
 
 #include "LVB.h"
+#include "WorkerPool.h"
 
 void calc_distribution_processors(Dataptr, Parameters rcstruct);
 
@@ -114,7 +114,7 @@ void PrintLVBCopyright()
                "ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.\n\n";
 }
 
-void PrintOutput(long iter, long trees_output_total, long final_length, double consistency_index, double homoplasy_index, double overall_time_taken, char *file_name_out)
+void PrintOutput(long iter, long trees_output_total, long trees_found, long final_length, double consistency_index, double homoplasy_index, double overall_time_taken, char *file_name_out)
 {
 
   printf("\nSearch Complete\n");
@@ -122,9 +122,14 @@ void PrintOutput(long iter, long trees_output_total, long final_length, double c
   printf("\nSearch Results:\n");
   printf("  Rearrangements evaluated: %ld\n", iter);
   printf("  Topologies recovered:     %ld\n", trees_output_total);
+  if (trees_found > trees_output_total)
+    printf("  Topologies found:         %ld\n", trees_found);
   printf("  Tree score:               %ld\n", final_length);
   printf("  Consistency index:        %.2lf\n", consistency_index);
   printf("  Homoplasy index:          %.2lf\n", homoplasy_index);
   printf("  Total runtime (seconds):  %.2lf\n", overall_time_taken);
-  printf("\nAll topologies written to '%s'\n", file_name_out);
+  if (trees_found > trees_output_total)
+    printf("\nRandom sample of topologies written to '%s'\n", file_name_out);
+  else
+    printf("\nAll topologies written to '%s'\n", file_name_out);
 }
@@ -56,6 +56,6 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 void PrintLVBCopyright();
 void PrintLVBInfo();
-void PrintOutput(long, long, long, double, double, double, char *);
+void PrintOutput(long, long, long, long, double, double, double, char *);
 
 #endif // LVB_INFO_H_
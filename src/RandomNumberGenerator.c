@@ -53,7 +53,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * assertion failure if rinit() has not yet been called, and check on
  * DBL_MANT_DIG added to rinit(). This last has to be done at run-time
  * for portability, since DBL_MANT_DIG (from float.h) might not be a
- * constant.
+ * constant. Later, the state of the generator made thread_local, so
+ * that each thread seeded with rinit() has a stream of its own; and later
+ * still, the state gathered into an Rng object, deviates made RNG_BUFFER
+ * at a time, the check on rinit() moved to the refill, and the Philox
+ * generator added beside UNI.
  */
 
 /*
@@ -68,43 +72,134 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "RandomNumberGenerator.h"
 
-static void rstart(int i, int j, int k, int l);
+static void rstart(Rng *rng, int i, int j, int k, int l);
 
 /*
  *	Global variables for rstart & uni
  */
 
-/*const int NUMBER_UNI_AVAILABLE = 10000;
-const int NUMBER_UNI_BUFFER = 2000;
-static double uni_values[NUMBER_UNI_AVAILABLE + NUMBER_UNI_BUFFER];*/
-static double uni_u[98]; /* Was U(97) in Fortran version */
-static double uni_c;
+thread_local Rng uni_rng; /* this thread's generator, zeroed, so of kind RNG_UNSET */
 const double uni_cd = 7654321.0 / 16777216.0;
 const double uni_cm = 16777213.0 / 16777216.0;
-static int uni_ui, uni_uj;
-static Lvb_bool rinit_called = LVB_FALSE; /* added - DB */
 
-double uni(void)
+/* Philox4x32-10 constants, from Salmon et al. (2011), "Parallel random
+ * numbers: as easy as 1, 2, 3" */
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+#define PHILOX_ROUNDS 10
+#define PHILOX_KEY_TAG 0x4C564200U	 /* second key word of the first stream */
+#define PHILOX_SPLIT_TAG 0x53504C54U /* marks blocks used to make keys */
+
+static void uni_fill(Rng *rng)
+/* fill rng->buf with the next RNG_BUFFER values of UNI */
 {
 	double luni; /* local variable for uni */
+	int i;		 /* loop counter */
 
-	lvb_assert(rinit_called != LVB_FALSE); /* added - DB */
-	luni = uni_u[uni_ui] - uni_u[uni_uj];
-	if (luni < 0.0)
-		luni += 1.0;
-	uni_u[uni_ui] = luni;
-	if (--uni_ui == 0)
-		uni_ui = 97;
-	if (--uni_uj == 0)
-		uni_uj = 97;
-	if ((uni_c -= uni_cd) < 0.0)
-		uni_c += uni_cm;
-	if ((luni -= uni_c) < 0.0)
-		luni += 1.0;
-	return (double)luni;
+	for (i = 0; i < RNG_BUFFER; i++)
+	{
+		luni = rng->u[rng->ui] - rng->u[rng->uj];
+		if (luni < 0.0)
+			luni += 1.0;
+		rng->u[rng->ui] = luni;
+		if (--rng->ui == 0)
+			rng->ui = 97;
+		if (--rng->uj == 0)
+			rng->uj = 97;
+		if ((rng->c -= uni_cd) < 0.0)
+			rng->c += uni_cm;
+		if ((luni -= rng->c) < 0.0)
+			luni += 1.0;
+		rng->buf[i] = luni;
+	}
+}
+
+void philox4x32(const uint32_t key[2], const uint32_t ctr[4], uint32_t out[4])
+/* put in out the Philox4x32-10 block of counter ctr under key key */
+{
+	uint32_t k0 = key[0], k1 = key[1];				  /* round key */
+	uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3]; /* block */
+	uint64_t p0, p1;								  /* products */
+	int r;											  /* loop counter */
+
+	for (r = 0; r < PHILOX_ROUNDS; r++)
+	{
+		p0 = (uint64_t)PHILOX_M0 * c0;
+		p1 = (uint64_t)PHILOX_M1 * c2;
+		c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		c1 = (uint32_t)p1;
+		c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		c3 = (uint32_t)p0;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+static void philox_fill(Rng *rng)
+/* fill rng->buf from the next RNG_BUFFER / 2 Philox blocks, two deviates
+ * of 53 bits from each */
+{
+	uint32_t out[4]; /* current block */
+	int i;			 /* loop counter */
+
+	for (i = 0; i < RNG_BUFFER; i += 2)
+	{
+		philox4x32(rng->key, rng->ctr, out);
+		if (++rng->ctr[0] == 0U)
+			rng->ctr[1]++;
+		rng->buf[i] = ((double)(out[0] >> 5) * 67108864.0 + (double)(out[1] >> 6)) / 9007199254740992.0;
+		rng->buf[i + 1] = ((double)(out[2] >> 5) * 67108864.0 + (double)(out[3] >> 6)) / 9007199254740992.0;
+	}
+}
+
+double rng_refill(Rng *rng)
+/* make the next RNG_BUFFER deviates of *rng and return the first, for
+ * rng_uni() once it has handed out all made before */
+{
+	if (rng->kind == RNG_UNI)
+		uni_fill(rng);
+	else if (rng->kind == RNG_PHILOX)
+		philox_fill(rng);
+	else
+		crash("random number generator used before rinit() or rng_init()");
+	rng->next = 1;
+	return rng->buf[0];
+}
+
+double uni_peek(void)
+/* return the value the next call to uni() will return, without changing
+ * the sequence */
+{
+	if (uni_rng.next == RNG_BUFFER)
+	{
+		(void)rng_refill(&uni_rng);
+		uni_rng.next = 0;
+	}
+	return uni_rng.buf[uni_rng.next];
+}
+
+void uni_get(Rng *rng)
+/* copy this thread's generator to *rng */
+{
+	lvb_assert(uni_rng.kind != RNG_UNSET);
+	*rng = uni_rng;
 }
 
-static void rstart(int i, int j, int k, int l)
+void uni_set(const Rng *rng)
+/* make *rng this thread's generator, so that uni() carries on from where
+ * it was when copied */
+{
+	lvb_assert(rng->kind != RNG_UNSET);
+	uni_rng = *rng;
+}
+
+static void rstart(Rng *rng, int i, int j, int k, int l)
 {
 	int ii, jj, m;
 	double s, t;
@@ -124,11 +219,11 @@ static void rstart(int i, int j, int k, int l)
 				s += t;
 			t *= 0.5;
 		}
-		uni_u[ii] = s;
+		rng->u[ii] = s;
 	}
-	uni_c = 362436.0 / 16777216.0;
-	uni_ui = 97; /*  There is a bug in the original Fortran version */
-	uni_uj = 33; /*  of UNI -- i and j should be SAVEd in UNI()     */
+	rng->c = 362436.0 / 16777216.0;
+	rng->ui = 97; /*  There is a bug in the original Fortran version */
+	rng->uj = 33; /*  of UNI -- i and j should be SAVEd in UNI()     */
 }
 
 /* ~rinit: this takes a single integer in the range
@@ -148,13 +243,11 @@ static void rstart(int i, int j, int k, int l)
  *     a proof to go with it. spb 12/12/90
  */
 
-void rinit(int ijkl)
+static void uni_start(Rng *rng, int ijkl)
+/* start UNI in *rng from seed ijkl, as rinit() used to */
 {
 	int i, j, k, l, ij, kl;
 
-	/* tell later calls to uni() that rinit() has been called - DB */
-	rinit_called = LVB_TRUE;
-
 	/* check double type is suitable */
 	if (DBL_MANT_DIG < 24)
 		crash("FP type unsuitable for uni() random no. generator\n"); /* too small */
@@ -194,7 +287,76 @@ void rinit(int ijkl)
 	/*        printf("rinit: initialising RNG via rstart(%d, %d, %d, %d)\n",
 					i, j, k, l); */
 
-	rstart(i, j, k, l);
+	rstart(rng, i, j, k, l);
+}
+
+void rng_init(Rng *rng, int kind, int seed)
+/* start *rng as a generator of kind kind (RNG_UNI or RNG_PHILOX) from
+ * seed seed, in the range [0..MAX_SEED] */
+{
+	if ((seed < 0) || (seed > MAX_SEED))
+		crash("random number seed %d out of range\n", seed);
+	rng->kind = kind;
+	rng->seed = seed;
+	rng->next = RNG_BUFFER; /* nothing made yet */
+	if (kind == RNG_UNI)
+		uni_start(rng, seed);
+	else if (kind == RNG_PHILOX)
+	{
+		rng->key[0] = (uint32_t)seed;
+		rng->key[1] = PHILOX_KEY_TAG;
+		rng->ctr[0] = rng->ctr[1] = rng->ctr[2] = rng->ctr[3] = 0U;
+	}
+	else
+		crash("unknown kind of random number generator %d\n", kind);
+}
+
+void rng_split(Rng *child, const Rng *parent, long stream)
+/* start *child as stream number stream (0 or more) of *parent, a stream of
+ * its own for a thread or annealing chain; it depends only on how parent
+ * was started, not on how far it has got. Stream 0 of UNI is parent's own
+ * sequence and stream s starts from seed + s * CHAIN_SEED_STEP, as separate
+ * chains always have; Philox streams have keys made from parent's by a
+ * Philox block of their own */
+{
+	uint32_t ctr[4]; /* block making the key */
+	uint32_t out[4]; /* new key, in out[0] and out[1] */
+
+	lvb_assert((parent->kind != RNG_UNSET) && (stream >= 0));
+	if (parent->kind == RNG_UNI)
+		rng_init(child, RNG_UNI, (int)((parent->seed + stream * CHAIN_SEED_STEP) % (MAX_SEED + 1L)));
+	else
+	{
+		rng_init(child, RNG_PHILOX, parent->seed);
+		child->key[0] = parent->key[0];
+		child->key[1] = parent->key[1];
+		if (stream > 0)
+		{
+			ctr[0] = (uint32_t)stream;
+			ctr[1] = (uint32_t)((unsigned long)stream >> 16 >> 16);
+			ctr[2] = PHILOX_SPLIT_TAG;
+			ctr[3] = 0U;
+			philox4x32(parent->key, ctr, out);
+			child->key[0] = out[0];
+			child->key[1] = out[1];
+		}
+	}
+}
+
+const char *rng_name(int kind)
+/* return the name of generator kind kind */
+{
+	if (kind == RNG_UNI)
+		return "UNI";
+	else if (kind == RNG_PHILOX)
+		return "Philox4x32-10";
+	return "none";
+}
+
+void rinit(int ijkl)
+/* start this thread's generator as UNI from seed ijkl */
+{
+	rng_init(&uni_rng, RNG_UNI, ijkl);
 }
 
 /**********
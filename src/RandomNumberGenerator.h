@@ -59,8 +59,56 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAX_SEED 900000000
 #endif /* if 900000001L > INT_MAX */
 
+/* kinds of generator */
+#define RNG_UNSET 0	 /* not started yet */
+#define RNG_UNI 1	 /* Marsaglia's UNI, as in earlier versions of LVB */
+#define RNG_PHILOX 2 /* Philox4x32-10, counter-based */
+
+#define RNG_BUFFER 64 /* deviates made at a time */
+
+/* state of a random number generator; uni() uses the one of the calling
+ * thread, uni_rng */
+typedef struct Rng
+{
+	int kind;				/* RNG_UNSET, RNG_UNI or RNG_PHILOX */
+	int seed;				/* seed of the first stream */
+	int next;				/* next deviate in buf to hand out */
+	double buf[RNG_BUFFER]; /* deviates made ahead */
+	double u[98];			/* UNI: lagged table, was U(97) in Fortran version */
+	double c;				/* UNI: subtracted sequence */
+	int ui, uj;				/* UNI: lags */
+	uint32_t key[2];		/* Philox: key, from seed and stream */
+	uint32_t ctr[4];		/* Philox: number of next block */
+} Rng;
+
+extern thread_local Rng uni_rng;
+
+double rng_refill(Rng *rng);
+
+static inline double rng_uni(Rng *rng)
+/* return the next deviate in [0, 1) from generator *rng */
+{
+	if (rng->next < RNG_BUFFER)
+		return rng->buf[rng->next++];
+	return rng_refill(rng);
+
+} /* end rng_uni() */
+
+static inline double uni(void)
+/* return the next deviate in [0, 1) from this thread's generator */
+{
+	return rng_uni(&uni_rng);
+
+} /* end uni() */
+
 /* external uni functions */
-double uni(void);
+double uni_peek(void);
+void uni_get(Rng *);
+void uni_set(const Rng *);
 void rinit(int ijkl);
+void rng_init(Rng *rng, int kind, int seed);
+void rng_split(Rng *child, const Rng *parent, long stream);
+void philox4x32(const uint32_t key[2], const uint32_t ctr[4], uint32_t out[4]);
+const char *rng_name(int kind);
 
 #endif
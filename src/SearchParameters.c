@@ -85,6 +85,25 @@ void defaults_params(Parameters *const prms)
 	prms->n_file_format = FORMAT_PHYLIP;
 	prms->n_processors_available = omp_get_max_threads();
 	prms->n_number_max_trees = 0; /* default, keep all EPT */
+	prms->n_sample_trees = 0;	  /* default, keep all EPT */
+	prms->fitch_kernel = FITCH_KERNEL_AUTO; /* fastest supported by CPU */
+	prms->compress_patterns = LVB_FALSE;
+	prms->indirect_scoring = LVB_FALSE;
+	prms->hillclimb = HILLCLIMB_NONE;
+	prms->n_chains = 1;
+	prms->n_replicas = 0;
+	prms->batch_size = 1;
+	prms->file_name_checkpoint[0] = '\0'; /* no checkpoints */
+	prms->checkpoint_every = 0;
+	prms->checkpoint_seconds = 0;
+	prms->resume = LVB_FALSE;
+	prms->rng = RNG_UNI; /* same sequences as earlier versions */
+	prms->treestack_memory = 0; /* keep all best trees in memory */
+	prms->matrix_cache = LVB_FALSE; /* read the alignment every time */
+	prms->shared_matrix[0] = '\0'; /* alignment private to this process */
+	prms->remove_shared_matrix = LVB_FALSE;
+	prms->min_taxa_subtree_tasks = MINIMUM_TAXA_SUBTREE_TASKS;
+	prms->min_branches_subtree_tasks = MINIMUM_BRANCHES_SUBTREE_TASKS;
 
 } /* end defaults_params() */
 
@@ -95,6 +114,42 @@ void getparam(Parameters *prms, int argc, char **argv)
 	defaults_params(prms);
 	/*   user_adjust(prms);*/
 	read_parameters(prms, argc, argv);
+	fitch_kernel_select(prms->fitch_kernel);
+
+	if (prms->remove_shared_matrix == LVB_TRUE)
+	{
+		if (matrix_shared_remove(prms->shared_matrix) == LVB_FALSE)
+		{
+			fprintf(stderr, "Error, cannot remove shared memory segment '%s': %s\n", prms->shared_matrix,
+					strerror(errno));
+			exit(1);
+		}
+		printf("Removed shared memory segment '%s'\n", prms->shared_matrix);
+		exit(0);
+	}
+
+	/* carry on with the search as it was, whatever is given now */
+	if (prms->resume == LVB_TRUE)
+		checkpoint_options(prms);
+
+	if (prms->file_name_checkpoint[0] != '\0')
+	{
+		if ((prms->n_chains > 1) || (prms->n_replicas > 1))
+			crash("checkpoints are only made of a single annealing chain, not with -m or -R");
+		if ((prms->checkpoint_every == 0) && (prms->checkpoint_seconds == 0))
+			prms->checkpoint_seconds = CHECKPOINT_SECONDS;
+	}
+	if ((prms->treestack_memory > 0) && ((prms->n_chains > 1) || (prms->n_replicas > 1)))
+		crash("best trees are only spilled to file from a single annealing chain, not with -m or -R");
+	if (prms->n_sample_trees > 0)
+	{
+		if ((prms->n_chains > 1) || (prms->n_replicas > 1))
+			crash("best trees are only sampled from a single annealing chain, not with -m or -R");
+		if (prms->n_number_max_trees > 0)
+			crash("--sample-trees keeps searching once its sample is full, so cannot be used with -t, which stops");
+		if (prms->treestack_memory > 0)
+			crash("--sample-trees already bounds the memory of best trees, so cannot be used with --stack-memory");
+	}
 
 } /* end getparam() */
 
@@ -149,8 +204,52 @@ void writeinf(Parameters prms, Dataptr MSA, int argc, char **argv)
 	else if (prms.algorithm_selection == 2)
 		printf("          2 (PBS)\n");
 
+	if (prms.shared_matrix[0] != '\0')
+		printf("  Shared alignment:    '%s', %s\n", prms.shared_matrix, matrix_shared_use());
+	else if (MSA->enc_rows != NULL)
+		printf("  Alignment cache:     read\n");
+	else if (prms.matrix_cache == LVB_TRUE)
+		printf("  Alignment cache:     written to '%s" MATRIX_CACHE_SUFFIX "'\n", prms.file_name_in);
+	if (prms.compress_patterns == LVB_TRUE)
+		printf("  Site patterns:       %ld, in %ld weight blocks\n", MSA->m, MSA->n_blocks);
+	if (prms.indirect_scoring == LVB_TRUE)
+		printf("  SPR/TBR scoring:     indirect, from up-pass statesets\n");
+	if (prms.hillclimb == HILLCLIMB_SPR)
+		printf("  Hill climbing:       SPR\n");
+	else if (prms.hillclimb == HILLCLIMB_TBR)
+		printf("  Hill climbing:       SPR and TBR\n");
+	if (prms.n_chains > 1)
+		printf("  Annealing chains:    %d\n", prms.n_chains);
+	if (prms.n_replicas > 1)
+		printf("  Replica exchange:    %d replicas\n", prms.n_replicas);
+	if (prms.batch_size > 1)
+		printf("  Speculative batch:   %d proposals\n", prms.batch_size);
+	if (prms.rng != RNG_UNI)
+		printf("  Random numbers:      %s\n", rng_name(prms.rng));
+	if (prms.n_sample_trees > 0)
+		printf("  Best trees kept:     random sample of %ld, with about 60 bytes for each other tree found\n",
+			   prms.n_sample_trees);
+	if (prms.treestack_memory > 0)
+		printf("  Best tree memory:    %ld bytes, then '%s.spill'\n", prms.treestack_memory, prms.file_name_out);
+	if (prms.file_name_checkpoint[0] != '\0')
+	{
+		printf("  Checkpoint file:    '%s'", prms.file_name_checkpoint);
+		if (prms.resume == LVB_TRUE)
+			printf(", resumed");
+		printf("\n");
+	}
+	printf("  Fitch kernel:        %s", fitch_kernel_name(fitch_kernel_current()));
+	if (prms.fitch_kernel == FITCH_KERNEL_AUTO)
+		printf(" (auto)");
+	printf("\n");
+
 	printf("\nParallelisation Properties: \n");
 
+	if ((prms.min_taxa_subtree_tasks != MINIMUM_TAXA_SUBTREE_TASKS) ||
+		(prms.min_branches_subtree_tasks != MINIMUM_BRANCHES_SUBTREE_TASKS))
+		printf("  Subtree tasks:       from %ld taxa and %ld branches\n", prms.min_taxa_subtree_tasks,
+			   prms.min_branches_subtree_tasks);
+
 	if (prms.n_processors_available != omp_get_max_threads())
 	{
 		printf("  PThreads:            %d\n", prms.n_processors_available);
@@ -50,8 +50,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <unistd.h>
 
 #include "LVB.h"
+#include "Checkpoint.h"
 #include "Clock.h"
 #include "CommandLineParser.h"
+#include "FitchKernel.h"
+#include "MatrixCache.h"
 
 void writeinf(Parameters rcstruct, Dataptr restrict, int, char **);
 
@@ -49,11 +49,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 using namespace std;
 using namespace std::chrono;
 
-static void lenlog(FILE *lengthfp, TREESTACK *treestack_ptr, long iteration, long length, double temperature)
-/* write a message to file pointer lengthfp; iteration gives current iteration;
- * crash verbosely on write error */
+static void lenlog(FILE *lengthfp, long stored, long iteration, long length, double temperature)
+/* write a message to file pointer lengthfp; iteration gives current iteration
+ * and stored the number of best trees kept; crash verbosely on write error */
 {
-	fprintf(lengthfp, "  %-15.8f%-15ld%-16ld%-15ld\n", temperature, iteration, treestack_ptr->next, length);
+	fprintf(lengthfp, "  %-15.8f%-15ld%-16ld%-15ld\n", temperature, iteration, stored, length);
 	if (ferror(lengthfp))
 	{
 		crash("file error when logging search progress");
@@ -61,6 +61,52 @@ static void lenlog(FILE *lengthfp, TREESTACK *treestack_ptr, long iteration, lon
 
 } /* end lenlog() */
 
+static Lvb_bool propose_regraft(Dataptr MSA, TREESTACK_TREE_NODES *const tree, long root, Lvb_bool tbr, Uppass_sets *up,
+							   long *move, Undo_log *undo)
+/* propose a random SPR rearrangement of the tree in tree (of root root),
+ * or a TBR one if tbr is LVB_TRUE; if up is not NULL, only choose it,
+ * putting the branch to move, its destination and the leaf next to its new
+ * root (UNSET for SPR) in move[0], move[1] and move[2], and return
+ * LVB_TRUE; otherwise make it in place, recording it in undo, and return
+ * LVB_FALSE; the random number sequence is the same either way */
+{
+	if (up == NULL)
+	{
+		if (tbr == LVB_TRUE)
+			mutate_tbr(MSA, tree, root, undo);
+		else
+			mutate_spr(MSA, tree, root, undo);
+		return LVB_FALSE;
+	}
+
+	if (tbr == LVB_TRUE)
+		tbr_choose(MSA, tree, root, &move[0], &move[1], &move[2]);
+	else
+	{
+		spr_choose(MSA, tree, root, &move[0], &move[1]);
+		move[2] = UNSET;
+	}
+	return LVB_TRUE;
+
+} /* end propose_regraft() */
+
+static void make_regraft(Dataptr MSA, TREESTACK_TREE_NODES *const tree, Parameters rcstruct, long root, const long *move,
+						 const long length, Undo_log *undo, long *p_todo_arr, long *p_todo_arr_sum_changes)
+/* make the rearrangement in move, chosen by propose_regraft() and found
+ * to give length length, in place, recording it in undo, and bring the
+ * statesets up to date */
+{
+	long made_length; /* length of tree as rearranged */
+
+	if (move[2] == UNSET)
+		spr_apply(MSA, tree, root, move[0], move[1], undo);
+	else
+		tbr_apply(MSA, tree, root, move[0], move[1], move[2], undo);
+	made_length = getplen(MSA, tree, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes);
+	lvb_assert(made_length == length);
+
+} /* end make_regraft() */
+
 long deterministic_hillclimb(Dataptr MSA, TREESTACK *treestack_ptr, const TREESTACK_TREE_NODES *const inittree,
 							 Parameters rcstruct, long root, FILE *const lenfp, long *current_iter, Lvb_bool log_progress)
 /* perform a deterministic hill-climbing optimization on the tree in inittree,
@@ -77,22 +123,21 @@ long deterministic_hillclimb(Dataptr MSA, TREESTACK *treestack_ptr, const TREEST
 	long proposed_tree_root = root;				  /* root of proposed new config */
 	long tree_length_change;					  /* change in length */
 	Lvb_bool newtree;							  /* accepted a new configuration */
-	TREESTACK_TREE_NODES *p_current_tree;		  /* current configuration */
-	TREESTACK_TREE_NODES *p_proposed_tree;		  /* proposed new configuration */
+	TREESTACK_TREE_NODES *p_current_tree;		  /* current configuration, changed in place */
+	Undo_log *undo;								  /* record of the proposed change */
 	unsigned int *branch_numbers_arr;			  /* array of internal branch numbers */
 	Lvb_bool leftright[] = {LVB_FALSE, LVB_TRUE}; /* to loop through left and right */
 	long *p_todo_arr;							  /* [MAX_BRANCHES + 1];	 list of "dirty" branch nos */
 	long *p_todo_arr_sum_changes;				  /*used in openMP, to sum the partial changes */
-	int *p_runs;								  /*used in openMP, 0 if not run yet, 1 if it was processed */
 
 	/* "local" dynamic heap memory */
 	p_current_tree = treealloc(MSA, LVB_TRUE);
-	p_proposed_tree = treealloc(MSA, LVB_TRUE);
+	undo = undo_alloc(MSA);
 	branch_numbers_arr = (unsigned int *)alloc(MSA->numberofpossiblebranches * sizeof(unsigned int), "old parent alloc");
 
 	treecopy(MSA, p_current_tree, inittree, LVB_TRUE); /* current configuration */
-	alloc_memory_to_getplen(MSA, &p_todo_arr, &p_todo_arr_sum_changes, &p_runs);
-	current_tree_length = getplen(MSA, p_current_tree, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes, p_runs);
+	alloc_memory_to_getplen(MSA, &p_todo_arr, &p_todo_arr_sum_changes);
+	current_tree_length = getplen(MSA, p_current_tree, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes);
 
 	/* identify internal branches */
 	for (i = MSA->n; i < MSA->numberofpossiblebranches; i++)
@@ -106,8 +151,9 @@ long deterministic_hillclimb(Dataptr MSA, TREESTACK *treestack_ptr, const TREEST
 		{
 			for (j = 0; j < 2; j++)
 			{
-				mutate_deterministic(MSA, p_proposed_tree, p_current_tree, root, branch_numbers_arr[i], leftright[j]);
-				proposed_tree_length = getplen(MSA, p_proposed_tree, rcstruct, proposed_tree_root, p_todo_arr, p_todo_arr_sum_changes, p_runs);
+				undo_begin(undo);
+				mutate_deterministic(MSA, p_current_tree, root, branch_numbers_arr[i], leftright[j], undo);
+				proposed_tree_length = getplen(MSA, p_current_tree, rcstruct, proposed_tree_root, p_todo_arr, p_todo_arr_sum_changes);
 				lvb_assert(proposed_tree_length >= 1L);
 				tree_length_change = proposed_tree_length - current_tree_length;
 				if (tree_length_change <= 0)
@@ -117,15 +163,16 @@ long deterministic_hillclimb(Dataptr MSA, TREESTACK *treestack_ptr, const TREEST
 						ClearTreestack(treestack_ptr);
 						current_tree_length = proposed_tree_length;
 					}
-					if (CompareHashTreeToHashstack(MSA, treestack_ptr, p_proposed_tree, proposed_tree_root, LVB_FALSE) == 1)
+					if (CompareTreeToTreestack(MSA, treestack_ptr, p_current_tree, proposed_tree_root, LVB_FALSE) == 1)
 					{
 						newtree = LVB_TRUE;
-						SwapTrees(&p_current_tree, &root, &p_proposed_tree, &proposed_tree_root);
+						undo_commit(undo);
 					}
 				}
+				undo_rollback(MSA, undo, p_current_tree); /* unless kept above */
 				if ((log_progress == LVB_TRUE) && ((*current_iter % STAT_LOG_INTERVAL) == 0))
 				{
-					lenlog(lenfp, treestack_ptr, *current_iter, current_tree_length, 0);
+					lenlog(lenfp, CountTreestack(*treestack_ptr), *current_iter, current_tree_length, 0);
 				}
 				*current_iter += 1;
 			}
@@ -133,18 +180,418 @@ long deterministic_hillclimb(Dataptr MSA, TREESTACK *treestack_ptr, const TREEST
 	} while (newtree == LVB_TRUE);
 
 	/* free "local" dynamic heap memory */
-	free_memory_to_getplen(&p_todo_arr, &p_todo_arr_sum_changes, &p_runs);
+	free_memory_to_getplen(&p_todo_arr, &p_todo_arr_sum_changes);
 	free(p_current_tree);
-	free(p_proposed_tree);
+	undo_free(undo);
 	free(branch_numbers_arr);
 
 	return current_tree_length;
 } /* end deterministic_hillclimb */
 
+typedef struct /* a rearrangement scored by regraft_hillclimb() */
+{
+	long length;  /* length of tree after it */
+	long src;	  /* branch to move, or UNSET if none */
+	long newroot; /* leaf next to new root of moved subtree, or UNSET */
+	long dest;	  /* destination of branch to move */
+} Regraft_move;
+
+typedef struct /* one round of regraft_hillclimb(), shared by the pool */
+{
+	Dataptr MSA;
+	const TREESTACK_TREE_NODES *tree;
+	long root;
+	long length;		 /* length of tree */
+	Lvb_bool tbr;		 /* reroot moved subtrees too */
+	Uppass_sets **up;	 /* by thread: up-pass statesets of tree, shared */
+	long **p_below;		 /* by thread: by branch, mark of last subtree to move it was in */
+	long **p_leaves;	 /* by thread: leaves of subtree to move */
+	Regraft_move *best;	 /* by thread: best rearrangement found */
+	long *p_scored;		 /* by thread: rearrangements scored */
+	long next_src;		 /* next branch to move to take */
+	long mark_base;		 /* added to a branch to move to mark its subtree, new every round */
+} Regraft_job;
+
+static Lvb_bool regraft_better(const Regraft_move *a, const Regraft_move *b)
+/* return LVB_TRUE if rearrangement a should be made rather than b, the
+ * shorter being better and ties going to the first in a fixed order, so
+ * that the choice does not depend on how the work was shared out */
+{
+	if (b->src == UNSET)
+		return LVB_TRUE;
+	if (a->length != b->length)
+		return a->length < b->length ? LVB_TRUE : LVB_FALSE;
+	if (a->src != b->src)
+		return a->src < b->src ? LVB_TRUE : LVB_FALSE;
+	if (a->newroot != b->newroot)
+		return a->newroot < b->newroot ? LVB_TRUE : LVB_FALSE;
+	return a->dest < b->dest ? LVB_TRUE : LVB_FALSE;
+
+} /* end regraft_better() */
+
+static void regraft_scores(void *arg, int thread)
+/* pool task for regraft_hillclimb(): take branches to move in turn and
+ * score every SPR rearrangement of each, and every TBR one too if wanted,
+ * keeping this thread's best in job->best[thread]; rearrangements not
+ * shorter than the best so far are abandoned early */
+{
+	Regraft_job *job = (Regraft_job *)arg;
+	Dataptr MSA = job->MSA;
+	const TREESTACK_TREE_NODES *tree = job->tree;
+	long *below = job->p_below[thread];
+	long *leaves = job->p_leaves[thread];
+	Regraft_move *best = &job->best[thread];
+	Regraft_move move;	/* current rearrangement */
+	long mark;			/* mark of subtree to move, never used before */
+	long n_leaves;		/* leaves of subtree to move */
+	long n_todo;		/* branches of subtree still to visit */
+	long branch;		/* current branch */
+	long sister;		/* sister of branch to move */
+	long i;				/* loop counter */
+	long scored = 0;	/* rearrangements scored */
+
+	for (;;)
+	{
+		move.src = __atomic_fetch_add(&job->next_src, 1, __ATOMIC_RELAXED);
+		if (move.src >= MSA->numberofpossiblebranches)
+			break;
+		if ((move.src == job->root) || (tree[move.src].parent == job->root))
+			continue;
+		sister = (tree[tree[move.src].parent].left == move.src) ? tree[tree[move.src].parent].right
+																 : tree[tree[move.src].parent].left;
+
+		/* mark the subtree to move, and find its leaves, keeping the
+		 * leaves found at the start of leaves and the branches still to
+		 * visit after them; marks left by earlier rounds, whichever
+		 * thread made them, are never taken for this one */
+		mark = job->mark_base + move.src;
+		n_leaves = 0;
+		n_todo = 0;
+		leaves[n_todo++] = move.src;
+		while (n_todo > n_leaves)
+		{
+			branch = leaves[--n_todo];
+			below[branch] = mark;
+			if (tree[branch].left == UNSET)
+			{
+				leaves[n_todo++] = leaves[n_leaves];
+				leaves[n_leaves++] = branch;
+			}
+			else
+			{
+				leaves[n_todo++] = tree[branch].left;
+				leaves[n_todo++] = tree[branch].right;
+			}
+		}
+
+		/* rerooting next to a child of the moved branch changes nothing */
+		for (i = -1; i < n_leaves; i++)
+		{
+			move.newroot = (i < 0) ? UNSET : leaves[i];
+			if ((move.newroot != UNSET) && ((job->tbr == LVB_FALSE) || (n_leaves <= 2) ||
+											(tree[move.newroot].parent == move.src)))
+				continue;
+			for (move.dest = 0; move.dest < MSA->numberofpossiblebranches; move.dest++)
+			{
+				if ((move.dest == job->root) || (move.dest == tree[move.src].parent) || (move.dest == sister) ||
+					(below[move.dest] == mark))
+					continue;
+				move.length = tbr_length(MSA, tree, job->up[thread], job->root, job->length, move.src, move.dest,
+										 move.newroot, best->length);
+				scored++;
+				if ((move.length <= best->length) && (regraft_better(&move, best) == LVB_TRUE))
+					*best = move;
+			}
+		}
+	}
+	job->p_scored[thread] = scored;
+
+} /* end regraft_scores() */
+
+long regraft_hillclimb(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK_TREE_NODES *const tree, Parameters rcstruct,
+					   long root, long *current_iter, Lvb_bool log_progress)
+/* improve the tree in tree (of root root) in place by hill climbing: score
+ * every SPR rearrangement of it, and every TBR one too if
+ * rcstruct.hillclimb is HILLCLIMB_TBR, without making them, on all the
+ * threads requested, make the best if it is shorter, and repeat until
+ * none is; if the tree is improved, it replaces the trees in
+ * treestack_ptr; return its length; *current_iter is increased by the
+ * rearrangements scored */
+{
+	const int n_threads = rcstruct.n_processors_available;
+	Regraft_job job;			  /* shared by the threads of the pool */
+	Regraft_move best;			  /* best rearrangement of a round */
+	long start_length;			  /* length before hill climbing */
+	long rounds = 0;			  /* rearrangements made */
+	long scored = 0;			  /* rearrangements scored */
+	long i;						  /* loop counter */
+	int k;						  /* loop counter */
+	double seconds;				  /* time taken */
+	long *p_todo_arr;			  /* list of "dirty" branch nos */
+	long *p_todo_arr_sum_changes; /* scratch for getplen() */
+
+	/* the pool is started again with every thread requested, and put back
+	 * as getplen() wants it afterwards */
+	pool_create(n_threads);
+	auto start = steady_clock::now();
+
+	job.MSA = MSA;
+	job.tree = tree;
+	job.root = root;
+	job.tbr = (rcstruct.hillclimb == HILLCLIMB_TBR) ? LVB_TRUE : LVB_FALSE;
+	job.up = (Uppass_sets **)alloc(n_threads * sizeof(Uppass_sets *), "up-pass statesets by thread");
+	job.p_below = (long **)alloc(n_threads * sizeof(long *), "subtree marks by thread");
+	job.p_leaves = (long **)alloc(n_threads * sizeof(long *), "subtree leaves by thread");
+	job.best = (Regraft_move *)alloc(n_threads * sizeof(Regraft_move), "best rearrangements");
+	job.p_scored = (long *)alloc(n_threads * sizeof(long), "rearrangements scored");
+	for (k = 0; k < n_threads; k++)
+	{
+		job.up[k] = uppass_alloc(MSA, k == 0 ? NULL : job.up[0]);
+		job.p_below[k] = (long *)alloc(MSA->numberofpossiblebranches * sizeof(long), "subtree marks");
+		job.p_leaves[k] = (long *)alloc(MSA->numberofpossiblebranches * sizeof(long), "subtree leaves");
+		for (i = 0; i < MSA->numberofpossiblebranches; i++)
+			job.p_below[k][i] = UNSET;
+	}
+
+	/* the tree may have come off the tree stack without statesets */
+	for (i = MSA->n; i < MSA->numberofpossiblebranches; i++)
+		tree[i].sitestate[0] = 0U;
+	alloc_memory_to_getplen(MSA, &p_todo_arr, &p_todo_arr_sum_changes);
+	job.length = getplen(MSA, tree, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes);
+	start_length = job.length;
+
+	for (;;)
+	{
+		uppass_fill(MSA, tree, root, job.up[0]);
+		for (k = 0; k < n_threads; k++)
+		{
+			job.up[k]->valid = LVB_TRUE;
+			job.best[k].length = job.length - 1; /* only shorter trees are wanted */
+			job.best[k].src = UNSET;
+		}
+		job.next_src = 0;
+		job.mark_base = rounds * MSA->numberofpossiblebranches;
+		pool_run(regraft_scores, &job);
+
+		best = job.best[0];
+		for (k = 0; k < n_threads; k++)
+		{
+			scored += job.p_scored[k];
+			if ((job.best[k].src != UNSET) && (regraft_better(&job.best[k], &best) == LVB_TRUE))
+				best = job.best[k];
+		}
+		if (best.src == UNSET)
+			break;
+
+		if (best.newroot == UNSET)
+			spr_apply(MSA, tree, root, best.src, best.dest, NULL);
+		else
+			tbr_apply(MSA, tree, root, best.src, best.dest, best.newroot, NULL);
+		job.length = getplen(MSA, tree, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes);
+		lvb_assert(job.length == best.length);
+		rounds++;
+	}
+
+	if (job.length < start_length)
+	{
+		ClearTreestack(treestack_ptr);
+		CompareTreeToTreestack(MSA, treestack_ptr, tree, root, LVB_FALSE);
+	}
+	*current_iter += scored;
+
+	seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+	if (log_progress == LVB_TRUE)
+	{
+		printf("\n%s hill climbing: %ld rearrangements made, %ld scored (%.0f per second), length %ld to %ld\n",
+			   job.tbr == LVB_TRUE ? "TBR" : "SPR", rounds, scored, seconds > 0.0 ? scored / seconds : 0.0,
+			   start_length, job.length);
+	}
+
+	/* free "local" dynamic heap memory */
+	free_memory_to_getplen(&p_todo_arr, &p_todo_arr_sum_changes);
+	for (k = n_threads - 1; k >= 0; k--)
+	{
+		uppass_free(job.up[k]);
+		free(job.p_below[k]);
+		free(job.p_leaves[k]);
+	}
+	free(job.up);
+	free(job.p_below);
+	free(job.p_leaves);
+	free(job.best);
+	free(job.p_scored);
+	pool_create(MSA->n_threads_getplen);
+
+	return job.length;
+
+} /* end regraft_hillclimb() */
+
+static long stored_trees(TREESTACK *treestack_ptr, Shared_treestack *shared)
+/* return the number of best trees kept, in shared if it is not NULL or
+ * in *treestack_ptr otherwise */
+{
+	return (shared == NULL) ? CountTreestack(*treestack_ptr) : CountSharedTreestack(shared);
+
+} /* end stored_trees() */
+
+static const char *const rearrangement_name[] = {"NNI", "SPR", "TBR"}; /* by REARRANGE_ value */
+
+static int choose_rearrangement(Parameters rcstruct, long iter, const double *trops_counter, double *trops_probs)
+/* return the rearrangement Anneal() makes at iteration iter, as one of
+ * REARRANGE_NNI, REARRANGE_SPR or REARRANGE_TBR; for algorithm 2, the
+ * probabilities in trops_probs are first worked out from the counts of
+ * useful rearrangements in trops_counter */
+{
+	long trops_total; /* total of counts */
+	double random_val; /* deviate choosing the rearrangement */
+
+	if (rcstruct.algorithm_selection == 2)
+	{
+		trops_total = trops_counter[0] + trops_counter[1] + trops_counter[2];
+		trops_probs[0] = trops_counter[0] / trops_total;
+		trops_probs[1] = trops_counter[1] / trops_total;
+		trops_probs[2] = trops_counter[2] / trops_total;
+	}
+
+	if (rcstruct.algorithm_selection >= 1)
+	{
+		random_val = uni();
+		if (random_val < trops_probs[0])
+			return REARRANGE_NNI;
+		else if (random_val < trops_probs[0] + trops_probs[1])
+			return REARRANGE_SPR;
+		else
+			return REARRANGE_TBR;
+	}
+	return (iter & 0x01) ? REARRANGE_SPR : REARRANGE_NNI;
+
+} /* end choose_rearrangement() */
+
+typedef struct /* proposal made and scored by Anneal() ahead of its turn */
+{
+	TREESTACK_TREE_NODES *tree;	  /* copy of the current tree, with the proposal made */
+	Undo_log *undo;				  /* record of the proposal */
+	long *p_todo_arr;			  /* list of "dirty" branch nos */
+	long *p_todo_arr_sum_changes; /* scratch for getplen() */
+	Rng rng;					  /* generator state just after making the proposal */
+	int kind;					  /* REARRANGE_NNI, REARRANGE_SPR or REARRANGE_TBR */
+	long ceiling;				  /* length above which the proposal is rejected */
+	long length;				  /* length of the proposed tree */
+} Speculation;
+
+typedef struct /* speculative batch scored at once by speculate() */
+{
+	Dataptr MSA;
+	Parameters rcstruct;
+	Speculation *spec; /* proposals */
+	long n;			   /* number of proposals */
+	long root;		   /* root of all trees */
+} Speculation_job;
+
+static void speculation_scores(void *arg, int thread)
+/* pool task for speculate(): score every proposal whose number, counting
+ * from 0, leaves thread when divided by the number of threads */
+{
+	Speculation_job *job = (Speculation_job *)arg;
+	Speculation *s; /* current proposal */
+	long k;			/* loop counter */
+
+	for (k = thread; k < job->n; k += pool_threads())
+	{
+		s = &job->spec[k];
+		s->length = getplen_bounded(job->MSA, s->tree, job->rcstruct, job->root, s->p_todo_arr,
+									s->p_todo_arr_sum_changes, s->ceiling);
+	}
+
+} /* end speculation_scores() */
+
+static void speculate(Dataptr MSA, Parameters rcstruct, Speculation *spec, long n, long root, long iter,
+					  double tree_minimum_length, long current_tree_length, double t, const double *trops_counter,
+					  const double *trops_probs)
+/* make the next n proposals of Anneal() from iteration iter, each on its
+ * own copy of the current tree in spec, as they would be made if each
+ * before it were rejected, and score them all at once with the worker
+ * pool; the random number generator is left as after the last rejection */
+{
+	Speculation_job job; /* work for the pool */
+	double counter[3];	 /* trops_counter as it would be */
+	double probs[3];	 /* trops_probs as it would be */
+	Speculation *s;		 /* current proposal */
+	long k;				 /* loop counter */
+	int i;				 /* loop counter */
+
+	memcpy(counter, trops_counter, sizeof(counter));
+	memcpy(probs, trops_probs, sizeof(probs));
+	for (k = 0; k < n; k++)
+	{
+		s = &spec[k];
+		undo_begin(s->undo);
+		s->kind = choose_rearrangement(rcstruct, iter + k, counter, probs);
+		if (s->kind == REARRANGE_NNI)
+			mutate_nni(MSA, s->tree, root, s->undo);
+		else if (s->kind == REARRANGE_SPR)
+			mutate_spr(MSA, s->tree, root, s->undo);
+		else
+			mutate_tbr(MSA, s->tree, root, s->undo);
+		uni_get(&s->rng);
+		s->ceiling = acceptance_ceiling(tree_minimum_length, current_tree_length, t);
+		(void)uni(); /* deviate drawn on rejection */
+
+		/* algorithm 2 counts are updated as for a rejection */
+		if (rcstruct.algorithm_selection == 2)
+			for (i = 0; i < 3; i++)
+				if (s->kind != i)
+					counter[i] = counter[i] + 0.5;
+	}
+
+	job.MSA = MSA;
+	job.rcstruct = rcstruct;
+	job.spec = spec;
+	job.n = n;
+	job.root = root;
+	pool_run(speculation_scores, &job);
+
+} /* end speculate() */
+
+static void speculation_discard(Dataptr MSA, Speculation *spec, long n, long *next)
+/* undo the proposals of the batch of n in spec not yet taken, *next on,
+ * and mark the batch used up */
+{
+	long k; /* loop counter */
+
+	for (k = *next; k < n; k++)
+		undo_rollback(MSA, spec[k].undo, spec[k].tree);
+	*next = n;
+
+} /* end speculation_discard() */
+
+static void speculation_accept(Dataptr MSA, TREESTACK_TREE_NODES *const current, Speculation *spec, long size, long n,
+							   long *next)
+/* make the proposal of the batch of n in spec taken last, *next - 1, in
+ * the current tree current and in the other size - 1 trees of spec, after
+ * undoing their own proposals, and mark the batch used up; the proposal
+ * is left recorded, for the caller to commit */
+{
+	Speculation *s = &spec[*next - 1]; /* proposal accepted */
+	long k;							   /* loop counter */
+
+	undo_copy(MSA, s->undo, s->tree, current);
+	for (k = 0; k < size; k++)
+	{
+		if (&spec[k] != s)
+		{
+			undo_rollback(MSA, spec[k].undo, spec[k].tree);
+			undo_copy(MSA, s->undo, s->tree, spec[k].tree);
+		}
+	}
+	*next = n;
+
+} /* end speculation_accept() */
+
 long Anneal(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK *treevo, const TREESTACK_TREE_NODES *const inittree, Parameters rcstruct,
 			long root, const double t0, const long maxaccept, const long maxpropose,
 			const long maxfail, FILE *const lenfp, long *current_iter,
-			Lvb_bool log_progress)
+			Lvb_bool log_progress, Shared_treestack *shared)
 /* seek parsimonious tree from initial tree in inittree (of root root)
  * with initial temperature t0, and subsequent temperatures obtained by
  * multiplying the current temperature by (t1 / t0) ** n * t0 where n is
@@ -156,7 +603,8 @@ long Anneal(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK *treevo, const TREE
  * lenfp is for output of current tree length and associated details;
  * *current_iter should give the iteration number at the start of this call and
  * will be used in any statistics sent to lenfp, and will be updated on
- * return */
+ * return; best trees are kept in *treestack_ptr, or, if shared is not NULL,
+ * in shared, which other chains may be using at the same time */
 {
 	long accepted = 0;						 /* changes accepted */
 	Lvb_bool dect;							 /* should decrease temperature */
@@ -177,11 +625,25 @@ long Anneal(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK *treevo, const TREE
 	double grad_geom = 0.99;				 /* "gradient" of the geometric schedule */
 	double grad_linear = 10 * LVB_EPS;		 /* gradient of the linear schedule */
 	/* double grad_linear = 10 * LVB_EPS; */ /* gradient of the linear schedule */
-	TREESTACK_TREE_NODES *p_current_tree;	 /* current configuration */
-	TREESTACK_TREE_NODES *p_proposed_tree;	 /* proposed new configuration */
+	TREESTACK_TREE_NODES *p_current_tree;	 /* current configuration, changed in place */
+	Undo_log *undo;							 /* record of the proposed change */
+	Uppass_sets *up = NULL;					 /* up-pass statesets of current tree, if wanted */
+	Uppass_sets *up_now;					 /* up, if to be used for this proposal */
+	long move[3];							 /* SPR or TBR proposal not made yet */
+	Lvb_bool scored = LVB_FALSE;			 /* proposal is in move, not made yet */
+	long unchanged = 0;						 /* proposals since current tree changed */
+	long ceiling;							 /* length above which proposal is rejected */
 	long *p_todo_arr;						 /* [MAX_BRANCHES + 1];	 list of "dirty" branch nos */
 	long *p_todo_arr_sum_changes;			 /*used in openMP, to sum the partial changes */
-	int *p_runs;							 /*used in openMP, 0 if not run yet, 1 if it was processed */
+	Fingerprint_set seen;					 /* best trees of this chain, if shared */
+	Speculation *spec = NULL;				 /* speculative batch, if wanted */
+	Speculation *spec_now = NULL;			 /* proposal of the batch taken now */
+	long spec_n = 0;						 /* proposals in the batch */
+	long spec_next = 0;						 /* next proposal of the batch to take */
+	TREESTACK_TREE_NODES *tree_now;			 /* tree with the proposal made */
+	Undo_log *undo_now;						 /* record of the proposal */
+	int kind;								 /* rearrangement proposed */
+	long k;									 /* loop counter */
 
 	/* variables that could calculate immediately */
 	const double log_wrapper_LVB_EPS = log_wrapper(LVB_EPS);
@@ -191,26 +653,81 @@ long Anneal(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK *treevo, const TREE
 
 	long w_changes_prop = 0;
 	long w_changes_acc = 0;
-	p_proposed_tree = treealloc(MSA, LVB_TRUE);
+	Checkpoint_state state;				 /* search state, for a checkpoint */
+	long checkpoint_iter = LONG_MAX;	 /* iteration when next checkpoint is due */
+	time_t checkpoint_time = 0;			 /* time when next checkpoint is due */
 	p_current_tree = treealloc(MSA, LVB_TRUE);
+	undo = undo_alloc(MSA);
+	if ((rcstruct.indirect_scoring == LVB_TRUE) && (rcstruct.batch_size < 2))
+		up = uppass_alloc(MSA, NULL);
 
 	treecopy(MSA, p_current_tree, inittree, LVB_TRUE); /* current configuration */
 
-	alloc_memory_to_getplen(MSA, &p_todo_arr, &p_todo_arr_sum_changes, &p_runs);
-	current_tree_length = getplen(MSA, p_current_tree, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes, p_runs);
+	alloc_memory_to_getplen(MSA, &p_todo_arr, &p_todo_arr_sum_changes);
+	current_tree_length = getplen(MSA, p_current_tree, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes);
 	dect = LVB_FALSE; /* made LVB_TRUE as necessary at end of loop */
 
 	lvb_assert(((float)t >= (float)LVB_EPS) && (t <= 1.0) && (grad_geom >= LVB_EPS) && (grad_linear >= LVB_EPS));
 
 	best_tree_length = current_tree_length;
 
-	CompareHashTreeToHashstack(MSA, treestack_ptr, inittree, root, LVB_FALSE); /* init. tree initially best */
+	/* init. tree initially best */
+	if (shared == NULL)
+		CompareTreeToTreestack(MSA, treestack_ptr, inittree, root, LVB_FALSE);
+	else
+		CompareTreeToSharedTreestack(MSA, shared, &seen, inittree, root, current_tree_length);
 
 	double trops_counter[3] = {1, 1, 1};
 	double trops_probs[3] = {0, 0, 0};
-	long trops_total = trops_counter[0] + trops_counter[1] + trops_counter[2];
 	long trops_id = 0;
 
+	/* carry on from a checkpoint, which must be of the same search, if
+	 * asked to; everything before this point is as it was then, except for
+	 * the random number generator */
+	if (rcstruct.resume == LVB_TRUE)
+	{
+		checkpoint_load(MSA, rcstruct, &state, p_current_tree, treestack_ptr);
+		if (state.t0 != t0)
+			crash("checkpoint file '%s' is from a different search: the starting temperature was %g, not %g",
+				  rcstruct.file_name_checkpoint, state.t0, t0);
+		*current_iter = state.current_iter;
+		iter = state.iter;
+		root = state.root;
+		best_tree_length = state.best_tree_length;
+		t = state.t;
+		t_n = state.t_n;
+		failedcnt = state.failedcnt;
+		accepted = state.accepted;
+		proposed = state.proposed;
+		unchanged = state.unchanged;
+		memcpy(trops_counter, state.trops_counter, sizeof(trops_counter));
+		memcpy(trops_probs, state.trops_probs, sizeof(trops_probs));
+		trops_id = state.trops_id;
+		current_tree_length = getplen(MSA, p_current_tree, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes);
+		lvb_assert(current_tree_length == state.current_tree_length);
+		uni_set(&state.rng);
+	}
+	if (rcstruct.file_name_checkpoint[0] != '\0')
+	{
+		if (rcstruct.checkpoint_every > 0)
+			checkpoint_iter = *current_iter + rcstruct.checkpoint_every;
+		checkpoint_time = time(NULL) + rcstruct.checkpoint_seconds;
+	}
+
+	/* a speculative batch starts from copies of the current tree, kept up
+	 * to date with it */
+	if (rcstruct.batch_size > 1)
+	{
+		spec = (Speculation *)alloc(rcstruct.batch_size * sizeof(Speculation), "speculative batch");
+		for (k = 0; k < rcstruct.batch_size; k++)
+		{
+			spec[k].tree = treealloc(MSA, LVB_TRUE);
+			spec[k].undo = undo_alloc(MSA);
+			alloc_memory_to_getplen(MSA, &spec[k].p_todo_arr, &spec[k].p_todo_arr_sum_changes);
+			treecopy(MSA, spec[k].tree, p_current_tree, LVB_TRUE);
+		}
+	}
+
 	if ((log_progress == LVB_TRUE) && (*current_iter == 0))
 	{
 
@@ -230,6 +747,8 @@ long Anneal(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK *treevo, const TREE
 			fprintf(pFile, "Iteration\tAlgorithm\tAccepted\tLength\tTemperature\tTreestack Size\n");
 		}
 	}
+	else if ((rcstruct.resume == LVB_TRUE) && (rcstruct.verbose == LVB_TRUE))
+		pFile = fopen("changeAccepted.tsv", "a");
 	tree_minimum_length = (double)MSA->min_len_tree;
 
 	while (1)
@@ -240,87 +759,138 @@ long Anneal(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK *treevo, const TREE
 		if ((*current_iter % REROOT_INTERVAL) == 0)
 		{
 			root = arbreroot(MSA, p_current_tree, root);
+			/* bring statesets up to date, so a proposal only changes its own path */
+			proposed_tree_length = getplen(MSA, p_current_tree, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes);
+			lvb_assert(proposed_tree_length == current_tree_length);
+			if (up != NULL)
+				up->valid = LVB_FALSE;
+			for (k = 0; (spec != NULL) && (k < rcstruct.batch_size); k++)
+				treecopy(MSA, spec[k].tree, p_current_tree, LVB_TRUE);
 			if ((log_progress == LVB_TRUE) && ((*current_iter % STAT_LOG_INTERVAL) == 0))
 			{
-				lenlog(lenfp, treestack_ptr, *current_iter, current_tree_length, t);
+				lenlog(lenfp, stored_trees(treestack_ptr, shared), *current_iter, current_tree_length, t);
 			}
 		}
 
 		lvb_assert(t > DBL_EPSILON);
 
-		/* mutation: alternate between the two mutation functions */
+		/* mutation: alternate between the two mutation functions; the
+		 * current tree is changed in place, and changed back if the
+		 * proposal is not accepted; in a speculative batch, proposals are
+		 * made and scored ahead on copies of the current tree, and taken
+		 * here in turn, each with the random number generator as it was
+		 * after making it */
 		proposed_tree_root = root;
-		if (rcstruct.algorithm_selection == 2)
-		{
-			trops_total = trops_counter[0] + trops_counter[1] + trops_counter[2];
-			trops_probs[0] = trops_counter[0] / trops_total;
-			trops_probs[1] = trops_counter[1] / trops_total;
-			trops_probs[2] = trops_counter[2] / trops_total;
-		}
-
-		if (rcstruct.algorithm_selection >= 1)
+		if (spec != NULL)
 		{
-			double random_val = uni();
-			if (random_val < trops_probs[0])
-			{
-				mutate_nni(MSA, p_proposed_tree, p_current_tree, root); /* local change */
-				strcpy(change, "NNI");
-				if (rcstruct.algorithm_selection == 2)
-					trops_id = 0;
-			}
-			else if (random_val < trops_probs[0] + trops_probs[1])
+			if (spec_next == spec_n)
 			{
-				mutate_spr(MSA, p_proposed_tree, p_current_tree, root); /* global change */
-				strcpy(change, "SPR");
-				if (rcstruct.algorithm_selection == 2)
-					trops_id = 1;
-			}
-			else
-			{
-				mutate_tbr(MSA, p_proposed_tree, p_current_tree, root); /* global change */
-				strcpy(change, "TBR");
-				if (rcstruct.algorithm_selection == 2)
-					trops_id = 2;
+				spec_n = rcstruct.batch_size;
+				if (spec_n > REROOT_INTERVAL - (*current_iter % REROOT_INTERVAL))
+					spec_n = REROOT_INTERVAL - (*current_iter % REROOT_INTERVAL); /* none may re-root */
+				if (spec_n > maxpropose - proposed)
+					spec_n = maxpropose - proposed; /* none may be at another temperature */
+				if (spec_n < 1)
+					spec_n = 1;
+				speculate(MSA, rcstruct, spec, spec_n, root, iter, tree_minimum_length, current_tree_length, t,
+						  trops_counter, trops_probs);
+				spec_next = 0;
 			}
+			spec_now = &spec[spec_next++];
+			uni_set(&spec_now->rng);
+			tree_now = spec_now->tree;
+			undo_now = spec_now->undo;
+			strcpy(change, rearrangement_name[spec_now->kind]);
+			if (rcstruct.algorithm_selection == 2)
+				trops_id = spec_now->kind;
+			scored = LVB_FALSE;
+			proposed_tree_length = spec_now->length;
 		}
 		else
 		{
-			if (iter & 0x01)
+			tree_now = p_current_tree;
+			undo_now = undo;
+			undo_begin(undo);
+
+			/* SPR and TBR proposals are scored from up-pass statesets
+			 * without being made, if these are up to date; finding them
+			 * again takes about as long as scoring a tree in full, so is
+			 * only worth it once the current tree has stopped changing for
+			 * a while */
+			up_now = NULL;
+			if ((up != NULL) && ((up->valid == LVB_TRUE) || (unchanged >= UPPASS_REFILL_INTERVAL)))
 			{
-				mutate_spr(MSA, p_proposed_tree, p_current_tree, root); /* global change */
-				strcpy(change, "SPR");
+				if (up->valid == LVB_FALSE)
+					uppass_fill(MSA, p_current_tree, root, up);
+				up_now = up;
 			}
+			scored = LVB_FALSE;
+			kind = choose_rearrangement(rcstruct, iter, trops_counter, trops_probs);
+			if (rcstruct.algorithm_selection == 2)
+				trops_id = kind;
+			if (kind == REARRANGE_NNI)
+				mutate_nni(MSA, p_current_tree, root, undo); /* local change */
+			else /* global change */
+				scored = propose_regraft(MSA, p_current_tree, root, (kind == REARRANGE_TBR) ? LVB_TRUE : LVB_FALSE,
+										 up_now, move, undo);
+			strcpy(change, rearrangement_name[kind]);
+
+			/* evaluation stops early if the proposed tree is too long to
+			 * be accepted; it is then rejected below as usual, still
+			 * drawing its deviate, so the random number sequence is
+			 * unchanged */
+			ceiling = acceptance_ceiling(tree_minimum_length, current_tree_length, t);
+			if (scored == LVB_TRUE)
+				proposed_tree_length = tbr_length(MSA, p_current_tree, up, root, current_tree_length, move[0], move[1],
+												  move[2], ceiling);
 			else
-			{
-				mutate_nni(MSA, p_proposed_tree, p_current_tree, root); /* local change */
-				strcpy(change, "NNI");
-			}
+				proposed_tree_length = getplen_bounded(MSA, p_current_tree, rcstruct, proposed_tree_root, p_todo_arr,
+													   p_todo_arr_sum_changes, ceiling);
 		}
-
-		proposed_tree_length = getplen(MSA, p_proposed_tree, rcstruct, proposed_tree_root, p_todo_arr, p_todo_arr_sum_changes, p_runs);
 		lvb_assert(proposed_tree_length >= 1L);
 		tree_length_change = proposed_tree_length - current_tree_length;
 		deltah = (tree_minimum_length / (double)current_tree_length) - (tree_minimum_length / (double)proposed_tree_length);
 		if (deltah > 1.0)
-			deltah = 1.0; /* MinimumTreeLength() problem with ambiguous sites */
+			deltah = 1.0; /* min_len_tree too high with ambiguous sites */
 
 		if (tree_length_change <= 0) /* accept the change */
 		{
+			if (scored == LVB_TRUE)
+				make_regraft(MSA, p_current_tree, rcstruct, root, move, proposed_tree_length, undo, p_todo_arr,
+							 p_todo_arr_sum_changes);
+			if (spec != NULL)
+				speculation_accept(MSA, p_current_tree, spec, rcstruct.batch_size, spec_n, &spec_next);
 			if (proposed_tree_length <= best_tree_length) /* store tree if new */
 			{
 				/*printf("%ld\n", *current_iter);*/
-				if (proposed_tree_length < best_tree_length)
+				if (shared != NULL)
 				{
-					ClearTreestack(treestack_ptr); /* discard old bests */
+					/* what counts is whether the tree is new to this chain,
+					 * so that chains do not depend on one another */
+					if (proposed_tree_length < best_tree_length)
+						seen.clear();
+					if (CompareTreeToSharedTreestack(MSA, shared, &seen, p_current_tree, proposed_tree_root,
+													 proposed_tree_length) == 1)
+						accepted++;
 				}
-				if (CompareTreeToTreestack(MSA, treestack_ptr, p_proposed_tree, proposed_tree_root, LVB_FALSE) == 1)
+				else
 				{
-					accepted++;
+					if (proposed_tree_length < best_tree_length)
+					{
+						ClearTreestack(treestack_ptr); /* discard old bests */
+					}
+					if (CompareTreeToTreestack(MSA, treestack_ptr, p_current_tree, proposed_tree_root, LVB_FALSE) == 1)
+					{
+						accepted++;
+					}
 				}
 			}
 			/* update current tree and its stats */
 			current_tree_length = proposed_tree_length;
-			SwapTrees(&p_current_tree, &root, &p_proposed_tree, &proposed_tree_root);
+			undo_commit(undo_now);
+			unchanged = 0;
+			if (up != NULL)
+				up->valid = LVB_FALSE;
 
 			/* very best so far */
 			if (proposed_tree_length < best_tree_length)
@@ -367,7 +937,15 @@ long Anneal(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK *treevo, const TREE
 				pacc = exp_wrapper(-deltah / t);
 				if (uni() < pacc) /* do accept the change */
 				{
-					SwapTrees(&p_current_tree, &root, &p_proposed_tree, &proposed_tree_root);
+					if (scored == LVB_TRUE)
+						make_regraft(MSA, p_current_tree, rcstruct, root, move, proposed_tree_length, undo, p_todo_arr,
+									 p_todo_arr_sum_changes);
+					if (spec != NULL)
+						speculation_accept(MSA, p_current_tree, spec, rcstruct.batch_size, spec_n, &spec_next);
+					undo_commit(undo_now);
+					unchanged = 0;
+					if (up != NULL)
+						up->valid = LVB_FALSE;
 					if (rcstruct.algorithm_selection == 2)
 						w_changes_acc++;
 					current_tree_length = proposed_tree_length;
@@ -375,8 +953,10 @@ long Anneal(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK *treevo, const TREE
 						changeAcc = 1;
 				}
 			}
+			undo_rollback(MSA, undo_now, tree_now); /* unless kept above */
 		}
 		proposed++;
+		unchanged++;
 
 		/* decide whether to reduce temperature */
 		if (accepted >= maxaccept)
@@ -435,6 +1015,8 @@ long Anneal(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK *treevo, const TREE
 			proposed = 0;
 			accepted = 0;
 			dect = LVB_FALSE;
+			if (spec != NULL)
+				speculation_discard(MSA, spec, spec_n, &spec_next); /* made at the old temperature */
 			if (rcstruct.algorithm_selection == 2)
 			{
 				w_changes_prop = 0;
@@ -444,7 +1026,7 @@ long Anneal(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK *treevo, const TREE
 
 		iter++;
 
-		if (rcstruct.n_number_max_trees > 0 && treestack_ptr->next >= rcstruct.n_number_max_trees)
+		if (rcstruct.n_number_max_trees > 0 && stored_trees(treestack_ptr, shared) >= rcstruct.n_number_max_trees)
 		{
 			break;
 		}
@@ -465,19 +1047,427 @@ long Anneal(Dataptr MSA, TREESTACK *treestack_ptr, TREESTACK *treevo, const TREE
 			}
 		}
 		if (rcstruct.verbose == LVB_TRUE)
-			fprintf(pFile, "%ld\t%s\t%d\t%ld\t%lf\t%ld\n", iter, change, changeAcc, current_tree_length, t * 10000, treestack_ptr->next);
+			fprintf(pFile, "%ld\t%s\t%d\t%ld\t%lf\t%ld\n", iter, change, changeAcc, current_tree_length, t * 10000,
+					stored_trees(treestack_ptr, shared));
+
+		/* checkpoint, if one is due, between speculative batches; the
+		 * file is written by another thread, and if it is still busy with
+		 * the last checkpoint, this one is put off */
+		if ((rcstruct.file_name_checkpoint[0] != '\0') && ((spec == NULL) || (spec_next == spec_n))
+			&& ((*current_iter >= checkpoint_iter)
+				|| ((rcstruct.checkpoint_seconds > 0) && (time(NULL) >= checkpoint_time))))
+		{
+			state.t0 = t0;
+			state.current_iter = *current_iter;
+			state.iter = iter;
+			state.root = root;
+			state.current_tree_length = current_tree_length;
+			state.best_tree_length = best_tree_length;
+			state.t = t;
+			state.t_n = t_n;
+			state.failedcnt = failedcnt;
+			state.accepted = accepted;
+			state.proposed = proposed;
+			state.unchanged = unchanged;
+			memcpy(state.trops_counter, trops_counter, sizeof(trops_counter));
+			memcpy(state.trops_probs, trops_probs, sizeof(trops_probs));
+			state.trops_id = trops_id;
+			uni_get(&state.rng);
+			if (checkpoint_save(MSA, rcstruct, &state, p_current_tree, treestack_ptr) == LVB_TRUE)
+			{
+				if (rcstruct.checkpoint_every > 0)
+					checkpoint_iter = *current_iter + rcstruct.checkpoint_every;
+				checkpoint_time = time(NULL) + rcstruct.checkpoint_seconds;
+			}
+		}
 	}
 
 	/* free "local" dynamic heap memory */
+	checkpoint_finish();
 	if (rcstruct.verbose == LVB_TRUE)
 		fclose(pFile);
-	free_memory_to_getplen(&p_todo_arr, &p_todo_arr_sum_changes, &p_runs);
+	free_memory_to_getplen(&p_todo_arr, &p_todo_arr_sum_changes);
 	free(p_current_tree);
-	free(p_proposed_tree);
+	undo_free(undo);
+	if (up != NULL)
+		uppass_free(up);
+	if (spec != NULL)
+	{
+		for (k = 0; k < rcstruct.batch_size; k++)
+		{
+			free(spec[k].tree);
+			undo_free(spec[k].undo);
+			free_memory_to_getplen(&spec[k].p_todo_arr, &spec[k].p_todo_arr_sum_changes);
+		}
+		free(spec);
+	}
 	return best_tree_length;
 
 } /* end Anneal() */
 
+static void start_stream(Parameters rcstruct, long stream)
+/* make this thread's random number generator stream number stream of the
+ * search's generator */
+{
+	Rng first; /* the search's generator, as started */
+	Rng own;   /* stream of this thread */
+
+	rng_init(&first, rcstruct.rng, rcstruct.seed);
+	rng_split(&own, &first, stream);
+	uni_set(&own);
+
+} /* end start_stream() */
+
+typedef struct /* annealing chains run at once by anneal_chains() */
+{
+	Dataptr MSA;
+	Parameters rcstruct;
+	Lvb_bit_length **enc_mat; /* encoded data mat. */
+	double t0;				  /* SA cooling cycle initial temp */
+	long maxaccept;			  /* SA cooling cycle maxaccept */
+	long maxpropose;		  /* SA cooling cycle maxpropose */
+	long maxfail;			  /* SA cooling cycle maxfail */
+	Lvb_bool log_progress;	  /* log progress of the first chain */
+	long *p_iter;			  /* by chain: iterations */
+	Shared_treestack shared;  /* best trees of all chains */
+} Chain_job;
+
+static void anneal_chain(void *arg, int thread)
+/* pool task for anneal_chains(): run chain number thread from a random
+ * tree of its own, with a random number stream of its own */
+{
+	Chain_job *job = (Chain_job *)arg;
+	Dataptr MSA = job->MSA;
+	Parameters rcstruct = job->rcstruct;
+	TREESTACK_TREE_NODES *tree; /* initial tree */
+
+	/* only the first chain writes progress */
+	if (thread > 0)
+		rcstruct.verbose = LVB_FALSE;
+	start_stream(rcstruct, thread);
+
+	/* random trees are made with static scratch space, so one at a time */
+	tree = treealloc(MSA, LVB_TRUE);
+	pthread_mutex_lock(&job->shared.lock);
+	PullRandomTree(MSA, tree);
+	pthread_mutex_unlock(&job->shared.lock);
+	ss_init(MSA, tree, job->enc_mat);
+
+	Anneal(MSA, job->shared.stack, NULL, tree, rcstruct, 0, job->t0, job->maxaccept, job->maxpropose, job->maxfail,
+		   stdout, &job->p_iter[thread], (thread == 0) ? job->log_progress : LVB_FALSE, &job->shared);
+	free(tree);
+
+} /* end anneal_chain() */
+
+static long anneal_chains(Dataptr MSA, TREESTACK *treestack_ptr, Parameters rcstruct, Lvb_bit_length **enc_mat,
+						  const double t0, const long maxaccept, const long maxpropose, const long maxfail,
+						  long *current_iter, Lvb_bool log_progress)
+/* run rcstruct.n_chains annealing chains at once, one per thread, each as
+ * Anneal() with the parameters given, from a random tree and with a random
+ * number stream of its own, all keeping their best trees in *treestack_ptr,
+ * which ends up with every tree of the best length found by any chain;
+ * return that length; *current_iter is increased by the iterations of all
+ * chains */
+{
+	const int n_threads_getplen = MSA->n_threads_getplen;
+	const int getplen_strategy = MSA->getplen_strategy;
+	Chain_job job; /* shared by the threads of the pool */
+	int k;		   /* loop counter */
+
+	job.MSA = MSA;
+	job.rcstruct = rcstruct;
+	job.rcstruct.batch_size = 1; /* the pool is busy with the chains */
+	job.enc_mat = enc_mat;
+	job.t0 = t0;
+	job.maxaccept = maxaccept;
+	job.maxpropose = maxpropose;
+	job.maxfail = maxfail;
+	job.log_progress = log_progress;
+	job.p_iter = (long *)alloc(rcstruct.n_chains * sizeof(long), "iterations by chain");
+	for (k = 0; k < rcstruct.n_chains; k++)
+		job.p_iter[k] = 0;
+	SharedTreestackInit(&job.shared, treestack_ptr);
+
+	/* each chain has a thread of its own, so getplen() has just the one */
+	MSA->n_threads_getplen = 1;
+	MSA->getplen_strategy = GETPLEN_SLICES;
+	pool_create(rcstruct.n_chains);
+	pool_run(anneal_chain, &job);
+	MSA->n_threads_getplen = n_threads_getplen;
+	MSA->getplen_strategy = getplen_strategy;
+	pool_create(n_threads_getplen);
+
+	for (k = 0; k < rcstruct.n_chains; k++)
+		*current_iter += job.p_iter[k];
+	SortSharedTreestack(&job.shared);
+	SharedTreestackFree(&job.shared);
+	free(job.p_iter);
+
+	return job.shared.length;
+
+} /* end anneal_chains() */
+
+typedef struct /* one replica of replica_exchange() */
+{
+	TREESTACK_TREE_NODES *tree;					  /* current configuration */
+	long root;									  /* root of tree */
+	long length;								  /* length of tree */
+	long best_length;							  /* best length found by this replica */
+	int rung;									  /* rung of the temperature ladder it is on */
+	long iter;									  /* proposals made */
+	Undo_log *undo;								  /* record of the proposed change */
+	long *p_todo_arr;							  /* list of "dirty" branch nos */
+	long *p_todo_arr_sum_changes;				  /* scratch for getplen() */
+	Fingerprint_set *seen;						  /* best trees of this replica */
+} Replica;
+
+typedef struct /* replicas run at once by replica_exchange() */
+{
+	Dataptr MSA;
+	Parameters rcstruct;
+	Lvb_bit_length **enc_mat; /* encoded data mat. */
+	const double *t;		  /* by rung: temperature */
+	Replica *replica;		  /* by thread: replica */
+	Shared_treestack shared;  /* best trees of all replicas */
+} Replica_job;
+
+static void replica_start(void *arg, int thread)
+/* pool task for replica_exchange(): set up the replica of this thread,
+ * from a random tree and with a random number stream of its own */
+{
+	Replica_job *job = (Replica_job *)arg;
+	Dataptr MSA = job->MSA;
+	Replica *r = &job->replica[thread];
+
+	start_stream(job->rcstruct, thread);
+	r->tree = treealloc(MSA, LVB_TRUE);
+	r->undo = undo_alloc(MSA);
+	r->seen = new Fingerprint_set;
+	alloc_memory_to_getplen(MSA, &r->p_todo_arr, &r->p_todo_arr_sum_changes);
+
+	/* random trees are made with static scratch space, so one at a time */
+	pthread_mutex_lock(&job->shared.lock);
+	PullRandomTree(MSA, r->tree);
+	pthread_mutex_unlock(&job->shared.lock);
+	ss_init(MSA, r->tree, job->enc_mat);
+	r->root = 0;
+	r->length = getplen(MSA, r->tree, job->rcstruct, r->root, r->p_todo_arr, r->p_todo_arr_sum_changes);
+	r->best_length = r->length;
+	r->rung = thread;
+	r->iter = 0;
+	CompareTreeToSharedTreestack(MSA, &job->shared, r->seen, r->tree, r->root, r->length);
+
+} /* end replica_start() */
+
+static void replica_steps(void *arg, int thread)
+/* pool task for replica_exchange(): make REPLICA_SWAP_INTERVAL proposals
+ * to the replica of this thread at the temperature of its rung, accepting
+ * or rejecting them as Anneal() does; proposals alternate between NNI and
+ * SPR for algorithm 0, and are otherwise NNI, SPR or TBR with equal
+ * probability */
+{
+	Replica_job *job = (Replica_job *)arg;
+	Dataptr MSA = job->MSA;
+	Replica *r = &job->replica[thread];
+	const double t = job->t[r->rung];						   /* temperature */
+	const double tree_minimum_length = (double)MSA->min_len_tree; /* minimum length for any tree */
+	const double log_wrapper_LVB_EPS = log_wrapper(LVB_EPS);
+	double deltah;		 /* change in energy (1 - C.I.) */
+	double random_val;	 /* deviate choosing the rearrangement */
+	long proposed;		 /* length of proposed new tree */
+	long ceiling;		 /* length above which proposal is rejected */
+	Lvb_bool accept;	 /* keep the proposal */
+	long i;				 /* loop counter */
+
+	for (i = 0; i < REPLICA_SWAP_INTERVAL; i++)
+	{
+		r->iter++;
+		/* occasionally re-root, to prevent influence from root position */
+		if ((r->iter % REROOT_INTERVAL) == 0)
+		{
+			r->root = arbreroot(MSA, r->tree, r->root);
+			proposed = getplen(MSA, r->tree, job->rcstruct, r->root, r->p_todo_arr, r->p_todo_arr_sum_changes);
+			lvb_assert(proposed == r->length);
+		}
+
+		undo_begin(r->undo);
+		if (job->rcstruct.algorithm_selection == 0)
+		{
+			if (r->iter & 0x01)
+				mutate_spr(MSA, r->tree, r->root, r->undo);
+			else
+				mutate_nni(MSA, r->tree, r->root, r->undo);
+		}
+		else
+		{
+			random_val = uni();
+			if (random_val < 1.0 / 3.0)
+				mutate_nni(MSA, r->tree, r->root, r->undo);
+			else if (random_val < 2.0 / 3.0)
+				mutate_spr(MSA, r->tree, r->root, r->undo);
+			else
+				mutate_tbr(MSA, r->tree, r->root, r->undo);
+		}
+
+		ceiling = acceptance_ceiling(tree_minimum_length, r->length, t);
+		proposed = getplen_bounded(MSA, r->tree, job->rcstruct, r->root, r->p_todo_arr, r->p_todo_arr_sum_changes,
+								   ceiling);
+		lvb_assert(proposed >= 1L);
+		deltah = (tree_minimum_length / (double)r->length) - (tree_minimum_length / (double)proposed);
+		if (deltah > 1.0)
+			deltah = 1.0; /* min_len_tree too high with ambiguous sites */
+
+		if (proposed <= r->length)
+			accept = LVB_TRUE;
+		else if (-deltah < t * log_wrapper_LVB_EPS)
+		{
+			(void)uni(); /* as in Anneal() */
+			accept = LVB_FALSE;
+		}
+		else
+			accept = (uni() < exp_wrapper(-deltah / t)) ? LVB_TRUE : LVB_FALSE;
+
+		if (accept == LVB_TRUE)
+		{
+			undo_commit(r->undo);
+			r->length = proposed;
+			if (proposed <= r->best_length)
+			{
+				if (proposed < r->best_length)
+				{
+					r->seen->clear();
+					r->best_length = proposed;
+				}
+				CompareTreeToSharedTreestack(MSA, &job->shared, r->seen, r->tree, r->root, proposed);
+			}
+		}
+		else
+			undo_rollback(MSA, r->undo, r->tree);
+	}
+
+} /* end replica_steps() */
+
+static long replica_exchange(Dataptr MSA, TREESTACK *treestack_ptr, Parameters rcstruct, Lvb_bit_length **enc_mat,
+							 const double t0, long *current_iter, Lvb_bool log_progress)
+/* search by replica exchange: run rcstruct.n_replicas replicas at once,
+ * one per thread, each at a fixed temperature on a geometric ladder from
+ * t0 down to REPLICA_COLDEST_T, and after every REPLICA_SWAP_INTERVAL
+ * proposals to each, offer to swap the configurations on neighbouring
+ * rungs by the Metropolis criterion on the energy used by Anneal(); stop
+ * once REPLICA_MAXFAIL exchanges in a row have not found a shorter tree;
+ * all keep their best trees in *treestack_ptr, which ends up with every
+ * tree of the best length found by any; return that length;
+ * *current_iter is increased by the proposals to all replicas */
+{
+	const int n_replicas = rcstruct.n_replicas;
+	const int n_threads_getplen = MSA->n_threads_getplen;
+	const int getplen_strategy = MSA->getplen_strategy;
+	const double t_coldest = (t0 > REPLICA_COLDEST_T) ? REPLICA_COLDEST_T : t0;
+	const double tree_minimum_length = (double)MSA->min_len_tree;
+	const double log_wrapper_LVB_EPS = log_wrapper(LVB_EPS);
+	Replica_job job;			/* shared by the threads of the pool */
+	double *t;					/* by rung: temperature */
+	int *on_rung;				/* by rung: replica on it */
+	double e_hot, e_cold;		/* energies of replicas on neighbouring rungs */
+	double delta;				/* log of probability of swapping them */
+	long best_length = LONG_MAX; /* best length found so far */
+	long failedcnt = 0;			/* exchanges without a shorter tree */
+	long rounds = 0;			/* exchanges made */
+	long swaps_proposed = 0;	/* swaps offered */
+	long swaps_accepted = 0;	/* swaps made */
+	int k, hot, cold;			/* rung numbers */
+
+	t = (double *)alloc(n_replicas * sizeof(double), "replica temperatures");
+	on_rung = (int *)alloc(n_replicas * sizeof(int), "replicas by rung");
+	for (k = 0; k < n_replicas; k++)
+	{
+		t[k] = t0 * pow_wrapper(t_coldest / t0, (double)k / (double)(n_replicas - 1));
+		on_rung[k] = k;
+	}
+	job.MSA = MSA;
+	job.rcstruct = rcstruct;
+	job.enc_mat = enc_mat;
+	job.t = t;
+	job.replica = (Replica *)alloc(n_replicas * sizeof(Replica), "replicas");
+	SharedTreestackInit(&job.shared, treestack_ptr);
+
+	if (log_progress == LVB_TRUE)
+	{
+		printf("\n--------------------------------------------------------");
+		printf("\n  Temperature:   Rearrangement: TreeStack size: Length:\n");
+		printf("--------------------------------------------------------\n");
+	}
+
+	/* each replica has a thread of its own, so getplen() has just the one */
+	MSA->n_threads_getplen = 1;
+	MSA->getplen_strategy = GETPLEN_SLICES;
+	pool_create(n_replicas);
+	pool_run(replica_start, &job);
+	while (failedcnt < REPLICA_MAXFAIL)
+	{
+		pool_run(replica_steps, &job);
+		rounds++;
+		*current_iter += n_replicas * REPLICA_SWAP_INTERVAL;
+
+		/* swap neighbouring rungs, taking odd and even pairs in turn */
+		for (hot = (int)(rounds & 0x01); hot + 1 < n_replicas; hot += 2)
+		{
+			cold = hot + 1;
+			e_hot = 1.0 - tree_minimum_length / (double)job.replica[on_rung[hot]].length;
+			e_cold = 1.0 - tree_minimum_length / (double)job.replica[on_rung[cold]].length;
+			delta = (1.0 / t[cold] - 1.0 / t[hot]) * (e_cold - e_hot);
+			swaps_proposed++;
+			if ((delta >= 0.0) || ((delta > log_wrapper_LVB_EPS) && (uni() < exp_wrapper(delta))))
+			{
+				k = on_rung[hot];
+				on_rung[hot] = on_rung[cold];
+				on_rung[cold] = k;
+				job.replica[on_rung[hot]].rung = hot;
+				job.replica[on_rung[cold]].rung = cold;
+				swaps_accepted++;
+			}
+		}
+
+		/* no thread is using the shared stack now */
+		if (job.shared.length < best_length)
+		{
+			best_length = job.shared.length;
+			failedcnt = 0;
+		}
+		else
+			failedcnt++;
+		if ((log_progress == LVB_TRUE) && ((rounds * REPLICA_SWAP_INTERVAL) % STAT_LOG_INTERVAL == 0))
+			lenlog(stdout, job.shared.stack->next, *current_iter, job.replica[on_rung[n_replicas - 1]].length,
+				   t[n_replicas - 1]);
+		if ((rcstruct.n_number_max_trees > 0) && (job.shared.stack->next >= rcstruct.n_number_max_trees))
+			break;
+	}
+	MSA->n_threads_getplen = n_threads_getplen;
+	MSA->getplen_strategy = getplen_strategy;
+	pool_create(n_threads_getplen);
+
+	if (log_progress == LVB_TRUE)
+		printf("\nReplica exchange: %d replicas, %ld exchanges, %ld of %ld swaps made\n", n_replicas, rounds,
+			   swaps_accepted, swaps_proposed);
+
+	/* free "local" dynamic heap memory */
+	for (k = 0; k < n_replicas; k++)
+	{
+		free(job.replica[k].tree);
+		undo_free(job.replica[k].undo);
+		delete job.replica[k].seen;
+		free_memory_to_getplen(&job.replica[k].p_todo_arr, &job.replica[k].p_todo_arr_sum_changes);
+	}
+	free(job.replica);
+	SortSharedTreestack(&job.shared);
+	SharedTreestackFree(&job.shared);
+	free(on_rung);
+	free(t);
+
+	return best_length;
+
+} /* end replica_exchange() */
+
 long GetSoln(Dataptr restrict MSA, Parameters rcstruct, long *iter_p, Lvb_bool log_progress)
 /* get and output solution(s) according to parameters in rcstruct;
  * return length of shortest tree(s) found */
@@ -498,7 +1488,6 @@ long GetSoln(Dataptr restrict MSA, Parameters rcstruct, long *iter_p, Lvb_bool l
 	Lvb_bit_length **enc_mat;		   /* encoded data mat. */
 	long *p_todo_arr;				   /* [MAX_BRANCHES + 1];	 list of "dirty" branch nos */
 	long *p_todo_arr_sum_changes;	   /*used in openMP, to sum the partial changes */
-	int *p_runs;					   /*used in openMP, 0 if not run yet, 1 if it was processed */
 
 	/* NOTE: These variables and their values are "dummies" and are no longer
 	 * used in the current version of LVB. However, in order to keep the
@@ -514,9 +1503,17 @@ long GetSoln(Dataptr restrict MSA, Parameters rcstruct, long *iter_p, Lvb_bool l
 	/* Allocation of the initial encoded MSA is non-contiguous because
 	 * this MSA isn't used much, so any performance penalty won't matter. */
 	enc_mat = (Lvb_bit_length **)malloc((MSA->n) * sizeof(Lvb_bit_length *));
-	for (i = 0; i < MSA->n; i++)
-		enc_mat[i] = (Lvb_bit_length *)alloc(MSA->bytes, "state sets");
-	DNAToBinary(MSA, enc_mat);
+	if (MSA->enc_rows != NULL) /* already encoded, in a cache or shared segment, and only read */
+	{
+		for (i = 0; i < MSA->n; i++)
+			enc_mat[i] = (Lvb_bit_length *)(MSA->enc_rows + i * MSA->nwords);
+	}
+	else
+	{
+		for (i = 0; i < MSA->n; i++)
+			enc_mat[i] = (Lvb_bit_length *)alloc(MSA->bytes, "state sets");
+		DNAToBinary(MSA, enc_mat, rcstruct.n_processors_available);
+	}
 
 	/* open and entitle statistics file shared by all cycles
 	 * NOTE: There are no cycles anymore in the current version
@@ -555,21 +1552,43 @@ long GetSoln(Dataptr restrict MSA, Parameters rcstruct, long *iter_p, Lvb_bool l
 
 	if (rcstruct.verbose == LVB_TRUE)
 	{
-		alloc_memory_to_getplen(MSA, &p_todo_arr, &p_todo_arr_sum_changes, &p_runs);
-		fprintf(sumfp, "%ld\t%ld\t%ld\t", start, cyc, getplen(MSA, tree, rcstruct, initroot, p_todo_arr, p_todo_arr_sum_changes, p_runs));
-		free_memory_to_getplen(&p_todo_arr, &p_todo_arr_sum_changes, &p_runs);
+		alloc_memory_to_getplen(MSA, &p_todo_arr, &p_todo_arr_sum_changes);
+		fprintf(sumfp, "%ld\t%ld\t%ld\t", start, cyc, getplen(MSA, tree, rcstruct, initroot, p_todo_arr, p_todo_arr_sum_changes));
+		free_memory_to_getplen(&p_todo_arr, &p_todo_arr_sum_changes);
 		PrintInitialTree(MSA, tree, start, cyc, initroot);
 	}
 
 	/* find solution(s) */
-	treelength = Anneal(MSA, &treestack, &stack_treevo, tree, rcstruct, initroot, t0, maxaccept,
-						maxpropose, maxfail, stdout, iter_p, log_progress);
+	if (rcstruct.n_replicas > 1)
+		treelength = replica_exchange(MSA, &treestack, rcstruct, enc_mat, t0, iter_p, log_progress);
+	else if (rcstruct.n_chains > 1)
+		treelength = anneal_chains(MSA, &treestack, rcstruct, enc_mat, t0, maxaccept, maxpropose, maxfail, iter_p,
+								   log_progress);
+	else if (rcstruct.batch_size > 1)
+	{
+		/* the pool scores a batch of proposals at once, each in one thread */
+		const int n_threads_getplen = MSA->n_threads_getplen;
+		const int getplen_strategy = MSA->getplen_strategy;
+		MSA->n_threads_getplen = 1;
+		MSA->getplen_strategy = GETPLEN_SLICES;
+		pool_create(rcstruct.batch_size);
+		treelength = Anneal(MSA, &treestack, &stack_treevo, tree, rcstruct, initroot, t0, maxaccept,
+							maxpropose, maxfail, stdout, iter_p, log_progress, NULL);
+		MSA->n_threads_getplen = n_threads_getplen;
+		MSA->getplen_strategy = getplen_strategy;
+		pool_create(n_threads_getplen);
+	}
+	else
+		treelength = Anneal(MSA, &treestack, &stack_treevo, tree, rcstruct, initroot, t0, maxaccept,
+							maxpropose, maxfail, stdout, iter_p, log_progress, NULL);
 	PullTreefromTreestack(MSA, tree, &initroot, &treestack, LVB_FALSE);
 
-	CompareHashTreeToHashstack(MSA, &treestack, tree, initroot, LVB_FALSE);
+	CompareTreeToTreestack(MSA, &treestack, tree, initroot, LVB_FALSE);
 
 	/* treelength = deterministic_hillclimb(MSA, &treestack, tree, rcstruct, initroot, stdout,
 				iter_p, log_progress); */
+	if (rcstruct.hillclimb != HILLCLIMB_NONE)
+		treelength = regraft_hillclimb(MSA, &treestack, tree, rcstruct, initroot, iter_p, log_progress);
 
 	/* log this cycle's solution and its details
 	 * NOTE: There are no cycles anymore in the current version
@@ -600,8 +1619,11 @@ long GetSoln(Dataptr restrict MSA, Parameters rcstruct, long *iter_p, Lvb_bool l
 		clnclose(sumfp, SUMFNAM);
 	/* "local" dynamic heap memory */
 	free(tree);
-	for (i = 0; i < MSA->n; i++)
-		free(enc_mat[i]);
+	if (MSA->enc_rows == NULL)
+	{
+		for (i = 0; i < MSA->n; i++)
+			free(enc_mat[i]);
+	}
 	free(enc_mat);
 
 	return treelength;
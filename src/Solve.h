@@ -53,6 +53,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "LVB.h"
 #include "Print.h"
 #include "Verbose.h"
+#include "Checkpoint.h"
+#include "WorkerPool.h"
 
 static TREESTACK treestack; /* overall best tree stack */
 static TREESTACK stack_treevo;
@@ -74,8 +74,8 @@ double StartingTemperature(Dataptr MSA, const TREESTACK_TREE_NODES *const inittr
 	double tree_minimum_length;	 /* minimum length for any tree */
 	long proposed_tree_root;	 /* root of new configuration */
 	double t = LVB_EPS;			 /* current temperature */
-	TREESTACK_TREE_NODES *x;	 /* current configuration */
-	TREESTACK_TREE_NODES *xdash; /* proposed new configuration */
+	TREESTACK_TREE_NODES *x;	 /* current configuration, changed in place */
+	Undo_log *undo;				 /* record of the proposed change */
 
 	/* Variables specific to the StartingTemperatureemperature() procedure*/
 	int acc_pos_trans = 0;			 /* Number of accepted positve transitions */
@@ -85,19 +85,18 @@ double StartingTemperature(Dataptr MSA, const TREESTACK_TREE_NODES *const inittr
 	int sample_size = 100;			 /* Sample size used to estimate the ratio */
 	long *p_todo_arr;				 /* [MAX_BRANCHES + 1];	 list of "dirty" branch nos */
 	long *p_todo_arr_sum_changes;	 /*used in openMP, to sum the partial changes */
-	int *p_runs;					 /*used in openMP, 0 if not run yet, 1 if it was processed */
 	const double log_wrapper_LVB_EPS = log_wrapper(LVB_EPS);
 
 	/* Create "local" dynamic heap memory and initialise tree
 	 * structures like in Anneal() */
 	x = treealloc(MSA, LVB_TRUE);
-	xdash = treealloc(MSA, LVB_TRUE);
+	undo = undo_alloc(MSA);
 
 	treecopy(MSA, x, inittree, LVB_TRUE); /* current configuration */
-	alloc_memory_to_getplen(MSA, &p_todo_arr, &p_todo_arr_sum_changes, &p_runs);
-	current_tree_length = getplen(MSA, x, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes, p_runs);
+	alloc_memory_to_getplen(MSA, &p_todo_arr, &p_todo_arr_sum_changes);
+	current_tree_length = getplen(MSA, x, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes);
 
-	lenmin = MinimumTreeLength(MSA);
+	lenmin = MSA->min_len_tree;
 	tree_minimum_length = (double)lenmin;
 
 	/* Log progress to standard output if chosen*/
@@ -114,23 +113,29 @@ double StartingTemperature(Dataptr MSA, const TREESTACK_TREE_NODES *const inittr
 
 			/* occasionally re-root, to prevent influence from root position */
 			if ((iter % REROOT_INTERVAL) == 0)
+			{
 				root = arbreroot(MSA, x, root);
+				proposed_tree_length = getplen(MSA, x, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes);
+				lvb_assert(proposed_tree_length == current_tree_length);
+			}
 
 			lvb_assert(t > DBL_EPSILON);
 
 			/* mutation: alternate between the two mutation functions */
 			proposed_tree_root = root;
+			undo_begin(undo);
 			if (iter & 0x01)
-				mutate_spr(MSA, xdash, x, root); /* global change */
+				mutate_spr(MSA, x, root, undo); /* global change */
 			else
-				mutate_nni(MSA, xdash, x, root); /* local change */
+				mutate_nni(MSA, x, root, undo); /* local change */
 
-			proposed_tree_length = getplen(MSA, xdash, rcstruct, proposed_tree_root, p_todo_arr, p_todo_arr_sum_changes, p_runs);
+			proposed_tree_length = getplen_bounded(MSA, x, rcstruct, proposed_tree_root, p_todo_arr, p_todo_arr_sum_changes,
+												   acceptance_ceiling(tree_minimum_length, current_tree_length, t));
 			lvb_assert(proposed_tree_length >= 1L);
 			tree_length_change = proposed_tree_length - current_tree_length;
 			deltah = (tree_minimum_length / (double)current_tree_length) - (tree_minimum_length / (double)proposed_tree_length);
 
-			if (deltah > 1.0) /* MinimumTreeLength() problem with ambiguous sites */
+			if (deltah > 1.0) /* min_len_tree too high with ambiguous sites */
 				deltah = 1.0;
 
 			/* Check whether the change is accepted (Again adopted from Anneal()*/
@@ -138,7 +143,7 @@ double StartingTemperature(Dataptr MSA, const TREESTACK_TREE_NODES *const inittr
 			{
 				/* update current tree and its stats */
 				current_tree_length = proposed_tree_length;
-				SwapTrees(&x, &root, &xdash, &proposed_tree_root);
+				undo_commit(undo);
 			}
 			else
 			{
@@ -159,10 +164,11 @@ double StartingTemperature(Dataptr MSA, const TREESTACK_TREE_NODES *const inittr
 					if (uni() < pacc) /* do accept the change */
 					{
 						current_tree_length = proposed_tree_length;
-						SwapTrees(&x, &root, &xdash, &proposed_tree_root);
+						undo_commit(undo);
 						acc_pos_trans++; /* The change has been accepted */
 					}
 				}
+				undo_rollback(MSA, undo, x); /* unless kept above */
 			}
 		}
 
@@ -181,9 +187,9 @@ double StartingTemperature(Dataptr MSA, const TREESTACK_TREE_NODES *const inittr
 	}
 
 	/* free "local" dynamic heap memory */
-	free_memory_to_getplen(&p_todo_arr, &p_todo_arr_sum_changes, &p_runs);
+	free_memory_to_getplen(&p_todo_arr, &p_todo_arr_sum_changes);
 	free(x);
-	free(xdash);
+	undo_free(undo);
 
 	/* Log progress if chosen*/
 	if (log_progress)
@@ -46,131 +46,419 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "TreeEvaluation.h"
 
+static inline Lvb_bool is_dirty(Dataptr restrict MSA, const TREESTACK_TREE_NODES *BranchArray, long branch)
+/* return LVB_TRUE if branch is an internal branch whose statesets and
+ * changes are not known, LVB_FALSE otherwise */
+{
+	return (branch >= MSA->n && BranchArray[branch].sitestate[0] == 0U) ? LVB_TRUE : LVB_FALSE;
+
+} /* end is_dirty() */
+
+static inline long subtree_changes(Dataptr restrict MSA, const TREESTACK_TREE_NODES *BranchArray, long branch)
+/* return changes for branch branch and everything below it, which must be
+ * already known */
+{
+	return branch < MSA->n ? 0 : BranchArray[branch].sum_changes;
+
+} /* end subtree_changes() */
+
+static long weighted_pair(Dataptr restrict MSA, const Lvb_bit_length *l, const Lvb_bit_length *r,
+						  Lvb_bit_length *dest, const long start, const long end, const long limit)
+/* Fitch step over words start to end - 1 of the statesets l and r, writing
+ * the result to dest; return the changes, counting each column as many times
+ * as its weight, or stop early and return the changes so far once they
+ * exceed limit */
+{
+	long changes = 0; /* changes so far */
+	long b;			  /* current block */
+	long from;		  /* first word of block in range */
+	long to;		  /* end of block in range */
+
+	for (b = 0; b < MSA->n_blocks; b++)
+	{
+		from = start > MSA->block_word[b] ? start : MSA->block_word[b];
+		to = end < MSA->block_word[b + 1] ? end : MSA->block_word[b + 1];
+		if (from >= to)
+			continue;
+		changes += MSA->block_weight[b] * fitch_pair_bounded(l + from, r + from, dest + from, to - from,
+															 limit == LONG_MAX ? LONG_MAX : (limit - changes) / MSA->block_weight[b]);
+		if (changes > limit)
+			break;
+	}
+	return changes;
+
+} /* end weighted_pair() */
+
+static long weighted_root(Dataptr restrict MSA, const Lvb_bit_length *l, const Lvb_bit_length *r,
+						  const Lvb_bit_length *rootset, const long start, const long end, const long limit)
+/* as weighted_pair(), but for the root, as fitch_root_bounded() */
+{
+	long changes = 0; /* changes so far */
+	long b;			  /* current block */
+	long from;		  /* first word of block in range */
+	long to;		  /* end of block in range */
+
+	for (b = 0; b < MSA->n_blocks; b++)
+	{
+		from = start > MSA->block_word[b] ? start : MSA->block_word[b];
+		to = end < MSA->block_word[b + 1] ? end : MSA->block_word[b + 1];
+		if (from >= to)
+			continue;
+		changes += MSA->block_weight[b] * fitch_root_bounded(l + from, r + from, rootset + from, to - from,
+															 limit == LONG_MAX ? LONG_MAX : (limit - changes) / MSA->block_weight[b]);
+		if (changes > limit)
+			break;
+	}
+	return changes;
+
+} /* end weighted_root() */
+
+static long dirty_postorder(Dataptr restrict MSA, const TREESTACK_TREE_NODES *BranchArray, const long root,
+							long *restrict p_todo_arr)
+/* fill p_todo_arr with the "dirty" branches of the tree in BranchArray in
+ * post-order, so that every branch comes after both its children, and return
+ * their number; since rearrangements mark branches dirty all the way up to
+ * the root, the walk only descends through dirty branches and never looks
+ * inside clean subtrees; the walk uses parent links instead of a stack */
+{
+	long current = root;   /* current branch */
+	long previous = UNSET; /* branch visited before current */
+	long next;			   /* branch to visit after current */
+	long left;			   /* left child of current */
+	long right;			   /* right child of current */
+	long number_of_internal_branches = 0;
+
+	do
+	{
+		left = BranchArray[current].left;
+		right = BranchArray[current].right;
+		if (previous == BranchArray[current].parent && is_dirty(MSA, BranchArray, left))
+			next = left; /* arrived from above, go down on the left */
+		else if (previous != right && is_dirty(MSA, BranchArray, right))
+			next = right; /* left side done or clean, go down on the right */
+		else
+		{ /* both sides done or clean, so current is ready */
+			if (current != root)
+				*(p_todo_arr + number_of_internal_branches++) = current;
+			next = BranchArray[current].parent;
+		}
+		previous = current;
+		current = next;
+	} while (current != UNSET);
+
+	return number_of_internal_branches;
+
+} /* end dirty_postorder() */
+
+static long clean_below(Dataptr restrict MSA, const TREESTACK_TREE_NODES *BranchArray, const long root,
+						const long *restrict p_todo_arr, long number_of_internal_branches)
+/* return changes in the clean subtrees hanging from the root and from the
+ * "dirty" branches listed in p_todo_arr, which are already known */
+{
+	long changes = 0; /* changes below clean children */
+	long i;			  /* loop counter */
+	long branch;	  /* current branch number */
+
+	for (i = 0; i <= number_of_internal_branches; i++)
+	{
+		branch = (i < number_of_internal_branches) ? *(p_todo_arr + i) : root;
+		if (is_dirty(MSA, BranchArray, BranchArray[branch].left) == LVB_FALSE)
+			changes += subtree_changes(MSA, BranchArray, BranchArray[branch].left);
+		if (is_dirty(MSA, BranchArray, BranchArray[branch].right) == LVB_FALSE)
+			changes += subtree_changes(MSA, BranchArray, BranchArray[branch].right);
+	}
+	return changes;
+
+} /* end clean_below() */
+
+typedef struct /* one evaluation shared by the threads of the pool */
+{
+	Dataptr MSA;
+	TREESTACK_TREE_NODES *BranchArray;
+	long root;
+	const long *p_todo_arr;		  /* dirty branches, children first */
+	long *p_todo_arr_sum_changes; /* changes of each branch and thread */
+	long *p_partial;			  /* running changes of each thread */
+	long number_of_internal_branches;
+	long known;		 /* changes already known */
+	long ceiling;	 /* give up once the length must be greater */
+	Lvb_bool bounded;
+	int aborted;	 /* set once the ceiling is passed */
+} Slice_job;
+
+static void getplen_slice(void *arg, int thread)
+/* pool task for getplen_bounded(): do this thread's slice of words of
+ * every branch listed in the job, in post-order, so the slices it depends
+ * on are always its own and already done */
+{
+	Slice_job *job = (Slice_job *)arg;
+	Dataptr restrict MSA = job->MSA;
+	TREESTACK_TREE_NODES *BranchArray = job->BranchArray;
+	const int n_threads = MSA->n_threads_getplen;
+	long l_start = MSA->n_slice_size_getplen * thread; /* first word of this thread's slice */
+	long l_end = MSA->n_slice_size_getplen * (thread + 1);
+	long mine = 0;		   /* changes found by this thread */
+	long others = 0;	   /* changes found by other threads, as last seen */
+	long limit = LONG_MAX; /* changes allowed in this slice */
+	long n_changes_temp;   /* changes in this slice of current branch */
+	long branch;		   /* current branch number */
+	long left;			   /* current left child number */
+	long right;			   /* current right child number */
+	long i;				   /* loop counter */
+	int k;				   /* loop counter */
+
+	if (thread >= n_threads)
+		return; /* the pool is larger for other work */
+	if (n_threads == thread + 1)
+		l_end += MSA->nwords - (MSA->n_slice_size_getplen * n_threads);
+
+	for (i = 0; i <= job->number_of_internal_branches; i++)
+	{
+		if (job->bounded == LVB_TRUE)
+		{
+			if (__atomic_load_n(&job->aborted, __ATOMIC_RELAXED))
+				break;
+			others = 0;
+			for (k = 0; k < n_threads; k++)
+			{
+				if (k != thread)
+					others += __atomic_load_n(&job->p_partial[k], __ATOMIC_RELAXED);
+			}
+			limit = job->ceiling - job->known - others - mine;
+		}
+
+		if (i < job->number_of_internal_branches)
+		{
+			branch = job->p_todo_arr[i];
+			left = BranchArray[branch].left;
+			right = BranchArray[branch].right;
+			n_changes_temp = weighted_pair(MSA, BranchArray[left].sitestate, BranchArray[right].sitestate,
+										   BranchArray[branch].sitestate, l_start, l_end, limit);
+		}
+		else
+		{ /* count the changes to the root one */
+			left = BranchArray[job->root].left;
+			right = BranchArray[job->root].right;
+			n_changes_temp = weighted_root(MSA, BranchArray[left].sitestate, BranchArray[right].sitestate,
+										   BranchArray[job->root].sitestate, l_start, l_end, limit);
+		}
+		job->p_todo_arr_sum_changes[i * n_threads + thread] = n_changes_temp;
+
+		if (job->bounded == LVB_TRUE)
+		{
+			mine += n_changes_temp;
+			__atomic_store_n(&job->p_partial[thread], mine, __ATOMIC_RELAXED);
+			if (job->known + others + mine > job->ceiling)
+			{
+				__atomic_store_n(&job->aborted, 1, __ATOMIC_RELAXED);
+				break;
+			}
+		}
+	}
+
+} /* end getplen_slice() */
+
+typedef struct /* one evaluation by subtree tasks, shared by the pool */
+{
+	Dataptr MSA;
+	TREESTACK_TREE_NODES *BranchArray;
+	long root;
+	long *p_waiting;  /* dirty children not yet done, by branch */
+	long *p_queue;	  /* branches ready to do, or UNSET while a slot is empty */
+	long n_branches;  /* dirty branches in all */
+	long next_slot;	  /* next slot of p_queue to take */
+	long free_slot;	  /* next slot of p_queue to fill */
+	long done;		  /* changes on the branches done */
+	long known;		  /* changes already known */
+	long ceiling;	  /* give up once the length must be greater */
+	int aborted;	  /* set once the ceiling is passed */
+} Subtree_job;
+
+static void getplen_subtrees(void *arg, int thread)
+/* pool task for getplen_bounded(): take ready branches off the shared
+ * queue and do each one in full; a branch is queued by whichever thread
+ * finishes its last dirty child, so subtrees that do not depend on each
+ * other are done at the same time */
+{
+	Subtree_job *job = (Subtree_job *)arg;
+	Dataptr restrict MSA = job->MSA;
+	TREESTACK_TREE_NODES *BranchArray = job->BranchArray;
+	long slot;	  /* slot of p_queue taken */
+	long branch;  /* current branch number */
+	long left;	  /* current left child number */
+	long right;	  /* current right child number */
+	long parent;  /* parent of current branch */
+	long changes; /* changes on current branch */
+	long round;	  /* rounds spent waiting for a branch */
+
+	(void)thread; /* any thread may do any branch */
+	for (;;)
+	{
+		slot = __atomic_fetch_add(&job->next_slot, 1, __ATOMIC_RELAXED);
+		if (slot >= job->n_branches)
+			break;
+		round = 0;
+		while ((branch = __atomic_load_n(&job->p_queue[slot], __ATOMIC_ACQUIRE)) == UNSET)
+		{
+			if (__atomic_load_n(&job->aborted, __ATOMIC_RELAXED))
+				return;
+			pool_pause(round++);
+		}
+
+		left = BranchArray[branch].left;
+		right = BranchArray[branch].right;
+		changes = weighted_pair(MSA, BranchArray[left].sitestate, BranchArray[right].sitestate,
+								BranchArray[branch].sitestate, 0, MSA->nwords, LONG_MAX);
+		BranchArray[branch].changes = changes;
+		BranchArray[branch].sum_changes = changes + subtree_changes(MSA, BranchArray, left) +
+										  subtree_changes(MSA, BranchArray, right);
+
+		if (job->known + __atomic_add_fetch(&job->done, changes, __ATOMIC_RELAXED) > job->ceiling)
+		{
+			__atomic_store_n(&job->aborted, 1, __ATOMIC_RELAXED);
+			return;
+		}
+
+		parent = BranchArray[branch].parent;
+		if (parent != job->root && __atomic_sub_fetch(&job->p_waiting[parent], 1, __ATOMIC_ACQ_REL) == 0)
+		{
+			slot = __atomic_fetch_add(&job->free_slot, 1, __ATOMIC_RELAXED);
+			__atomic_store_n(&job->p_queue[slot], parent, __ATOMIC_RELEASE);
+		}
+	}
+
+} /* end getplen_subtrees() */
+
+static long subtree_tasks(Dataptr restrict MSA, TREESTACK_TREE_NODES *BranchArray, const long root,
+						  const long *restrict p_todo_arr, long *p_todo_arr_sum_changes,
+						  const long number_of_internal_branches, const long known, const long ceiling)
+/* do the "dirty" branches listed in p_todo_arr with subtree tasks on the
+ * pool and return the changes on them; if these take the length past
+ * ceiling, the work may be abandoned early, returning the changes on the
+ * branches done and leaving the others "dirty" */
+{
+	Subtree_job job; /* shared by the threads of the pool */
+	long branch;	 /* current branch number */
+	long i;			 /* loop counter */
+
+	job.MSA = MSA;
+	job.BranchArray = BranchArray;
+	job.root = root;
+	job.p_waiting = p_todo_arr_sum_changes;
+	job.p_queue = p_todo_arr_sum_changes + MSA->numberofpossiblebranches;
+	job.n_branches = number_of_internal_branches;
+	job.next_slot = 0;
+	job.free_slot = 0;
+	job.done = 0;
+	job.known = known;
+	job.ceiling = ceiling;
+	job.aborted = 0;
+
+	/* the parent of a dirty branch is dirty too, or is the root */
+	for (i = 0; i < number_of_internal_branches; i++)
+		job.p_waiting[p_todo_arr[i]] = 0;
+	for (i = 0; i < number_of_internal_branches; i++)
+	{
+		branch = p_todo_arr[i];
+		if (BranchArray[branch].parent != root)
+			job.p_waiting[BranchArray[branch].parent]++;
+		job.p_queue[i] = UNSET;
+	}
+	for (i = 0; i < number_of_internal_branches; i++)
+	{
+		if (job.p_waiting[p_todo_arr[i]] == 0)
+			job.p_queue[job.free_slot++] = p_todo_arr[i];
+	}
+
+	pool_run(getplen_subtrees, &job);
+
+	if (job.aborted)
+		lvb_assert(known + job.done > ceiling);
+	return job.done;
+
+} /* end subtree_tasks() */
+
 long getplen(Dataptr restrict MSA, TREESTACK_TREE_NODES *BranchArray, Parameters rcstruct, const long root,
-			 long *restrict p_todo_arr, long *p_todo_arr_sum_changes, int *p_runs)
+			 long *restrict p_todo_arr, long *p_todo_arr_sum_changes)
+/* return length of the tree in BranchArray, rooted at root */
+{
+	return getplen_bounded(MSA, BranchArray, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes, LONG_MAX);
+
+} /* end getplen() */
+
+long getplen_bounded(Dataptr restrict MSA, TREESTACK_TREE_NODES *BranchArray, Parameters rcstruct, const long root,
+					 long *restrict p_todo_arr, long *p_todo_arr_sum_changes, const long ceiling)
+/* return length of the tree in BranchArray, rooted at root, if it is no
+ * greater than ceiling; otherwise the calculation may be abandoned early,
+ * returning a lower bound on the length that is greater than ceiling and
+ * leaving unfinished branches "dirty"; statesets and changes are calculated
+ * for "dirty" branches only, each after its children, as listed by
+ * dirty_postorder() */
 {
 	long branch;						  /* current branch number */
 	long changes = 0;					  /* tree length (number of changes) */
-	long n_changes_temp;				  /* temp variable to count the changes */
-	long done = 0;						  /* count of branches "done" */
+	long known = 0;						  /* lower bound on tree length so far */
 	long i;								  /* loop counter */
-	long k;								  /* current character number */
+	long k;								  /* current thread number */
 	long left;							  /* current left child number */
 	long right;							  /* current right child number */
-	long number_of_internal_branches = 0; /* count of branches "to do" */
-	long l_end = 0;
+	long number_of_internal_branches;	  /* count of branches "to do" */
+	const Lvb_bool bounded = (ceiling == LONG_MAX) ? LVB_FALSE : LVB_TRUE;
+
+	/* get the branches to touch, children before parents */
+	number_of_internal_branches = dirty_postorder(MSA, BranchArray, root, p_todo_arr);
+	if (bounded == LVB_TRUE)
+		known = MSA->length_offset + clean_below(MSA, BranchArray, root, p_todo_arr, number_of_internal_branches);
 
 	/* calculate state sets and changes where not already known */
-	if (MSA->n_threads_getplen > 1)
+	if (MSA->n_threads_getplen > 1 && MSA->getplen_strategy == GETPLEN_SLICES)
 	{ /* only if is greather than 1 that use the thread version */
 
-		/* get the branches to touch */
-		memset(p_runs, 0, MSA->n_threads_getplen * (MSA->numberofpossiblebranches - MSA->n) * sizeof(int));
-		for (i = MSA->n; i < MSA->numberofpossiblebranches; i++)
-		{
-			if (BranchArray[i].sitestate[0] == 0U)
-			{
-				*(p_todo_arr + number_of_internal_branches++) = i;
-			}
-			else
-			{
-				changes += BranchArray[i].changes;
-				for (k = 0; k < MSA->n_threads_getplen; k++)
-				{
-					*(p_runs + ((i - MSA->n) * MSA->n_threads_getplen) + k) = 1;
-				}
-			}
-		}
+		/* running changes of each thread, so each can see when the total
+		 * has passed the ceiling */
+		Slice_job job; /* shared by the threads of the pool */
+		long *p_partial = p_todo_arr_sum_changes + (MSA->numberofpossiblebranches - MSA->n + 1) * MSA->n_threads_getplen;
+		int aborted;	 /* set once the ceiling is passed */
 
-		omp_set_dynamic(0); /* disable dinamic threathing */
-#pragma omp parallel num_threads(MSA->n_threads_getplen) private(done, l_end, k, i, left, right, branch, n_changes_temp)
-		{
-			long j;			  /* loop counter */
-			long ch;		  /* partial changes */
-			Lvb_bit_length u; /* for s. set and length calcs */
-			Lvb_bit_length x; /* batch of 8 left state sets */
-			Lvb_bit_length y; /* batch of 8 right state sets */
-
-			done = 0;
-			l_end = MSA->n_slice_size_getplen * (omp_get_thread_num() + 1);
-			if (MSA->n_threads_getplen == (omp_get_thread_num() + 1))
-				l_end += MSA->nwords - (MSA->n_slice_size_getplen * MSA->n_threads_getplen);
-
-			while (done < number_of_internal_branches)
-			{
-				for (i = 0; i < number_of_internal_branches; i++)
-				{
-					branch = *(p_todo_arr + i);
-					if (*(p_runs + ((branch - MSA->n) * MSA->n_threads_getplen) + omp_get_thread_num()) == 0) /* "dirty" */
-					{
-						left = BranchArray[branch].left;
-						right = BranchArray[branch].right;
-						if ((left < MSA->n || *(p_runs + ((left - MSA->n) * MSA->n_threads_getplen) + omp_get_thread_num()) == 1) &&
-							(right < MSA->n || *(p_runs + ((right - MSA->n) * MSA->n_threads_getplen) + omp_get_thread_num()) == 1))
-						{
-							n_changes_temp = 0;
-							Lvb_bit_length *restrict l_sitestates = BranchArray[left].sitestate;
-							Lvb_bit_length *restrict r_sitestates = BranchArray[right].sitestate;
-							for (j = MSA->n_slice_size_getplen * omp_get_thread_num(); j < l_end; j++)
-							{
-								x = l_sitestates[j];
-								y = r_sitestates[j];
-								u = ((((x & y & MASK_SEVEN) + MASK_SEVEN) | (x & y)) & MASK_EIGHT);
-								__asm__("popcnt %1, %0"
-										: "=r"(ch)
-										: "0"(u));
-								ch = LENGTH_WORD - ch;
-								u >>= 3;
-								n_changes_temp += ch;
-								BranchArray[branch].sitestate[j] = (x & y) | ((x | y) & ((u + MASK_SEVEN) ^ MASK_EIGHT));
-								;
-							}
-							*(p_todo_arr_sum_changes + (i * MSA->n_threads_getplen) + omp_get_thread_num()) = n_changes_temp;
-							done++;
-							*(p_runs + ((branch - MSA->n) * MSA->n_threads_getplen) + omp_get_thread_num()) = 1;
-						}
-					}
-				}
-			}
+		for (k = 0; k < MSA->n_threads_getplen; k++)
+			p_partial[k] = 0;
 
-			/* count the changes to the root one */
-			n_changes_temp = 0;
-			left = BranchArray[root].left;
-			right = BranchArray[root].right;
-			for (j = MSA->n_slice_size_getplen * omp_get_thread_num(); j < l_end; j++)
-			{
-				x = BranchArray[left].sitestate[j];
-				y = BranchArray[right].sitestate[j];
-				u = ((((x & y & MASK_SEVEN) + MASK_SEVEN) | (x & y)) & MASK_EIGHT);
-				__asm__("popcnt %1, %0"
-						: "=r"(ch)
-						: "0"(u));
-
-				ch = LENGTH_WORD - ch;
-				u >>= 3;
-				n_changes_temp += ch;
-
-				x = (x & y) | ((x | y) & ((u + MASK_SEVEN) ^ MASK_EIGHT));
-				y = BranchArray[root].sitestate[j];
-				u = ((((x & y & MASK_SEVEN) + MASK_SEVEN) | (x & y)) & MASK_EIGHT);
-				__asm__("popcnt %1, %0"
-						: "=r"(ch)
-						: "0"(u));
-				ch = LENGTH_WORD - ch;
-				n_changes_temp += ch;
-			}
-			*(p_todo_arr_sum_changes + (number_of_internal_branches * MSA->n_threads_getplen) + omp_get_thread_num()) = n_changes_temp;
+		job.MSA = MSA;
+		job.BranchArray = BranchArray;
+		job.root = root;
+		job.p_todo_arr = p_todo_arr;
+		job.p_todo_arr_sum_changes = p_todo_arr_sum_changes;
+		job.p_partial = p_partial;
+		job.number_of_internal_branches = number_of_internal_branches;
+		job.known = known;
+		job.ceiling = ceiling;
+		job.bounded = bounded;
+		job.aborted = 0;
+		pool_run(getplen_slice, &job);
+		aborted = job.aborted;
+
+		if (aborted)
+		{ /* slices may be missing anywhere, so redo every branch next time */
+			for (i = 0; i < number_of_internal_branches; i++)
+				BranchArray[*(p_todo_arr + i)].sitestate[0] = 0U;
+			for (k = 0; k < MSA->n_threads_getplen; k++)
+				known += p_partial[k];
+			lvb_assert(known > ceiling);
+			return known;
 		}
 
 		/* sum the changes */
 		for (i = 0; i < number_of_internal_branches; i++)
 		{
-			BranchArray[*(p_todo_arr + i)].changes = *(p_todo_arr_sum_changes + (i * MSA->n_threads_getplen));
+			branch = *(p_todo_arr + i);
+			BranchArray[branch].changes = *(p_todo_arr_sum_changes + (i * MSA->n_threads_getplen));
 			for (k = 1; k < MSA->n_threads_getplen; k++)
 			{
-				BranchArray[*(p_todo_arr + i)].changes += *(p_todo_arr_sum_changes + (i * MSA->n_threads_getplen) + k);
+				BranchArray[branch].changes += *(p_todo_arr_sum_changes + (i * MSA->n_threads_getplen) + k);
 			}
-			changes += BranchArray[*(p_todo_arr + i)].changes;
+			BranchArray[branch].sum_changes = BranchArray[branch].changes +
+											  subtree_changes(MSA, BranchArray, BranchArray[branch].left) +
+											  subtree_changes(MSA, BranchArray, BranchArray[branch].right);
 		}
 		/* sum the changes to the root */
 		for (k = 0; k < MSA->n_threads_getplen; k++)
@@ -179,60 +467,36 @@ long getplen(Dataptr restrict MSA, TREESTACK_TREE_NODES *BranchArray, Parameters
 		}
 		/* END of threading code */
 	}
+	else if (MSA->getplen_strategy == GETPLEN_SUBTREES && number_of_internal_branches >= MSA->min_branches_subtree_tasks)
+	{ /* whole branches on different threads, then the root here */
+		known += subtree_tasks(MSA, BranchArray, root, p_todo_arr, p_todo_arr_sum_changes,
+							   number_of_internal_branches, known, ceiling);
+		if (known > ceiling)
+			return known;
+
+		left = BranchArray[root].left;
+		right = BranchArray[root].right;
+		changes += weighted_root(MSA, BranchArray[left].sitestate, BranchArray[right].sitestate,
+								 BranchArray[root].sitestate, 0, MSA->nwords, ceiling - known);
+	}
 	else
 	{ /* code to the orginal version, without threading */
 
-		long ch;		  /* partial changes */
-		long j;			  /* loop counter */
-		Lvb_bit_length u; /* for s. set and length calcs */
-		Lvb_bit_length x; /* batch of 8 left state sets */
-		Lvb_bit_length y; /* batch of 8 right state sets */
-
-		for (i = MSA->n; i < MSA->numberofpossiblebranches; i++)
+		for (i = 0; i < number_of_internal_branches; i++)
 		{
-			if (BranchArray[i].sitestate[0] == 0U)
-			{
-				*(p_todo_arr + number_of_internal_branches++) = i;
-				BranchArray[i].changes = 0;
-			}
-			else
-			{
-				changes += BranchArray[i].changes;
-			}
-		}
-
-		while (done < number_of_internal_branches)
-		{
-			for (i = 0; i < number_of_internal_branches; i++)
-			{
-				branch = *(p_todo_arr + i);
-				if (BranchArray[branch].sitestate[0] == 0U) /* "dirty" */
-				{
-					left = BranchArray[branch].left;
-					right = BranchArray[branch].right;
-					if (BranchArray[left].sitestate[0] && BranchArray[right].sitestate[0])
-					{
-						Lvb_bit_length *restrict l_sitestates = BranchArray[left].sitestate;
-						Lvb_bit_length *restrict r_sitestates = BranchArray[right].sitestate;
-						for (j = 0; j < MSA->nwords; j++)
-						{
-							x = l_sitestates[j];
-							y = r_sitestates[j];
-							u = ((((x & y & MASK_SEVEN) + MASK_SEVEN) | (x & y)) & MASK_EIGHT);
-							__asm__("popcnt %1, %0"
-									: "=r"(ch)
-									: "0"(u));
-							ch = LENGTH_WORD - ch;
-
-							u >>= 3;
-							BranchArray[branch].sitestate[j] = (x & y) | ((x | y) & ((u + MASK_SEVEN) ^ MASK_EIGHT));
-							BranchArray[branch].changes += ch;
-							changes += ch;
-						}
-						done++;
-					}
-				}
+			branch = *(p_todo_arr + i);
+			left = BranchArray[branch].left;
+			right = BranchArray[branch].right;
+			BranchArray[branch].changes = weighted_pair(MSA, BranchArray[left].sitestate, BranchArray[right].sitestate,
+														BranchArray[branch].sitestate, 0, MSA->nwords, ceiling - known);
+			known += BranchArray[branch].changes;
+			if (known > ceiling)
+			{ /* give up, this branch's statesets are unfinished */
+				BranchArray[branch].sitestate[0] = 0U;
+				return known;
 			}
+			BranchArray[branch].sum_changes = BranchArray[branch].changes +
+											  subtree_changes(MSA, BranchArray, left) + subtree_changes(MSA, BranchArray, right);
 		}
 
 		/* root: add length for root branch structure, and also for true root which
@@ -241,30 +505,294 @@ long getplen(Dataptr restrict MSA, TREESTACK_TREE_NODES *BranchArray, Parameters
 		 * leaf) */
 		left = BranchArray[root].left;
 		right = BranchArray[root].right;
-		for (j = 0; j < MSA->nwords; j++)
-		{
-			x = BranchArray[left].sitestate[j];
-			y = BranchArray[right].sitestate[j];
-			u = ((((x & y & MASK_SEVEN) + MASK_SEVEN) | (x & y)) & MASK_EIGHT);
-			__asm__("popcnt %1, %0"
-					: "=r"(ch)
-					: "0"(u));
-			ch = LENGTH_WORD - ch;
-			u >>= 3;
-			changes += ch;
-
-			x = (x & y) | ((x | y) & ((u + MASK_SEVEN) ^ MASK_EIGHT));
-			y = BranchArray[root].sitestate[j];
-			u = ((((x & y & MASK_SEVEN) + MASK_SEVEN) | (x & y)) & MASK_EIGHT);
-			__asm__("popcnt %1, %0"
-					: "=r"(ch)
-					: "0"(u));
-			ch = LENGTH_WORD - ch;
-			changes += ch;
-		}
+		changes += weighted_root(MSA, BranchArray[left].sitestate, BranchArray[right].sitestate,
+								 BranchArray[root].sitestate, 0, MSA->nwords, ceiling - known);
 	}
 
+	/* everything below the root, and the columns cut as uninformative */
+	changes += subtree_changes(MSA, BranchArray, BranchArray[root].left) +
+			   subtree_changes(MSA, BranchArray, BranchArray[root].right) + MSA->length_offset;
+
 	lvb_assert(changes > 0);
 	return changes;
 
-} /* end getplen() */
+} /* end getplen_bounded() */
+
+long acceptance_ceiling(const double tree_minimum_length, const long current_tree_length, const double t)
+/* return a length such that any proposed tree longer than it is certain to
+ * be rejected at temperature t by the test in Anneal(), given the uni()
+ * deviate that test will draw next, or LONG_MAX if there is no such length;
+ * the generator's state is not changed. A change for the worse is accepted
+ * if u < exp(-deltah / t), i.e. if
+ *     lmin / proposed > lmin / current + t * ln u,
+ * where u is the deviate and lmin the minimum length of any tree. */
+{
+	double u = uni_peek();	/* deviate the acceptance test will use */
+	double denominator;		/* lmin / current + t * ln u */
+	double bound;			/* exact limit on accepted length */
+
+	/* deltah is capped at 1 when lmin exceeds the current length, so the
+	 * limit does not hold; and ln 0 is not defined */
+	if ((tree_minimum_length >= (double)current_tree_length) || (u <= 0.0))
+		return LONG_MAX;
+
+	denominator = tree_minimum_length / (double)current_tree_length + t * log_wrapper(u);
+	if (denominator <= 0.0)
+		return LONG_MAX;
+	bound = tree_minimum_length / denominator;
+	if (bound >= (double)(LONG_MAX / 2))
+		return LONG_MAX;
+
+	/* allow for rounding in the acceptance test itself */
+	return (long)(bound * (1.0 + ACCEPTANCE_CEILING_MARGIN)) + 1;
+
+} /* end acceptance_ceiling() */
+
+Uppass_sets *uppass_alloc(Dataptr restrict MSA, Uppass_sets *share)
+/* return new, not yet valid, up-pass statesets for a tree for the data
+ * MSA; if share is not NULL, the new ones have scratch space of their own
+ * but use the statesets of share, so that several threads may score
+ * rearrangements of the same tree at once */
+{
+	Uppass_sets *up; /* return value */
+	long i;			 /* loop counter */
+
+	up = (Uppass_sets *)alloc(sizeof(Uppass_sets), "up-pass statesets");
+	up->valid = LVB_FALSE;
+	up->mark = 0;
+	up->stamp = (long *)alloc(MSA->numberofpossiblebranches * sizeof(long), "up-pass stamps");
+	up->path = (long *)alloc(MSA->numberofpossiblebranches * sizeof(long), "up-pass path");
+	up->shared = (share == NULL) ? LVB_FALSE : LVB_TRUE;
+	if (share == NULL)
+		up->upset = (Lvb_bit_length *)alloc(MSA->numberofpossiblebranches * MSA->bytes, "up-pass statesets");
+	else
+		up->upset = share->upset;
+	up->scratch = (Lvb_bit_length *)alloc(UPPASS_SCRATCH_SETS * MSA->bytes, "up-pass scratch statesets");
+	for (i = 0; i < MSA->numberofpossiblebranches; i++)
+		up->stamp[i] = UNSET;
+	return up;
+
+} /* end uppass_alloc() */
+
+void uppass_free(Uppass_sets *up)
+/* free the up-pass statesets up and everything in them */
+{
+	free(up->stamp);
+	free(up->path);
+	if (up->shared == LVB_FALSE)
+		free(up->upset);
+	free(up->scratch);
+	free(up);
+
+} /* end uppass_free() */
+
+static inline long other_child(const TREESTACK_TREE_NODES *BranchArray, const long parent, const long child)
+/* return the child of parent that is not child */
+{
+	return BranchArray[parent].left == child ? BranchArray[parent].right : BranchArray[parent].left;
+
+} /* end other_child() */
+
+static inline const Lvb_bit_length *outside(Dataptr restrict MSA, const TREESTACK_TREE_NODES *BranchArray,
+											const Uppass_sets *up, const long root, const long branch)
+/* return the statesets of the rest of the tree seen from branch; the rest
+ * of the tree seen from the root branch is the root leaf itself */
+{
+	return branch == root ? BranchArray[root].sitestate : up->upset + branch * MSA->nwords;
+
+} /* end outside() */
+
+void uppass_fill(Dataptr restrict MSA, const TREESTACK_TREE_NODES *BranchArray, const long root, Uppass_sets *up)
+/* make up describe the tree in BranchArray, rooted at root, which must
+ * have no "dirty" branches: for every branch but the root, find the Fitch
+ * statesets of the rest of the tree, from those of the rest of the tree
+ * seen from its parent and those of its sister, parents first */
+{
+	long *queue = up->path; /* branches whose children are still to do */
+	long n_queued = 0;		/* branches put in queue */
+	long i;					/* loop counter */
+	long branch;			/* current branch */
+	long left;				/* left child of current branch */
+	long right;				/* right child of current branch */
+
+	queue[n_queued++] = root;
+	for (i = 0; i < n_queued; i++)
+	{
+		branch = queue[i];
+		left = BranchArray[branch].left;
+		right = BranchArray[branch].right;
+		weighted_pair(MSA, outside(MSA, BranchArray, up, root, branch), BranchArray[right].sitestate,
+					  up->upset + left * MSA->nwords, 0, MSA->nwords, LONG_MAX);
+		weighted_pair(MSA, outside(MSA, BranchArray, up, root, branch), BranchArray[left].sitestate,
+					  up->upset + right * MSA->nwords, 0, MSA->nwords, LONG_MAX);
+		if (left >= MSA->n)
+			queue[n_queued++] = left;
+		if (right >= MSA->n)
+			queue[n_queued++] = right;
+	}
+	up->valid = LVB_TRUE;
+
+} /* end uppass_fill() */
+
+static const Lvb_bit_length *pruned_below(Dataptr restrict MSA, const TREESTACK_TREE_NODES *BranchArray, Uppass_sets *up,
+										  const long src, const long top, int *next)
+/* return the downwards statesets of branch top, which must be above the
+ * parent of src, once src is pruned: the sister of src takes its parent's
+ * place, and the statesets are found again from there up to top, using
+ * scratch sets *next and 1 - *next in turn */
+{
+	const long nwords = MSA->nwords;
+	const Lvb_bit_length *below; /* statesets of child on the path */
+	Lvb_bit_length *dest;		 /* statesets of current branch */
+	long child;					 /* child of current branch on the path */
+	long branch;				 /* current branch */
+
+	child = BranchArray[src].parent;
+	below = BranchArray[other_child(BranchArray, child, src)].sitestate;
+	for (branch = BranchArray[child].parent;; branch = BranchArray[branch].parent)
+	{
+		dest = up->scratch + *next * nwords;
+		weighted_pair(MSA, below, BranchArray[other_child(BranchArray, branch, child)].sitestate, dest, 0, nwords,
+					  LONG_MAX);
+		below = dest;
+		*next = 1 - *next;
+		if (branch == top)
+			break;
+		child = branch;
+	}
+	return below;
+
+} /* end pruned_below() */
+
+static long regraft_length(Dataptr restrict MSA, const TREESTACK_TREE_NODES *BranchArray, Uppass_sets *up,
+						   const long root, const long length, const long src, const Lvb_bit_length *subtree,
+						   const long dest, const long ceiling)
+/* return the length of the tree in BranchArray, of length length, after
+ * branch src is pruned and regrafted to branch dest with statesets subtree
+ * at its root, if it is no greater than ceiling; otherwise may return a
+ * lower bound greater than ceiling. Attaching src to the edge between
+ * statesets x and y costs as many changes as joining its statesets with
+ * those of x and y joined together. Pruning src changes statesets only on
+ * the path from its parent to dest, so only these are found: downwards
+ * ones up to where the path turns, then up-pass ones down to dest */
+{
+	const long nwords = MSA->nwords;
+	const long src_parent = BranchArray[src].parent; /* disappears on pruning */
+	const long src_sister = other_child(BranchArray, src_parent, src);
+	Lvb_bit_length *joined = up->scratch + 3 * nwords; /* edge statesets joined */
+	const Lvb_bit_length *below;					   /* downwards statesets of dest after pruning */
+	const Lvb_bit_length *above;					   /* up-pass statesets of dest after pruning */
+	long removed;									   /* changes attaching src where it is */
+	long added;										   /* changes attaching src at dest */
+	long turn;										   /* where the path from dest turns down */
+	long side;										   /* child of turn on the side of src */
+	long n_path = 0;								   /* branches from dest up to turn */
+	long branch;									   /* current branch */
+	int next = 0;									   /* next scratch set to use */
+
+	lvb_assert(up->valid == LVB_TRUE);
+
+	/* changes that go with src attached where it is; the statesets joined
+	 * with themselves cost nothing */
+	weighted_pair(MSA, BranchArray[src_sister].sitestate, outside(MSA, BranchArray, up, root, src_parent), joined, 0,
+				  nwords, LONG_MAX);
+	removed = weighted_root(MSA, joined, joined, BranchArray[src].sitestate, 0, nwords, LONG_MAX);
+
+	/* mark the branches above the parent of src, and walk up from dest to
+	 * the first of them, or to the parent of src if dest is below its
+	 * sister */
+	up->mark++;
+	for (branch = BranchArray[src_parent].parent; branch != UNSET; branch = BranchArray[branch].parent)
+		up->stamp[branch] = up->mark;
+	for (turn = dest; (turn != src_parent) && (up->stamp[turn] != up->mark); turn = BranchArray[turn].parent)
+		up->path[n_path++] = turn;
+
+	if (n_path == 0)
+	{ /* dest is above src: only its downwards statesets change */
+		below = pruned_below(MSA, BranchArray, up, src, dest, &next);
+		above = outside(MSA, BranchArray, up, root, dest);
+	}
+	else
+	{
+		if (turn == src_parent)
+		{ /* the sister of src takes its parent's place */
+			above = outside(MSA, BranchArray, up, root, src_parent);
+		}
+		else
+		{ /* up-pass statesets of the child of turn on the side of dest */
+			side = other_child(BranchArray, turn, up->path[n_path - 1]);
+			below = (side == src_parent) ? BranchArray[src_sister].sitestate
+										 : pruned_below(MSA, BranchArray, up, src, side, &next);
+			weighted_pair(MSA, outside(MSA, BranchArray, up, root, turn), below, up->scratch + 2 * nwords, 0, nwords,
+						  LONG_MAX);
+			above = up->scratch + 2 * nwords;
+		}
+
+		/* up-pass statesets down the path to dest */
+		for (next = 0; n_path > 1; n_path--)
+		{
+			branch = up->path[n_path - 1];
+			weighted_pair(MSA, above, BranchArray[other_child(BranchArray, branch, up->path[n_path - 2])].sitestate,
+						  up->scratch + next * nwords, 0, nwords, LONG_MAX);
+			above = up->scratch + next * nwords;
+			next = 1 - next;
+		}
+		below = BranchArray[dest].sitestate;
+	}
+
+	/* changes that go with src attached at dest */
+	weighted_pair(MSA, below, above, joined, 0, nwords, LONG_MAX);
+	added = weighted_root(MSA, joined, joined, subtree, 0, nwords,
+						  ceiling == LONG_MAX ? LONG_MAX : ceiling - length + removed);
+
+	return length - removed + added;
+
+} /* end regraft_length() */
+
+long spr_length(Dataptr restrict MSA, const TREESTACK_TREE_NODES *BranchArray, Uppass_sets *up, const long root,
+				const long length, const long src, const long dest, const long ceiling)
+/* return the length of the tree in BranchArray, rooted at root and of
+ * length length, after spr_apply() moves branch src to branch dest, if it
+ * is no greater than ceiling; otherwise may return a lower bound greater
+ * than ceiling; the tree is not changed, and up must describe it */
+{
+	return regraft_length(MSA, BranchArray, up, root, length, src, BranchArray[src].sitestate, dest, ceiling);
+
+} /* end spr_length() */
+
+long tbr_length(Dataptr restrict MSA, const TREESTACK_TREE_NODES *BranchArray, Uppass_sets *up, const long root,
+				const long length, const long src, const long dest, const long newroot, const long ceiling)
+/* as spr_length(), but after tbr_apply() also reroots the moved subtree
+ * next to leaf newroot, unless newroot is UNSET: its length is the same
+ * wherever it is rooted, so only the statesets at its new root are found,
+ * by up-pass statesets within the subtree down the path to newroot */
+{
+	const long nwords = MSA->nwords;
+	Lvb_bit_length *subtree = up->scratch + 4 * nwords; /* statesets at new root */
+	const Lvb_bit_length *above;						/* up-pass statesets within subtree */
+	long n_path = 0;									/* branches from newroot up to src */
+	long branch;										/* current branch */
+	int next = 0;										/* next scratch set to use */
+
+	if (newroot == UNSET)
+		return spr_length(MSA, BranchArray, up, root, length, src, dest, ceiling);
+
+	for (branch = newroot; branch != src; branch = BranchArray[branch].parent)
+		up->path[n_path++] = branch;
+	lvb_assert(n_path >= 2);
+
+	/* seen from a child of src, the rest of the subtree is its sister */
+	above = BranchArray[other_child(BranchArray, src, up->path[n_path - 1])].sitestate;
+	for (; n_path > 1; n_path--)
+	{
+		branch = up->path[n_path - 1];
+		weighted_pair(MSA, above, BranchArray[other_child(BranchArray, branch, up->path[n_path - 2])].sitestate,
+					  up->scratch + next * nwords, 0, nwords, LONG_MAX);
+		above = up->scratch + next * nwords;
+		next = 1 - next;
+	}
+	weighted_pair(MSA, BranchArray[newroot].sitestate, above, subtree, 0, nwords, LONG_MAX);
+
+	return regraft_length(MSA, BranchArray, up, root, length, src, subtree, dest, ceiling);
+
+} /* end tbr_length() */
@@ -48,5 +48,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define LVB_TREEEVALUATION_H
 
 #include "LVB.h"
+#include "FitchKernel.h"
+#include "WorkerPool.h"
 
 #endif
@@ -54,6 +54,7 @@ void nodeclear(TREESTACK_TREE_NODES *const BranchArray, const long brnch)
 	BranchArray[brnch].right = UNSET;
 	BranchArray[brnch].parent = UNSET;
 	BranchArray[brnch].changes = UNSET;
+	BranchArray[brnch].sum_changes = UNSET;
 	BranchArray[brnch].sitestate[0] = 0U; /* "dirty" */
 
 } /* end nodeclear() */
@@ -85,41 +86,39 @@ void treeclear(Dataptr restrict MSA, TREESTACK_TREE_NODES *const BranchArray)
 
 } /* end treeclear() */
 
-static void make_dirty_below(Dataptr restrict MSA, TREESTACK_TREE_NODES *tree, long dirty_node)
+static void make_dirty_below(Dataptr restrict MSA, TREESTACK_TREE_NODES *tree, long dirty_node, Undo_log *undo)
 /* mark nodes "dirty" from branch dirty_node, which must not be the root,
  * down to (but not including) the root branch of the tree tree; the true
  * root lies outside the LVB tree data structure so cannot be marked
- * dirty, but will always be dirty after any rearrangement */
+ * dirty, but will always be dirty after any rearrangement; record each
+ * branch's statesets in undo first, if undo is not NULL */
 {
 
 	lvb_assert(dirty_node >= MSA->n); /* not leaf/root */
 	lvb_assert(tree[dirty_node].parent != UNSET);
 	do
 	{
+		undo_save_sitestate(MSA, undo, tree, dirty_node);
 		tree[dirty_node].sitestate[0] = 0U; /* " make dirty" */
 		dirty_node = tree[dirty_node].parent;
 	} while (tree[dirty_node].parent != UNSET);
 
 } /* end make_dirty_below() */
 
-void mutate_deterministic(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree,
-						  const TREESTACK_TREE_NODES *const sourcetree, long root, long p, Lvb_bool left)
-/* make a copy of the tree sourcetree (of root root) in desttree,
- * with a change in topology, the change being caused by nearest
- * neighbour interchange (NNI) rearrangement at branch p, involving the
- * right node if right is LVB_TRUE, otherwise the left node; N.B. code
- * is largely copied from mutate_nni() */
+void mutate_deterministic(Dataptr restrict MSA, TREESTACK_TREE_NODES *const tree, long root, long p, Lvb_bool left,
+						  Undo_log *undo)
+/* change the topology of the tree tree (of root root) in place, the
+ * change being caused by nearest neighbour interchange (NNI)
+ * rearrangement at branch p, involving the right node if right is
+ * LVB_TRUE, otherwise the left node; record the branches changed in
+ * undo, if it is not NULL; N.B. code is largely copied from
+ * mutate_nni() */
 {
-	TREESTACK_TREE_NODES *tree;
 	long u, v, a, b, c;
 
 	lvb_assert(p != root);
 	lvb_assert(p >= MSA->n);
 
-	/* for ease of reading, make alias of desttree, tree */
-	tree = desttree;
-	treecopy(MSA, tree, sourcetree, LVB_TRUE);
-
 	u = p;
 	v = tree[u].parent;
 	a = tree[u].left;
@@ -130,6 +129,12 @@ void mutate_deterministic(Dataptr restrict MSA, TREESTACK_TREE_NODES *const dest
 	else
 		c = tree[v].left;
 
+	undo_save(MSA, undo, tree, u);
+	undo_save(MSA, undo, tree, v);
+	undo_save(MSA, undo, tree, a);
+	undo_save(MSA, undo, tree, b);
+	undo_save(MSA, undo, tree, c);
+
 	if (left != LVB_TRUE)
 	{
 		if (tree[v].left == u)
@@ -153,23 +158,18 @@ void mutate_deterministic(Dataptr restrict MSA, TREESTACK_TREE_NODES *const dest
 		tree[a].parent = v;
 	}
 
-	make_dirty_below(MSA, tree, u);
+	make_dirty_below(MSA, tree, u, undo);
 
-} /* end mutate_nni() */
+} /* end mutate_deterministic() */
 
-void mutate_nni(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, const TREESTACK_TREE_NODES *const sourcetree, long root)
-/* make a copy of the tree sourcetree (of root root) in desttree,
- * with a random change in topology, the change being caused by nearest
- * neighbour interchange (NNI) rearrangement; N.B. the code is mostly
- * the same in mutate_deterministic() */
+void mutate_nni(Dataptr restrict MSA, TREESTACK_TREE_NODES *const tree, long root, Undo_log *undo)
+/* make a random change in the topology of the tree tree (of root root) in
+ * place, the change being caused by nearest neighbour interchange (NNI)
+ * rearrangement; record the branches changed in undo, if it is not NULL;
+ * N.B. the code is mostly the same in mutate_deterministic() */
 {
-	TREESTACK_TREE_NODES *tree;
 	long u, v, a, b, c;
 
-	/* for ease of reading, make alias of desttree, tree */
-	tree = desttree;
-	treecopy(MSA, tree, sourcetree, LVB_TRUE);
-
 	/* get a random internal branch */
 	u = randpint(MSA->numberofpossiblebranches - MSA->n - 1) + MSA->n;
 	v = tree[u].parent;
@@ -181,6 +181,12 @@ void mutate_nni(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, cons
 	else
 		c = tree[v].left;
 
+	undo_save(MSA, undo, tree, u);
+	undo_save(MSA, undo, tree, v);
+	undo_save(MSA, undo, tree, a);
+	undo_save(MSA, undo, tree, b);
+	undo_save(MSA, undo, tree, c);
+
 	if (uni() < 0.5)
 	{
 		if (tree[v].left == u)
@@ -204,7 +210,7 @@ void mutate_nni(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, cons
 		tree[a].parent = v;
 	}
 
-	make_dirty_below(MSA, tree, u);
+	make_dirty_below(MSA, tree, u, undo);
 
 } /* end mutate_nni() */
 
@@ -233,24 +239,15 @@ from ancestor, LVB_FALSE otherwise */
 
 } /* end is_descendant() */
 
-void mutate_spr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, const TREESTACK_TREE_NODES *const sourcetree, long root)
-/* make a copy of the tree sourcetree (of root root) in desttree,
- * with a random change in topology, the change being caused by subtree
- * pruning and regrafting (SPR) rearrangement */
+void spr_choose(Dataptr restrict MSA, TREESTACK_TREE_NODES *const tree, long root, long *p_src, long *p_dest)
+/* choose a random subtree pruning and regrafting (SPR) rearrangement of
+ * the tree tree (of root root), without making it: on return *p_src is the
+ * branch to move and *p_dest the branch to move it to */
 {
-	long src;					/* branch to move */
-	long dest;					/* destination of branch to move */
-	long dest_parent;			/* parent of destination branch */
-	long src_parent;			/* parent of branch to move */
-	long excess_br;				/* branch temporarily excised */
-	long orig_child = UNSET;	/* original child of destination */
-	long parents_par;			/* parent of parent of br. to move */
-	long src_sister;			/* sister of branch to move */
-	TREESTACK_TREE_NODES *tree; /* destination tree */
-
-	/* for ease of reading, make alias of desttree, tree */
-	tree = desttree;
-	treecopy(MSA, tree, sourcetree, LVB_TRUE);
+	long src;		 /* branch to move */
+	long dest;		 /* destination of branch to move */
+	long src_parent; /* parent of branch to move */
+	long src_sister; /* sister of branch to move */
 
 	/* get random branch but not root and not root's immediate descendant */
 	do
@@ -270,6 +267,36 @@ void mutate_spr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, cons
 		dest = randpint(MSA->numberofpossiblebranches - 1);
 	} while ((dest == src) || (dest == src_parent) || (dest == src_sister) || (dest == root) || is_descendant(tree, root, src, dest));
 
+	*p_src = src;
+	*p_dest = dest;
+
+} /* end spr_choose() */
+
+void spr_apply(Dataptr restrict MSA, TREESTACK_TREE_NODES *const tree, long root, long src, long dest, Undo_log *undo)
+/* change the topology of the tree tree (of root root) in place by moving
+ * branch src to branch dest, as chosen by spr_choose(); record the
+ * branches changed in undo, if it is not NULL */
+{
+	long dest_parent;			/* parent of destination branch */
+	long src_parent;			/* parent of branch to move */
+	long excess_br;				/* branch temporarily excised */
+	long orig_child = UNSET;	/* original child of destination */
+	long parents_par;			/* parent of parent of br. to move */
+	long src_sister;			/* sister of branch to move */
+
+	src_parent = tree[src].parent;
+	lvb_assert(src_parent != UNSET);
+	src_sister = getsister(tree, src);
+	lvb_assert(src_sister != UNSET);
+
+	/* record what may change, so the rearrangement can be undone */
+	undo_save(MSA, undo, tree, src);
+	undo_save(MSA, undo, tree, src_parent);
+	undo_save(MSA, undo, tree, src_sister);
+	undo_save(MSA, undo, tree, tree[src_parent].parent);
+	undo_save(MSA, undo, tree, dest);
+	undo_save(MSA, undo, tree, tree[dest].parent);
+
 	/* excise source branch, leaving a damaged data structure */
 	if (tree[src_parent].left == src)
 	{
@@ -299,6 +326,7 @@ void mutate_spr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, cons
 	tree[src_sister].parent = parents_par;
 
 	excess_br = src_parent; /* for ease of human understanding */
+	undo_save_sitestate(MSA, undo, tree, excess_br);
 	nodeclear(tree, excess_br);
 
 	/* make space at destination, re-using the excess branch */
@@ -327,27 +355,72 @@ void mutate_spr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, cons
 	tree[src].parent = excess_br;
 
 	/* ensure recalculation of lengths where necessary */
-	make_dirty_below(MSA, tree, excess_br);
+	make_dirty_below(MSA, tree, excess_br, undo);
 	if (parents_par != root)
 	{
-		make_dirty_below(MSA, tree, parents_par);
+		make_dirty_below(MSA, tree, parents_par, undo);
 	}
+} /* end spr_apply() */
+
+void mutate_spr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const tree, long root, Undo_log *undo)
+/* make a random change in the topology of the tree tree (of root root) in
+ * place, the change being caused by subtree pruning and regrafting (SPR)
+ * rearrangement; record the branches changed in undo, if it is not NULL */
+{
+	long src;  /* branch to move */
+	long dest; /* destination of branch to move */
+
+	spr_choose(MSA, tree, root, &src, &dest);
+	spr_apply(MSA, tree, root, src, dest, undo);
+
 } /* end mutate_spr() */
 
-void mutate_tbr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, const TREESTACK_TREE_NODES *const sourcetree, long root)
-/* make a copy of the tree sourcetree (of root root) in desttree,
- * with a random change in topology, the change being caused by subtree
- * pruning and regrafting (SPR) rearrangement */
+void tbr_choose(Dataptr restrict MSA, TREESTACK_TREE_NODES *const tree, long root, long *p_src, long *p_dest,
+				long *p_newroot)
+/* choose a random tree bisection and reconnection (TBR) rearrangement of
+ * the tree tree (of root root), without making it: on return *p_src is
+ * the branch to move, *p_dest the branch to move it to, and *p_newroot the
+ * leaf of the moved subtree next to which it is rerooted, or UNSET if the
+ * subtree is not rerooted */
+{
+	long oldroot;	 /* root of subtree to move */
+	long newroot;	 /* leaf next to its new root */
+	int size;		 /* leaves in subtree to move */
+	int *arr = NULL; /* leaves in subtree to move */
+
+	spr_choose(MSA, tree, root, p_src, p_dest);
+
+	/* reroot source branch (only if size of subtree > than 2) */
+	newroot = UNSET;
+	oldroot = *p_src;
+	size = count(tree, oldroot);
+	if (size > 2)
+	{
+		arr = (int *)alloc(size * sizeof(*arr), "subtree leaves");
+		addtoarray(tree, oldroot, arr, 0);
+		do
+		{
+			newroot = arr[randpint(size - 1)];
+		} while (newroot == tree[oldroot].left || newroot == tree[oldroot].right);
+		free(arr);
+	}
+	*p_newroot = newroot;
+
+} /* end tbr_choose() */
+
+void tbr_apply(Dataptr restrict MSA, TREESTACK_TREE_NODES *const tree, long root, long src, long dest, long newroot,
+			   Undo_log *undo)
+/* change the topology of the tree tree (of root root) in place by moving
+ * branch src to branch dest and rerooting it next to leaf newroot, as
+ * chosen by tbr_choose(); record the branches changed in undo, if it is
+ * not NULL */
 {
-	long src;					/* branch to move */
-	long dest;					/* destination of branch to move */
 	long dest_parent;			/* parent of destination branch */
 	long src_parent;			/* parent of branch to move */
 	long excess_br;				/* branch temporarily excised */
 	long orig_child = UNSET;	/* original child of destination */
 	long parents_par;			/* parent of parent of br. to move */
 	long src_sister;			/* sister of branch to move */
-	TREESTACK_TREE_NODES *tree; /* destination tree */
 
 	long oldroot;
 	long current;		 /* current branch */
@@ -356,30 +429,20 @@ void mutate_tbr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, cons
 	long oldsister = UNSET;
 	long tempsister = UNSET;
 	long previous = UNSET; /* previous branch */
-	long newroot;
-	static int *oldparent = NULL; /* element i was old static parent of i */
-
-	/* for ease of reading, make alias of desttree, tree */
-	tree = desttree;
-	treecopy(MSA, tree, sourcetree, LVB_TRUE);
-
-	/* get random branch but not root and not root's immediate descendant */
-	do
-	{
-		src = randpint(MSA->numberofpossiblebranches - 1);
-	} while ((src == root) || (src == tree[root].left) || (src == tree[root].right));
+	static thread_local int *oldparent = NULL; /* element i was old static parent of i */
 
 	src_parent = tree[src].parent;
 	lvb_assert(src_parent != UNSET);
 	src_sister = getsister(tree, src);
 	lvb_assert(src_sister != UNSET);
 
-	/* get destination that is not source or its parent, sister or descendant
-	 * or the root */
-	do
-	{
-		dest = randpint(MSA->numberofpossiblebranches - 1);
-	} while ((dest == src) || (dest == src_parent) || (dest == src_sister) || (dest == root) || is_descendant(tree, root, src, dest));
+	/* record what may change, so the rearrangement can be undone */
+	undo_save(MSA, undo, tree, src);
+	undo_save(MSA, undo, tree, src_parent);
+	undo_save(MSA, undo, tree, src_sister);
+	undo_save(MSA, undo, tree, tree[src_parent].parent);
+	undo_save(MSA, undo, tree, dest);
+	undo_save(MSA, undo, tree, tree[dest].parent);
 
 	/* excise source branch, leaving a damaged data structure */
 	if (tree[src_parent].left == src)
@@ -410,6 +473,7 @@ void mutate_tbr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, cons
 	tree[src_sister].parent = parents_par;
 
 	excess_br = src_parent; /* for ease of human understanding */
+	undo_save_sitestate(MSA, undo, tree, excess_br);
 	nodeclear(tree, excess_br);
 
 	/* make space at destination, re-using the excess branch */
@@ -437,31 +501,21 @@ void mutate_tbr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, cons
 		oldparent = (int *)alloc(MSA->numberofpossiblebranches * sizeof(int), "old parent alloc");
 
 	int size = count(tree, src);
-	int *arr = NULL;
-	if (arr == NULL)
-		arr = (int *)malloc(size * sizeof(*arr));
-
 	int *mid_nodes = NULL;
 	if (mid_nodes == NULL)
 		mid_nodes = (int *)malloc(size * sizeof(*mid_nodes));
 	int i = 0;
 
-	/*reroot source branch (only if size of subtree > than 2) */
-	if (size > 2)
+	/* reroot source branch next to newroot, if chosen */
+	if (newroot != UNSET)
 	{
 		oldroot = src;
 		for (current = 0; current < MSA->numberofpossiblebranches; current++)
 			oldparent[current] = tree[current].parent;
 
-		addtoarray(tree, src, arr, 0);
-
-		do
-		{
-			newroot = arr[randpint(size - 1)];
-		} while (newroot == tree[oldroot].left || newroot == tree[oldroot].right);
-
 		/* update the newroot */
 		parnt = tree[newroot].parent;
+		undo_save(MSA, undo, tree, parnt);
 		if (tree[parnt].left == newroot)
 			sister = tree[parnt].right;
 		else if (tree[parnt].right == newroot)
@@ -484,6 +538,9 @@ void mutate_tbr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, cons
 			i++;
 
 			parnt = oldparent[current];
+			undo_save(MSA, undo, tree, current);
+			undo_save(MSA, undo, tree, parnt);
+			undo_save(MSA, undo, tree, oldsister);
 
 			if (tree[current].left == previous)
 				tempsister = tree[current].right;
@@ -503,6 +560,8 @@ void mutate_tbr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, cons
 		}
 
 		/* updating the oldroot */
+		undo_save(MSA, undo, tree, oldroot);
+		undo_save(MSA, undo, tree, oldsister);
 		tree[oldroot].parent = previous;
 		if (tree[current].left == tree[oldroot].parent)
 			tree[oldroot].left = oldsister;
@@ -517,27 +576,40 @@ void mutate_tbr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const desttree, cons
 	tree[src].parent = excess_br;
 
 	/* ensure recalculation of lengths where necessary */
-	if (size > 2)
+	if (newroot != UNSET)
 	{
-		make_dirty_below(MSA, tree, oldroot);
+		make_dirty_below(MSA, tree, oldroot, undo);
 		if (i > 0)
 		{
 			int j;
 			for (j = i - 1; j >= 0; j--)
 			{
-				make_dirty_below(MSA, tree, mid_nodes[j]);
+				make_dirty_below(MSA, tree, mid_nodes[j], undo);
 			}
 		}
-		make_dirty_below(MSA, tree, src);
+		make_dirty_below(MSA, tree, src, undo);
 	}
-	make_dirty_below(MSA, tree, excess_br);
+	make_dirty_below(MSA, tree, excess_br, undo);
 	if (parents_par != root)
 	{
-		make_dirty_below(MSA, tree, parents_par);
+		make_dirty_below(MSA, tree, parents_par, undo);
 	}
 
-	free(arr);
 	free(mid_nodes);
+} /* end tbr_apply() */
+
+void mutate_tbr(Dataptr restrict MSA, TREESTACK_TREE_NODES *const tree, long root, Undo_log *undo)
+/* make a random change in the topology of the tree tree (of root root) in
+ * place, the change being caused by tree bisection and reconnection (TBR)
+ * rearrangement; record the branches changed in undo, if it is not NULL */
+{
+	long src;	  /* branch to move */
+	long dest;	  /* destination of branch to move */
+	long newroot; /* leaf next to new root of moved subtree */
+
+	tbr_choose(MSA, tree, root, &src, &dest, &newroot);
+	tbr_apply(MSA, tree, root, src, dest, newroot, undo);
+
 } /* end mutate_tbr() */
 
 /* Count total number of nodes of the tbr subtree */
@@ -582,7 +654,7 @@ long lvb_reroot(Dataptr restrict MSA, TREESTACK_TREE_NODES *const BranchArray, c
 	long parnt;					   /* parent of current branch */
 	long sister = UNSET;		   /* sister of current branch */
 	long previous;				   /* previous branch */
-	static long *oldparent = NULL; /* element i was old static parent of i */
+	static thread_local long *oldparent = NULL; /* element i was old static parent of i */
 
 	/* check new root is a leaf but not the current root */
 	lvb_assert(newroot < MSA->n);
@@ -772,29 +844,13 @@ void treecopy(Dataptr restrict MSA, TREESTACK_TREE_NODES *const dest, const TREE
 
 } /* end treecopy() */
 
-void copy_sitestate(Dataptr restrict MSA, Objset *p_sitestate_1)
+void copy_splits(Dataptr restrict MSA, Lvb_bit_length *splits)
+/* copy the split bitsets made by the last call to makesets() to splits,
+ * which must hold nsets * split_words words */
 {
+	memcpy(splits, splits_2, MSA->nsets * MSA->split_words * sizeof(Lvb_bit_length));
 
-	long to_copy;
-	for (long i = 0; i < MSA->nsets; i++)
-	{
-		to_copy = sitestate_2[i].cnt * sizeof(long);
-		if (p_sitestate_1[i].set == NULL)
-		{ // need to alloc memory
-			p_sitestate_1[i].set = (long *)alloc(to_copy, "object set object arrays");
-		}
-		else if (p_sitestate_1[i].cnt != sitestate_2[i].cnt)
-		{
-			p_sitestate_1[i].set = (long *)realloc(p_sitestate_1[i].set, to_copy);
-			if (p_sitestate_1[i].set == NULL)
-			{
-				crash("out of memory: cannot increase allocation for best sitestate %ld elements", to_copy);
-			}
-		}
-		memcpy(p_sitestate_1[i].set, sitestate_2[i].set, to_copy);
-		p_sitestate_1[i].cnt = sitestate_2[i].cnt;
-	}
-}
+} /* end copy_splits() */
 
 void PullRandomTree(Dataptr MSA, TREESTACK_TREE_NODES *const BranchArray)
 /* fill BranchArray with a random tree, where BranchArray[0] is the root; all branches
@@ -1079,6 +1135,137 @@ void SwapTrees(TREESTACK_TREE_NODES **const tree1, long *const root1,
 
 } /* end SwapTrees() */
 
+Undo_log *undo_alloc(Dataptr restrict MSA)
+/* return a new, empty undo log with room for every branch of a tree for
+ * the data MSA */
+{
+	Undo_log *undo; /* return value */
+	long i;			/* loop counter */
+
+	undo = (Undo_log *)alloc(sizeof(Undo_log), "undo log");
+	undo->n = 0;
+	undo->proposal = 0;
+	undo->stamp = (long *)alloc(MSA->numberofpossiblebranches * sizeof(long), "undo log stamps");
+	undo->entry = (long *)alloc(MSA->numberofpossiblebranches * sizeof(long), "undo log entries");
+	undo->branch = (long *)alloc(MSA->numberofpossiblebranches * sizeof(long), "undo log branches");
+	undo->sitestate_saved = (Lvb_bool *)alloc(MSA->numberofpossiblebranches * sizeof(Lvb_bool), "undo log flags");
+	undo->was_dirty = (Lvb_bool *)alloc(MSA->numberofpossiblebranches * sizeof(Lvb_bool), "undo log flags");
+	undo->node = (TREESTACK_TREE_NODES *)alloc(MSA->numberofpossiblebranches * sizeof(TREESTACK_TREE_NODES), "undo log scalars");
+	undo->sitestate = (Lvb_bit_length *)alloc(MSA->numberofpossiblebranches * MSA->bytes, "undo log statesets");
+	for (i = 0; i < MSA->numberofpossiblebranches; i++)
+		undo->stamp[i] = UNSET;
+	return undo;
+
+} /* end undo_alloc() */
+
+void undo_free(Undo_log *undo)
+/* free the undo log undo and everything in it */
+{
+	free(undo->stamp);
+	free(undo->entry);
+	free(undo->branch);
+	free(undo->sitestate_saved);
+	free(undo->was_dirty);
+	free(undo->node);
+	free(undo->sitestate);
+	free(undo);
+
+} /* end undo_free() */
+
+void undo_begin(Undo_log *undo)
+/* start recording a new rearrangement in undo, forgetting the last one */
+{
+	undo->n = 0;
+	undo->proposal++;
+
+} /* end undo_begin() */
+
+void undo_save(Dataptr restrict MSA, Undo_log *undo, const TREESTACK_TREE_NODES *const tree, const long branch)
+/* record the scalars of branch branch of tree in undo, if undo is not
+ * NULL and they are not already recorded for this rearrangement */
+{
+	if ((undo == NULL) || (undo->stamp[branch] == undo->proposal))
+		return;
+	undo->stamp[branch] = undo->proposal;
+	undo->entry[branch] = undo->n;
+	undo->branch[undo->n] = branch;
+	undo->node[undo->n] = tree[branch];
+	undo->sitestate_saved[undo->n] = LVB_FALSE;
+	undo->was_dirty[undo->n] = (tree[branch].sitestate[0] == 0U) ? LVB_TRUE : LVB_FALSE;
+	undo->n++;
+
+} /* end undo_save() */
+
+void undo_save_sitestate(Dataptr restrict MSA, Undo_log *undo, const TREESTACK_TREE_NODES *const tree, const long branch)
+/* as undo_save(), but record the statesets of branch branch too, if they
+ * are not "dirty"; must be called before the statesets or "dirty" mark
+ * change */
+{
+	long e; /* entry for branch */
+
+	if (undo == NULL)
+		return;
+	undo_save(MSA, undo, tree, branch);
+	e = undo->entry[branch];
+	if ((undo->sitestate_saved[e] == LVB_FALSE) && (undo->was_dirty[e] == LVB_FALSE))
+	{
+		memcpy(undo->sitestate + e * MSA->nwords, tree[branch].sitestate, MSA->bytes);
+		undo->sitestate_saved[e] = LVB_TRUE;
+	}
+
+} /* end undo_save_sitestate() */
+
+void undo_commit(Undo_log *undo)
+/* keep the rearrangement recorded in undo */
+{
+	undo->n = 0;
+
+} /* end undo_commit() */
+
+void undo_rollback(Dataptr restrict MSA, Undo_log *undo, TREESTACK_TREE_NODES *const tree)
+/* put every branch recorded in undo back in tree as it was before the
+ * rearrangement, including statesets changed since by getplen() */
+{
+	long e;						   /* current entry */
+	long branch;				   /* current branch */
+	Lvb_bit_length *tmp_sitestate; /* branch's own stateset array */
+
+	for (e = 0; e < undo->n; e++)
+	{
+		branch = undo->branch[e];
+		tmp_sitestate = tree[branch].sitestate;
+		tree[branch] = undo->node[e];
+		tree[branch].sitestate = tmp_sitestate;
+		if (undo->sitestate_saved[e] == LVB_TRUE)
+			memcpy(tree[branch].sitestate, undo->sitestate + e * MSA->nwords, MSA->bytes);
+		else if (undo->was_dirty[e] == LVB_TRUE)
+			tree[branch].sitestate[0] = 0U;
+	}
+	undo->n = 0;
+
+} /* end undo_rollback() */
+
+void undo_copy(Dataptr restrict MSA, const Undo_log *undo, const TREESTACK_TREE_NODES *const from,
+			   TREESTACK_TREE_NODES *const to)
+/* copy every branch recorded in undo, statesets included, from the tree
+ * in from, where the rearrangement was made, to the tree in to, which must
+ * be as from was before it */
+{
+	long e;						   /* current entry */
+	long branch;				   /* current branch */
+	Lvb_bit_length *tmp_sitestate; /* branch's own stateset array */
+
+	for (e = 0; e < undo->n; e++)
+	{
+		branch = undo->branch[e];
+		tmp_sitestate = to[branch].sitestate;
+		to[branch] = from[branch];
+		to[branch].sitestate = tmp_sitestate;
+		memcpy(to[branch].sitestate, from[branch].sitestate, MSA->bytes);
+	}
+
+} /* end undo_copy() */
+
 void treedump(Dataptr MSA, FILE *const stream, const TREESTACK_TREE_NODES *const tree, Lvb_bool b_with_sitestate)
 /* send tree as table of integers to file pointed to by stream */
 {
@@ -1219,16 +1406,16 @@ void ur_print(Dataptr MSA, FILE *const stream, const TREESTACK_TREE_NODES *const
 
 } /* end ur_print() */
 
-long TopologyComparison(Dataptr MSA, Objset *sitestate_1, const TREESTACK_TREE_NODES *const tree_2, Lvb_bool b_First)
-/* return 0 if the topology of tree_1 (of root root_1) is the same as
- * that of tree_2 (of root root_2), or non-zero if different */
+long TopologyComparison(Dataptr MSA, const Lvb_bit_length *const splits_1, const TREESTACK_TREE_NODES *const tree_2, Lvb_bool b_First)
+/* return 0 if the tree whose splits are splits_1 has the same topology
+ * as tree_2 (of root zero), or non-zero if different; tree_2's splits
+ * are only made afresh if b_First is LVB_TRUE */
 {
-	//	b_First = LVB_TRUE;
 	if (b_First == LVB_TRUE)
 	{
 		makesets(MSA, tree_2, 0 /* always root zero */);
 	}
-	return setstcmp(MSA, sitestate_1, sitestate_2, b_First /* this one is the static */);
+	return splitscmp(MSA, splits_1);
 } /* end TopologyComparison() */
 
 long setstcmp(Dataptr MSA, Objset *const oset_1, Objset *const oset_2, Lvb_bool b_First) /* this one is the static */
@@ -1248,28 +1435,27 @@ long setstcmp(Dataptr MSA, Objset *const oset_1, Objset *const oset_2, Lvb_bool
 	return 0;
 } /* end setstcmp() */
 
-long setstcmp_with_sitestate2(Dataptr MSA, Objset *const oset_1)
-/* return 0 if the same sets of objects are in oset_1 and oset_2,
- * and non-zero otherwise */
+long splitscmp(Dataptr MSA, const Lvb_bit_length *const splits_1)
+/* return 0 if splits_1 holds the same splits as made by the last call to
+ * makesets(), and non-zero otherwise; both are sorted, so one block
+ * comparison decides */
 {
-	long i; /* loop counter */
-
-	for (i = 0; i < MSA->nsets; i++)
-	{
-		if (oset_1[i].cnt != sitestate_2[i].cnt)
-			return 1;
-		if (memcmp(oset_1[i].set, sitestate_2[i].set, sizeof(long) * oset_1[i].cnt) != 0)
-			return 1;
-	}
-	return 0;
-} /* end setstcmp() */
+	return memcmp(splits_1, splits_2, MSA->nsets * MSA->split_words * sizeof(Lvb_bit_length)) != 0;
+} /* end splitscmp() */
 
 void dump_stack_to_screen(Dataptr MSA, TREESTACK *sp)
 {
 	for (int i = 0; i < sp->next; i++)
 	{
 		printf("Stack number: %d\n", i);
-		dump_objset_to_screen(MSA, sp->stack[i].p_sitestate);
+		for (long j = 0; j < MSA->nsets; j++)
+		{
+			printf("%ld   ", j);
+			for (long w = MSA->split_words - 1; w >= 0; w--)
+				printf("%016llx", (unsigned long long)sp->stack[i].splits[j * MSA->split_words + w]);
+			printf("\n");
+		}
+		printf("\n");
 	}
 }
 
@@ -1389,23 +1575,189 @@ int osetcmp(const void *oset1, const void *oset2)
 
 } /* end osetcmp() */
 
-void makesets(Dataptr MSA, const TREESTACK_TREE_NODES *const tree_2, const long root)
-/* fill static sitestate_1 and static sitestate_2 with arrays of object sets for
- * tree_1 and tree_2 (of root_1 and root_2 respectively), and return
- * the extent of each array;
- * the trees must have the same object in the root branch;
- * arrays will be overwritten on subsequent calls */
+static long splitcmp_words; /* words per split, for splitcmp() */
+
+static int splitcmp(const void *split1, const void *split2)
+/* comparison function for split bitsets of splitcmp_words words: order by
+ * the highest differing word */
 {
-	if (sitestate_2[0].set == NULL)
-	{ /* first call, allocate memory  to the static sitestate_2*/
-		ssarralloc(MSA, sitestate_2);
+	const Lvb_bit_length *lsplit_1 = (const Lvb_bit_length *)split1; /* typed */
+	const Lvb_bit_length *lsplit_2 = (const Lvb_bit_length *)split2; /* typed */
+
+	for (long w = splitcmp_words - 1; w >= 0; w--)
+	{
+		if (lsplit_1[w] < lsplit_2[w])
+			return -1;
+		else if (lsplit_1[w] > lsplit_2[w])
+			return +1;
 	}
+	return 0;
 
-	fillsets(MSA, sitestate_2, tree_2, root);
-	Sort(MSA, sitestate_2, MSA->nsets);
+} /* end splitcmp() */
+
+static void fillsplits(Dataptr MSA, const TREESTACK_TREE_NODES *const tree, const long branch,
+					   Lvb_bit_length *const clade, long *const p_next)
+/* add the objects in the clade at branch to the bitset clade (if not NULL);
+ * if branch is interior, also write its own clade's bitset to the next free
+ * split of splits_2 */
+{
+	Lvb_bit_length *split; /* this branch's split */
+
+	if (branch < MSA->n)
+	{
+		clade[branch / NUMBER_OF_BITS] |= (Lvb_bit_length)1 << (branch % NUMBER_OF_BITS);
+		return;
+	}
+
+	lvb_assert(*p_next < MSA->nsets);
+	split = splits_2 + (*p_next)++ * MSA->split_words;
+	memset(split, 0, MSA->split_words * sizeof(Lvb_bit_length));
+	fillsplits(MSA, tree, tree[branch].left, split, p_next);
+	fillsplits(MSA, tree, tree[branch].right, split, p_next);
+	if (clade != NULL)
+		for (long w = 0; w < MSA->split_words; w++)
+			clade[w] |= split[w];
+
+} /* end fillsplits() */
+
+static void makesplits(Dataptr MSA, const TREESTACK_TREE_NODES *const tree_2, const long root)
+/* fill static splits_2 with the sorted split bitsets of tree_2: one per
+ * interior branch, each the set of objects descended from it as seen from
+ * root; sorting makes the result the same for all drawings of a topology */
+{
+	long next = 0; /* next split to fill */
+
+	if (splits_2 == NULL)
+		splits_2 = (Lvb_bit_length *)alloc(MSA->nsets * MSA->split_words * sizeof(Lvb_bit_length), "split bitsets");
+
+	if (tree_2[root].left >= MSA->n) /* interior */
+		fillsplits(MSA, tree_2, tree_2[root].left, NULL, &next);
+	if (tree_2[root].right >= MSA->n) /* interior */
+		fillsplits(MSA, tree_2, tree_2[root].right, NULL, &next);
+	lvb_assert(next == MSA->nsets);
+
+	splitcmp_words = MSA->split_words;
+	qsort(splits_2, (size_t)MSA->nsets, MSA->split_words * sizeof(Lvb_bit_length), splitcmp);
+
+} /* end makesplits() */
+
+void makesets(Dataptr MSA, const TREESTACK_TREE_NODES *const tree_2, const long root)
+/* fill static splits_2 with the sorted split bitsets of tree_2 (of root
+ * root), for comparison with splitscmp() or copying with copy_splits();
+ * the trees compared must have the same object in the root branch;
+ * splits will be overwritten on subsequent calls */
+{
+	makesplits(MSA, tree_2, root);
 
 } /* end makesets() */
 
+/* fixed Philox key for the random keys of objects, so that fingerprints
+ * do not depend on the seed or use up any random numbers */
+static const uint32_t FINGERPRINT_PHILOX_KEY[2] = {0x4c564246U, 0x50524e54U};
+
+static Lvb_fingerprint fingerprint_add(Lvb_fingerprint a, const Lvb_fingerprint b)
+/* return a + b, each half modulo 2^64 */
+{
+	a.lo += b.lo;
+	a.hi += b.hi;
+	return a;
+} /* end fingerprint_add() */
+
+static uint64_t fingerprint_fmix(uint64_t x)
+/* return x with its bits well mixed (MurmurHash3 finaliser) */
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+} /* end fingerprint_fmix() */
+
+static Lvb_fingerprint fingerprint_mix(const Lvb_fingerprint sum)
+/* return a 128-bit hash of the key sum sum of one side of a split */
+{
+	Lvb_fingerprint h; /* return value */
+
+	h.lo = fingerprint_fmix(sum.lo ^ fingerprint_fmix(sum.hi + 0x9e3779b97f4a7c15ULL));
+	h.hi = fingerprint_fmix(sum.hi ^ fingerprint_fmix(sum.lo + 0xbf58476d1ce4e5b9ULL));
+	return h;
+} /* end fingerprint_mix() */
+
+Lvb_fingerprint TreeFingerprint(Dataptr MSA, const TREESTACK_TREE_NODES *const BranchArray, const long root)
+/* return the topology fingerprint of the tree in BranchArray (of root
+ * root): the sum, over its internal branches, of a hash of the split the
+ * branch makes, where each side of a split is summarised by the sum of
+ * random 128-bit keys of its objects; the same for every rooting and
+ * drawing of a topology, and different for two topologies with
+ * probability close to 1 - 2^-128; each thread has scratch space of its
+ * own, so threads may call it at once */
+{
+	static thread_local long n = 0;                      /* objects keys are made for */
+	static thread_local Lvb_fingerprint *key = NULL;     /* by object: random key */
+	static thread_local Lvb_fingerprint total;           /* sum of all keys */
+	static thread_local long *p_todo_arr = NULL;         /* branches, parents first */
+	static thread_local Lvb_fingerprint *p_clade = NULL; /* by branch: sum of keys of its clade */
+	Lvb_fingerprint fingerprint = {0, 0};   /* return value */
+	Lvb_fingerprint other;                  /* sum of keys on the far side */
+	long n_todo = 0;                        /* branches on p_todo_arr */
+	long branch;                            /* current branch */
+	long i;                                 /* loop counter */
+	uint32_t ctr[4] = {0, 0, 0, 0};         /* Philox counter */
+	uint32_t out[4];                        /* Philox output */
+
+	/* allocate "local" static heap memory - static - do not free! */
+	if (n != MSA->n)
+	{
+		free(key);
+		free(p_todo_arr);
+		free(p_clade);
+		key = (Lvb_fingerprint *)alloc(MSA->n * sizeof(Lvb_fingerprint), "fingerprint keys");
+		p_todo_arr = (long *)alloc(MSA->numberofpossiblebranches * sizeof(long), "branch list");
+		p_clade = (Lvb_fingerprint *)alloc(MSA->numberofpossiblebranches * sizeof(Lvb_fingerprint), "clade key sums");
+		total.lo = total.hi = 0;
+		for (i = 0; i < MSA->n; i++)
+		{
+			ctr[0] = (uint32_t)i;
+			philox4x32(FINGERPRINT_PHILOX_KEY, ctr, out);
+			key[i].lo = ((uint64_t)out[1] << 32) | out[0];
+			key[i].hi = ((uint64_t)out[3] << 32) | out[2];
+			total = fingerprint_add(total, key[i]);
+		}
+		n = MSA->n;
+	}
+
+	/* list the branches parents first, then sum their clades children first;
+   * each side of a split is hashed, so it does not matter which side the
+   * root is on */
+	p_todo_arr[n_todo++] = BranchArray[root].left;
+	p_todo_arr[n_todo++] = BranchArray[root].right;
+	for (i = 0; i < n_todo; i++)
+	{
+		branch = p_todo_arr[i];
+		if (branch >= MSA->n)
+		{
+			p_todo_arr[n_todo++] = BranchArray[branch].left;
+			p_todo_arr[n_todo++] = BranchArray[branch].right;
+		}
+	}
+	for (i = n_todo - 1; i >= 0; i--)
+	{
+		branch = p_todo_arr[i];
+		if (branch < MSA->n)
+			p_clade[branch] = key[branch];
+		else
+		{
+			p_clade[branch] = fingerprint_add(p_clade[BranchArray[branch].left], p_clade[BranchArray[branch].right]);
+			other.lo = total.lo - p_clade[branch].lo;
+			other.hi = total.hi - p_clade[branch].hi;
+			fingerprint = fingerprint_add(fingerprint, fingerprint_mix(p_clade[branch]));
+			fingerprint = fingerprint_add(fingerprint, fingerprint_mix(other));
+		}
+	}
+	return fingerprint;
+} /* end TreeFingerprint() */
+
 void ssarralloc(Dataptr MSA, Objset *nobjset_2)
 /* Fill nobjset[0..nsets-1] with pointers each pointing to newly
  * allocated space for setsize objects; assumes nobjset points to the
@@ -1512,35 +1864,4 @@ void ss_init(Dataptr MSA, TREESTACK_TREE_NODES *tree, Lvb_bit_length **enc_mat)
 
 } /* end ss_init() */
 
-std::string MakeHashSet(Dataptr MSA, const TREESTACK_TREE_NODES *const tree_2, const long root)
-/* fill static sitestate_2 with arrays of object sets for
- * tree_2, and return sitestate_2 string
- * arrays and strings overwritten on subsequent calls */
-{
-	if (sitestate_2[0].set == NULL)
-	{ /* first call, allocate memory  to the static sitestate_2*/
-		ssarralloc(MSA, sitestate_2);
-	}
-
-	fillsets(MSA, sitestate_2, tree_2, root);
-	Sort(MSA, sitestate_2, MSA->nsets);
-	// dump_objset_to_file(MSA, sitestate_2);
-
-	return ConvertSiteSetToString(MSA, sitestate_2);
-} /* end MakeHashSet() */
-
-/* convert sset to string  */
-std::string ConvertSiteSetToString(Dataptr MSA, Objset *oset_1)
-{
-	std::ostringstream os;
-	for (int i = 0; i < MSA->nsets; i++)
-	{
-		os << i << "    " << oset_1[i].cnt << "    ";
-		for (int x = 0; x < oset_1[i].cnt; x++)
-			os << oset_1[i].set[x] << "   ";
-		os << std::endl;
-	}
 
-	std::string sitesetstr(os.str());
-	return sitesetstr;
-}
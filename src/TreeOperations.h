@@ -55,6 +55,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* object sets for tree comparison */
 Objset sitestate_2[MAX_N - 3] = {{NULL, 0}};
 
+/* split bitsets for tree comparison, nsets of split_words words each */
+Lvb_bit_length *splits_2 = NULL;
+
 void cr_bpnc(const TREESTACK_TREE_NODES *const BranchArray, const long branch);
 void cr_chaf(const TREESTACK_TREE_NODES *const BranchArray, const long destination, const long newchild);
 void cr_uxe(FILE *const stream, const char *const msg);
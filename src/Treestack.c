@@ -76,36 +76,308 @@ static void TreestackAllocationIncrease(Dataptr restrict MSA, TREESTACK *sp)
         /* sp->stack[i].tree = treealloc(MSA->n); */
         sp->stack[i].tree = treealloc(MSA, LVB_FALSE);
         sp->stack[i].root = -1;
+        sp->stack[i].splits = (Lvb_bit_length *)alloc(MSA->nsets * MSA->split_words * sizeof(Lvb_bit_length),
+                                                      "split bitsets");
+    }
+
+} /* end TreestackAllocationIncrease() */
+
+static Lvb_fingerprint entry_fingerprint(const TREESTACK *sp, const long i)
+/* return the fingerprint of tree i of *sp, in memory or in the spill file */
+{
+    return (i < sp->next) ? sp->stack[i].fingerprint : sp->spill->fingerprint[i - sp->next];
+
+} /* end entry_fingerprint() */
+
+static long index_home(const TREESTACK *sp, const Lvb_fingerprint fingerprint)
+/* return the entry of sp's index at which a search for fingerprint starts */
+{
+    return (long)(fingerprint.lo & (uint64_t)(sp->index_size - 1));
+
+} /* end index_home() */
+
+static void index_insert(TREESTACK *sp, const long i)
+/* enter tree i of *sp in its index, which must have room */
+{
+    long pos = index_home(sp, entry_fingerprint(sp, i)); /* entry of index */
 
-        int j;
-        /* set memory for sitestate */
-        sp->stack[sp->next].p_sitestate = (Objset *)alloc(MSA->nsets * sizeof(Objset), "object set object arrays");
-        for (j = 0; j < MSA->nsets; j++)
+    while (sp->index[pos] != -1)
+        pos = (pos + 1) & (sp->index_size - 1);
+    sp->index[pos] = i;
+
+} /* end index_insert() */
+
+static void index_remove(TREESTACK *sp, const long i)
+/* take tree i of *sp out of its index, moving back later entries of the
+ * same run that would otherwise no longer be found */
+{
+    const long mask = sp->index_size - 1; /* for wrapping round */
+    long pos = index_home(sp, entry_fingerprint(sp, i));  /* hole */
+    long next;                                            /* entry after hole */
+    long home;                                            /* where its tree belongs */
+
+    while (sp->index[pos] != i)
+        pos = (pos + 1) & mask;
+    sp->index[pos] = -1;
+    for (next = (pos + 1) & mask; sp->index[next] != -1; next = (next + 1) & mask)
+    {
+        home = index_home(sp, entry_fingerprint(sp, sp->index[next]));
+        if (((next - home) & mask) >= ((next - pos) & mask)) /* home not after hole */
         {
-            sp->stack[sp->next].p_sitestate[j].set = NULL; // alloc(to_copy, "object set object arrays");
-            sp->stack[sp->next].p_sitestate[j].cnt = UNSET;
+            sp->index[pos] = sp->index[next];
+            sp->index[next] = -1;
+            pos = next;
         }
     }
 
-} /* end TreestackAllocationIncrease() */
+} /* end index_remove() */
 
-long PushCurrentTreeToStack(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NODES *const BranchArray, const long root, Lvb_bool b_with_sitestate)
-/* push tree in BranchArray (of root root) on to stack *sp */
+static void index_reserve(TREESTACK *sp, const long trees)
+/* make the index of *sp at least twice as big as trees, so searches stay
+ * short, re-entering the trees on it if it has to grow */
+{
+    long size = (sp->index_size > 0) ? sp->index_size : TREESTACK_INDEX_MIN; /* new size */
+
+    while (size < 2 * trees)
+        size *= 2;
+    if (size == sp->index_size)
+        return;
+    if (sp->index != NULL)
+        free(sp->index);
+    sp->index = (long *)alloc(size * sizeof(long), "tree stack index");
+    sp->index_size = size;
+    ReindexTreestack(sp);
+
+} /* end index_reserve() */
+
+static void tree_splits(Dataptr MSA, const TREESTACK_TREE_NODES *const BranchArray, const long root)
+/* make the splits of the tree in BranchArray (of root root) with
+ * makesets(), from a copy rooted at object zero */
+{
+    static TREESTACK_TREE_NODES *copy_2 = NULL; /* possibly re-rooted tree */
+
+    /* allocate "local" static heap memory - static - do not free! */
+    if (copy_2 == NULL)
+        copy_2 = treealloc(MSA, LVB_FALSE);
+    treecopy(MSA, copy_2, BranchArray, LVB_FALSE);
+    if (root != 0)
+        lvb_reroot(MSA, copy_2, root, 0, LVB_FALSE);
+    makesets(MSA, copy_2, 0);
+
+} /* end tree_splits() */
+
+static long stored(const TREESTACK *sp)
+/* return the number of trees on *sp, in memory and in the spill file */
+{
+    return sp->next + ((sp->spill != NULL) ? sp->spill->n : 0);
+
+} /* end stored() */
+
+static void spill_seek(const TREESTACK *sp, const long j, const long offset)
+/* position the spill file of *sp offset bytes into the record of its tree j */
+{
+    if (fseeko(sp->spill->fp, (off_t)j * sp->spill->record_bytes + offset, SEEK_SET) != 0)
+        crash("cannot seek in best tree spill file '%s'", sp->spill->file_name);
+
+} /* end spill_seek() */
+
+static void spill_write(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NODES *const BranchArray, const long root,
+                        const Lvb_fingerprint fingerprint)
+/* append tree in BranchArray (of root root), of fingerprint fingerprint and
+ * with splits made by the last call to makesets(), to the spill file of
+ * *sp, opening it if need be */
+{
+    Treestack_spill *spill = sp->spill; /* spill file details */
+    long *record = spill->record;       /* next field of record */
+    long i;                             /* loop counter */
+
+    if (spill->fp == NULL)
+    {
+        spill->fp = fopen(spill->file_name, "w+b");
+        if (spill->fp == NULL)
+            crash("cannot open best tree spill file '%s'", spill->file_name);
+    }
+    if (spill->n == spill->size)
+    {
+        spill->size = (spill->size > 0) ? 2 * spill->size : TREESTACK_INDEX_MIN;
+        spill->fingerprint = (Lvb_fingerprint *)realloc(spill->fingerprint, spill->size * sizeof(Lvb_fingerprint));
+        if (spill->fingerprint == NULL)
+            crash("out of memory: cannot increase allocation for best tree spill index to %ld elements", spill->size);
+    }
+
+    *record++ = root;
+    for (i = 0; i < MSA->numberofpossiblebranches; i++)
+    {
+        *record++ = BranchArray[i].parent;
+        *record++ = BranchArray[i].left;
+        *record++ = BranchArray[i].right;
+        *record++ = BranchArray[i].changes;
+        *record++ = BranchArray[i].sum_changes;
+    }
+    copy_splits(MSA, spill->splits);
+    spill_seek(sp, spill->n, 0);
+    if ((fwrite(spill->record, 1, spill->tree_bytes, spill->fp) != (size_t)spill->tree_bytes) ||
+        (fwrite(spill->splits, 1, spill->record_bytes - spill->tree_bytes, spill->fp) !=
+         (size_t)(spill->record_bytes - spill->tree_bytes)))
+        crash("cannot write best tree spill file '%s'", spill->file_name);
+    spill->fingerprint[spill->n++] = fingerprint;
+
+} /* end spill_write() */
+
+static long spill_read_tree(Dataptr MSA, const TREESTACK *sp, const long j, TREESTACK_TREE_NODES *const BranchArray)
+/* copy tree j of the spill file of *sp to BranchArray, leaving its stateset
+ * arrays alone, and return its root */
+{
+    const Treestack_spill *spill = sp->spill; /* spill file details */
+    const long *record = spill->record;       /* next field of record */
+    long root;                                /* return value */
+    long i;                                   /* loop counter */
+
+    spill_seek(sp, j, 0);
+    if (fread(spill->record, 1, spill->tree_bytes, spill->fp) != (size_t)spill->tree_bytes)
+        crash("cannot read best tree spill file '%s'", spill->file_name);
+    root = *record++;
+    for (i = 0; i < MSA->numberofpossiblebranches; i++)
+    {
+        BranchArray[i].parent = *record++;
+        BranchArray[i].left = *record++;
+        BranchArray[i].right = *record++;
+        BranchArray[i].changes = *record++;
+        BranchArray[i].sum_changes = *record++;
+    }
+    return root;
+
+} /* end spill_read_tree() */
+
+static const Lvb_bit_length *spill_read_splits(const TREESTACK *sp, const long j)
+/* return the splits of tree j of the spill file of *sp, valid until the
+ * next call */
 {
+    const Treestack_spill *spill = sp->spill; /* spill file details */
+
+    spill_seek(sp, j, spill->tree_bytes);
+    if (fread(spill->splits, 1, spill->record_bytes - spill->tree_bytes, spill->fp) !=
+        (size_t)(spill->record_bytes - spill->tree_bytes))
+        crash("cannot read best tree spill file '%s'", spill->file_name);
+    return spill->splits;
+
+} /* end spill_read_splits() */
+
+static long treestack_find(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NODES *const BranchArray, const long root,
+                           const Lvb_fingerprint fingerprint, Lvb_bool *p_made_splits)
+/* return the number of the tree on *sp of the same topology as the tree in
+ * BranchArray (of root root), whose fingerprint is fingerprint, or -1 if
+ * there is none; trees of the same fingerprint are compared split by split,
+ * after making the splits of BranchArray if *p_made_splits is LVB_FALSE,
+ * and *p_made_splits is then set to LVB_TRUE */
+{
+    long pos; /* entry of index */
+    long i;   /* tree of stack */
+
+    if (sp->index_size == 0)
+        return -1;
+    for (pos = index_home(sp, fingerprint); sp->index[pos] != -1; pos = (pos + 1) & (sp->index_size - 1))
+    {
+        i = sp->index[pos];
+        if (entry_fingerprint(sp, i) == fingerprint)
+        {
+            if (*p_made_splits == LVB_FALSE)
+            {
+                tree_splits(MSA, BranchArray, root);
+                *p_made_splits = LVB_TRUE;
+            }
+            if (splitscmp(MSA, (i < sp->next) ? sp->stack[i].splits : spill_read_splits(sp, i - sp->next)) == 0)
+                return i;
+        }
+    }
+    return -1;
+
+} /* end treestack_find() */
+
+static void treestack_push(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NODES *const BranchArray, const long root,
+                           Lvb_bool b_with_sitestate, const Lvb_fingerprint fingerprint, Lvb_bool made_splits)
+/* push tree in BranchArray (of root root), of fingerprint fingerprint, on
+ * to stack *sp, or into its spill file once its memory is full, and enter
+ * it in the index; made_splits is LVB_TRUE if makesets() was last called
+ * for this tree */
+{
+    index_reserve(sp, stored(sp) + 1);
+    if (made_splits == LVB_FALSE)
+        tree_splits(MSA, BranchArray, root);
+    if ((sp->spill != NULL) && ((sp->next == sp->spill->max_trees) || (sp->spill->n > 0)))
+    {
+        spill_write(MSA, sp, BranchArray, root, fingerprint);
+        index_insert(sp, stored(sp) - 1);
+        return;
+    }
+
     lvb_assert(sp->next <= sp->size);
     if (sp->next == sp->size)
         TreestackAllocationIncrease(MSA, sp);
     treecopy(MSA, sp->stack[sp->next].tree, BranchArray, b_with_sitestate);
     sp->stack[sp->next].root = root;
-
-    /* need to copy the sitestate_2 to the sp->stack[sp->next].sitestate  */
-    copy_sitestate(MSA, sp->stack[sp->next].p_sitestate);
+    copy_splits(MSA, sp->stack[sp->next].splits);
+    sp->stack[sp->next].fingerprint = fingerprint;
     sp->next++;
+    index_insert(sp, sp->next - 1);
+
+} /* end treestack_push() */
+
+static void sample_push(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NODES *const BranchArray, const long root,
+                        Lvb_bool b_with_sitestate, const Lvb_fingerprint fingerprint, Lvb_bool made_splits)
+/* offer tree in BranchArray (of root root), of fingerprint fingerprint and
+ * not found before, to the random sample kept on stack *sp, so that every
+ * tree found is equally likely to be kept (reservoir sampling, Vitter's
+ * algorithm R); made_splits is as for treestack_push() */
+{
+    Treestack_sample *sample = sp->sample; /* sample details */
+    long found = sp->next + (long)sample->dropped->size() + 1; /* trees found, this one included */
+    long i;                                                    /* tree it replaces */
+
+    if (sp->next < sample->max_trees)
+    {
+        treestack_push(MSA, sp, BranchArray, root, b_with_sitestate, fingerprint, made_splits);
+        return;
+    }
+
+    i = (long)(rng_uni(sample->rng) * found);
+    if (i >= sample->max_trees) /* not kept */
+    {
+        sample->dropped->insert(fingerprint);
+        return;
+    }
+    sample->dropped->insert(sp->stack[i].fingerprint);
+    index_remove(sp, i);
+    sp->changes++;
+    treecopy(MSA, sp->stack[i].tree, BranchArray, b_with_sitestate);
+    sp->stack[i].root = root;
+    if (made_splits == LVB_FALSE)
+        tree_splits(MSA, BranchArray, root);
+    copy_splits(MSA, sp->stack[i].splits);
+    sp->stack[i].fingerprint = fingerprint;
+    index_insert(sp, i);
+
+} /* end sample_push() */
+
+long PushCurrentTreeToStack(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NODES *const BranchArray, const long root, Lvb_bool b_with_sitestate)
+/* push tree in BranchArray (of root root) on to stack *sp, whether or not
+ * its topology is there already */
+{
+    treestack_push(MSA, sp, BranchArray, root, b_with_sitestate, TreeFingerprint(MSA, BranchArray, root), LVB_FALSE);
 
     return 1;
 
 } /* end PushCurrentTreeToStack() */
 
+void PushFingerprintedTreeToStack(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NODES *const BranchArray, const long root,
+                                  const Lvb_fingerprint fingerprint)
+/* as PushCurrentTreeToStack() without site states, for a tree whose
+ * fingerprint, from TreeFingerprint(), is fingerprint */
+{
+    treestack_push(MSA, sp, BranchArray, root, LVB_FALSE, fingerprint, LVB_FALSE);
+
+} /* end PushFingerprintedTreeToStack() */
+
 /**********
 
 =head1 CountTreestack - RETURN COUNT OF TREES ON STACK
@@ -116,7 +388,8 @@ long CountTreestack(TREESTACK s);
 
 =head2 DESCRIPTION
 
-Return the number of trees currently stored on the stack C<s>.
+Return the number of trees currently stored on the stack C<s>, in
+memory and in its spill file.
 
 =head2 PARAMETERS
 
@@ -140,10 +413,18 @@ Returns number of trees on stack C<s>.
 
 long CountTreestack(TREESTACK s)
 {
-    return s.next;
+    return stored(&s);
 
 } /* end CountTreestack() */
 
+long CountTreestackFound(TREESTACK s)
+/* return the number of distinct trees found for stack s since it was last
+ * cleared, whether kept in its random sample or not */
+{
+    return stored(&s) + ((s.sample != NULL) ? (long)s.sample->dropped->size() : 0);
+
+} /* end CountTreestackFound() */
+
 /**********
 
 =head1 CreateNewTreestack - RETURN A NEW TREE STACK
@@ -175,6 +456,11 @@ TREESTACK CreateNewTreestack(void)
     s.size = 0;
     s.next = 0;
     s.stack = NULL;
+    s.index = NULL;
+    s.index_size = 0;
+    s.spill = NULL;
+    s.sample = NULL;
+    s.changes = 0;
     return s;
 
 } /* end CreateNewTreestack() */
@@ -191,8 +477,15 @@ TREESTACK CreateNewTreestack(void)
 =head2 DESCRIPTION
 
 Push copy of a tree onto an existing tree stack. Will not push if its
-topology is already present on the stack. The stack will increase its
-own memory allocation if necessary.
+topology is already present on the stack, which is found through the
+stack's index of topology fingerprints, so the time taken does not grow
+with the number of trees on the stack. The stack will increase its own
+memory allocation if necessary.
+
+If the stack keeps a random sample of trees (see TreestackSample()), a
+new topology may instead replace a tree on the stack or be left out; it
+counts as pushed either way. A topology found before but left out is
+recognised by its fingerprint alone.
 
 =head2 PARAMETERS
 
@@ -230,76 +523,21 @@ Returns 1 if the tree was pushed, or 0 if not.
 
 long CompareTreeToTreestack(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NODES *const BranchArray, const long root, Lvb_bool b_with_sitestate)
 {
-#define MIN_THREAD_SEARCH_SSET 5
-
-    long i, slice, slice_tail, new_root = 0;
-    static TREESTACK_TREE_NODES *copy_2 = NULL; /* possibly re-rooted tree 2 */
-    Lvb_bool b_First = LVB_TRUE;
-    Lvb_bool b_find_sset = LVB_FALSE;
-
-    /* allocate "local" static heap memory - static - do not free! */
-    if (copy_2 == NULL)
-        copy_2 = treealloc(MSA, b_with_sitestate);
-    treecopy(MSA, copy_2, BranchArray, b_with_sitestate);
-    if (root != 0)
-    {
-        lvb_reroot(MSA, copy_2, root, new_root, b_with_sitestate);
-    }
+    const Lvb_fingerprint fingerprint = TreeFingerprint(MSA, BranchArray, root); /* of topology */
+    Lvb_bool made_splits = LVB_FALSE; /* splits of tree made */
 
     /* return before push if not a new topology */
-    /* check backwards as similar trees may be discovered together */
-
-    if (sp->next == 0)
-    {
-        makesets(MSA, copy_2, new_root /* always root zero */);
-    }
-    else
-    {
-        if (sp->next > MIN_THREAD_SEARCH_SSET)
-            slice = sp->next / MSA->n_threads_getplen;
-        if (sp->next > MIN_THREAD_SEARCH_SSET && slice > 0)
-        {
-            makesets(MSA, copy_2, 0 /* always root zero */);
-            slice_tail = (sp->next - (slice * MSA->n_threads_getplen));
-            omp_set_dynamic(0); /* disable dinamic threathing */
-#pragma omp parallel num_threads(MSA->n_threads_getplen) private(i) shared(slice, slice_tail, b_find_sset)
-            {
-                int n_count = 0;
-                int n_end = slice * (omp_get_thread_num() + 1);
-                int n_begin = slice * omp_get_thread_num();
-                if (MSA->n_threads_getplen == (omp_get_thread_num() + 1))
-                    n_end += slice_tail;
-                for (i = n_begin; i < n_end; i++)
-                {
-                    if (setstcmp_with_sitestate2(MSA, sp->stack[i].p_sitestate) == 0)
-                    {
-                        b_find_sset = LVB_TRUE;
-                        break;
-                    }
-                    if (n_count > 0 && (n_count % 20) == 0 && b_find_sset == LVB_TRUE)
-                    {
-                        break;
-                    }
-                    n_count += 1;
-                }
-            }
-            if (b_find_sset == LVB_TRUE)
-                return 0;
-        }
-        else
-        {
-            for (i = sp->next - 1; i >= 0; i--)
-            {
-                if (TopologyComparison(MSA, sp->stack[i].p_sitestate, copy_2, b_First) == 0)
-                    return 0; // If trees are the same, return 0
-                b_First = LVB_FALSE;
-            }
-        }
-    }
+    if (treestack_find(MSA, sp, BranchArray, root, fingerprint, &made_splits) >= 0)
+        return 0;
+    if ((sp->sample != NULL) && (sp->sample->dropped->count(fingerprint) > 0))
+        return 0;
 
     /* topology is new so must be pushed */
     lvb_assert(root < MSA->n);
-    PushCurrentTreeToStack(MSA, sp, BranchArray, root, b_with_sitestate);
+    if (sp->sample != NULL)
+        sample_push(MSA, sp, BranchArray, root, b_with_sitestate, fingerprint, made_splits);
+    else
+        treestack_push(MSA, sp, BranchArray, root, b_with_sitestate, fingerprint, made_splits);
 
     return 1;
 
@@ -307,6 +545,142 @@ long CompareTreeToTreestack(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NOD
 
 /**********
 
+=head1 FindTreeInTreestack - FIND TOPOLOGY ON TREE STACK
+
+=head2 SYNOPSIS
+
+    long FindTreeInTreestack(Dataptr MSA, TREESTACK *sp,
+    const TREESTACK_TREE_NODES *const BranchArray, const long root);
+
+=head2 DESCRIPTION
+
+Look for a tree of the same topology as a given tree on a tree stack,
+through the stack's index of topology fingerprints. Trees of the same
+fingerprint are compared split by split, so a match is exact.
+
+=head2 PARAMETERS
+
+=head3 INPUT
+
+=over 4
+
+=item BranchArray
+
+Pointer to first element of array containing tree to be looked for.
+
+=item root
+
+Root branch number of tree to be looked for.
+
+=item sp
+
+Pointer to tree stack to be searched.
+
+=back
+
+=head2 RETURN
+
+Returns the number of the matching tree on the stack, or -1 if there is
+none.
+
+=cut
+
+**********/
+
+long FindTreeInTreestack(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NODES *const BranchArray, const long root)
+{
+    Lvb_bool made_splits = LVB_FALSE; /* splits of tree made */
+
+    return treestack_find(MSA, sp, BranchArray, root, TreeFingerprint(MSA, BranchArray, root), &made_splits);
+
+} /* end FindTreeInTreestack() */
+
+long FindFingerprintedTreeInTreestack(Dataptr MSA, TREESTACK *sp, const TREESTACK_TREE_NODES *const BranchArray,
+                                      const long root, const Lvb_fingerprint fingerprint)
+/* as FindTreeInTreestack(), for a tree whose fingerprint, from
+ * TreeFingerprint(), is fingerprint */
+{
+    Lvb_bool made_splits = LVB_FALSE; /* splits of tree made */
+
+    return treestack_find(MSA, sp, BranchArray, root, fingerprint, &made_splits);
+
+} /* end FindFingerprintedTreeInTreestack() */
+
+void TreestackLimitMemory(Dataptr MSA, TREESTACK *sp, const long bytes, const char *file_name)
+/* keep no more than about bytes of the trees of the empty stack *sp in
+ * memory, and put any further trees in file file_name, which is removed
+ * when the stack is freed; the index of all trees stays in memory */
+{
+    Treestack_spill *spill; /* spill file details */
+    long splits_bytes = MSA->nsets * MSA->split_words * sizeof(Lvb_bit_length); /* per tree */
+    long tree_bytes = sizeof(TREESTACK_TREES) + MSA->tree_bytes_without_sitestate + splits_bytes +
+                      2 * sizeof(long); /* per tree in memory, index included */
+
+    lvb_assert((sp->next == 0) && (sp->spill == NULL));
+    spill = (Treestack_spill *)alloc(sizeof(Treestack_spill), "best tree spill details");
+    spill->max_trees = (bytes / tree_bytes > 0) ? bytes / tree_bytes : 1;
+    spill->file_name = (char *)alloc(strlen(file_name) + 1, "best tree spill file name");
+    strcpy(spill->file_name, file_name);
+    spill->fp = NULL;
+    spill->n = 0;
+    spill->size = 0;
+    spill->fingerprint = NULL;
+    spill->tree_bytes = (1 + 5 * MSA->numberofpossiblebranches) * sizeof(long);
+    spill->record_bytes = spill->tree_bytes + splits_bytes;
+    spill->record = (long *)alloc(spill->tree_bytes, "best tree spill record");
+    spill->splits = (Lvb_bit_length *)alloc(splits_bytes, "best tree spill splits");
+    sp->spill = spill;
+
+} /* end TreestackLimitMemory() */
+
+long GetTreeFromTreestack(Dataptr MSA, const TREESTACK *sp, const long i, TREESTACK_TREE_NODES *const BranchArray)
+/* copy tree i of stack *sp, counting trees in memory first and then those
+ * in its spill file, to BranchArray, leaving its stateset arrays alone, and
+ * return its root */
+{
+    lvb_assert((i >= 0) && (i < stored(sp)));
+    if (i >= sp->next)
+        return spill_read_tree(MSA, sp, i - sp->next, BranchArray);
+    treecopy(MSA, BranchArray, sp->stack[i].tree, LVB_FALSE);
+    return sp->stack[i].root;
+
+} /* end GetTreeFromTreestack() */
+
+void TreestackSample(TREESTACK *sp, const long max_trees, const Rng *rng)
+/* keep no more than max_trees of the trees pushed on the empty stack *sp
+ * with CompareTreeToTreestack() since it was last cleared, chosen at random
+ * with generator *rng so all are equally likely to be kept, while still
+ * counting every distinct tree found; the fingerprint of every tree left
+ * out is kept to know it again, so memory still grows, if slowly, with
+ * the number of distinct trees found */
+{
+    Treestack_sample *sample; /* sample details */
+
+    lvb_assert((sp->next == 0) && (sp->sample == NULL) && (max_trees > 0));
+    sample = (Treestack_sample *)alloc(sizeof(Treestack_sample), "best tree sample details");
+    sample->max_trees = max_trees;
+    sample->rng = (Rng *)alloc(sizeof(Rng), "best tree sample random number generator");
+    *sample->rng = *rng;
+    sample->dropped = new Fingerprint_set;
+    sp->sample = sample;
+
+} /* end TreestackSample() */
+
+void ReindexTreestack(TREESTACK *sp)
+/* make the index of stack *sp afresh, as needed if its trees are moved */
+{
+    long i; /* loop counter */
+
+    for (i = 0; i < sp->index_size; i++)
+        sp->index[i] = -1;
+    for (i = 0; i < stored(sp); i++)
+        index_insert(sp, i);
+    sp->changes++;
+
+} /* end ReindexTreestack() */
+
+/**********
+
 =head1 PullTreefromTreestack - POP TREE OFF TREE STACK
 
 =head2 SYNOPSIS
@@ -356,8 +730,17 @@ long PullTreefromTreestack(Dataptr MSA, TREESTACK_TREE_NODES *BranchArray, long
 {
     long val; /* return value */
 
-    if (sp->next >= 1)
+    sp->changes++;
+    if ((sp->spill != NULL) && (sp->spill->n > 0)) /* latest tree is in file */
     {
+        index_remove(sp, stored(sp) - 1);
+        *root = spill_read_tree(MSA, sp, sp->spill->n - 1, BranchArray);
+        sp->spill->n--;
+        val = 1;
+    }
+    else if (sp->next >= 1)
+    {
+        index_remove(sp, sp->next - 1);
         sp->next--;
         treecopy(MSA, BranchArray, sp->stack[sp->next].tree, b_with_sitestate);
         *root = sp->stack[sp->next].root;
@@ -387,20 +770,21 @@ int PrintTreestack(Dataptr MSA, TREESTACK *sp, FILE *const outfp, Lvb_bool onera
 
     if (onerandom == LVB_TRUE) /* choose one random tree to print */
     {
-        lower = randpint(sp->next - 1);
+        lower = randpint(stored(sp) - 1);
         upper = lower + 1;
     }
     else
     {
         lower = 0;
-        upper = sp->next;
+        upper = stored(sp);
     }
 
+    /* trees in the spill file are read one at a time */
     for (i = lower; i < upper; i++)
     {
-        treecopy(MSA, BranchArray, sp->stack[i].tree, LVB_FALSE);
-        if (sp->stack[i].root != d_obj1)
-            lvb_reroot(MSA, BranchArray, sp->stack[i].root, d_obj1, LVB_FALSE);
+        root = GetTreeFromTreestack(MSA, sp, i, BranchArray);
+        if (root != d_obj1)
+            lvb_reroot(MSA, BranchArray, root, d_obj1, LVB_FALSE);
         root = d_obj1;
         lvb_treeprint(MSA, outfp, BranchArray, root);
     }
@@ -457,23 +841,39 @@ void FreeTreestackMemory(Dataptr restrict MSA, TREESTACK *sp)
             free(sp->stack[i].tree);
         sp->stack[i].tree = NULL;
         sp->stack[i].root = -1;
-
-        int j;
-        if (sp->stack[i].p_sitestate != NULL)
+        if (sp->stack[i].splits != NULL)
+            free(sp->stack[i].splits);
+        sp->stack[i].splits = NULL;
+    }
+    free(sp->stack);
+    if (sp->index != NULL)
+        free(sp->index);
+    if (sp->spill != NULL)
+    {
+        if (sp->spill->fp != NULL)
         {
-            for (j = 0; j < (int)MSA->nsets; j++)
-            {
-                if (sp->stack[i].p_sitestate[j].set != NULL)
-                    free(sp->stack[i].p_sitestate[j].set);
-                sp->stack[i].p_sitestate[j].cnt = UNSET;
-            }
-            free(sp->stack[i].p_sitestate);
+            fclose(sp->spill->fp);
+            remove(sp->spill->file_name);
         }
+        free(sp->spill->file_name);
+        free(sp->spill->fingerprint);
+        free(sp->spill->record);
+        free(sp->spill->splits);
+        free(sp->spill);
+        sp->spill = NULL;
+    }
+    if (sp->sample != NULL)
+    {
+        delete sp->sample->dropped;
+        free(sp->sample->rng);
+        free(sp->sample);
+        sp->sample = NULL;
     }
-    free(sp->stack);
     sp->next = 0;
     sp->size = 0;
     sp->stack = NULL;
+    sp->index = NULL;
+    sp->index_size = 0;
 
 } /* end bstfree() */
 
@@ -514,6 +914,24 @@ None.
 void ClearTreestack(TREESTACK *sp)
 /* clear stack *sp; note its allocation is not changed */
 {
+    long i; /* loop counter */
+
+    /* empty the index entries in use, not the whole index, which may be
+     * much bigger than the stack now is */
+    for (i = 0; i < stored(sp); i++)
+    {
+        long pos = index_home(sp, entry_fingerprint(sp, i)); /* entry of index */
+
+        while (sp->index[pos] != i)
+            pos = (pos + 1) & (sp->index_size - 1);
+        sp->index[pos] = -1;
+    }
+    if (stored(sp) > 0)
+        sp->changes++;
     sp->next = 0; /* clear stack */
+    if (sp->spill != NULL)
+        sp->spill->n = 0; /* file is written over */
+    if (sp->sample != NULL)
+        sp->sample->dropped->clear();
 
 } /* end ClearTreestack() */
@@ -0,0 +1,299 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro and Maximilian Strobl.
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* ========== WorkerPool.c - persistent threads for getplen() ========== */
+
+/*
+
+A fixed set of worker threads, started once, that run the same task
+together each time pool_run() is called. The calling thread takes part as
+thread 0, so a pool of n threads has n - 1 workers.
+
+Work is handed over through two shared words. The caller bumps
+"generation" to start a task, and every worker counts "pending" down when
+it has finished. A thread waiting on either word spins for POOL_SPINS
+rounds first, as the next task usually comes within microseconds, and
+then sleeps on a futex until woken. There is no spinning when the pool has
+more threads than the process has processors. Threads that may be asleep are
+counted, so no system call is made while everyone is spinning. Where the
+system allows it and the process may only use about as many processors
+as the pool has threads, as when a launcher has bound it, worker i is
+pinned to the i'th of those processors. A process free to use many more
+processors is left unpinned, as many such processes on one computer
+would otherwise all pin their workers to the same few processors. The
+caller is never pinned, so that threads it starts later, such as OpenMP
+ones, are not all tied to one processor.
+
+**********/
+
+#include "WorkerPool.h"
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static int pool_size = 1;				/* threads in the pool, including the caller */
+static pthread_t *workers = NULL;		/* worker threads */
+static Pool_task pool_task = NULL;		/* task for the current generation */
+static void *pool_arg = NULL;			/* argument for pool_task */
+static Lvb_bool pool_quit = LVB_FALSE;	/* workers must leave at next generation */
+static int generation = 0;				/* bumped to start each task */
+static int pending = 0;					/* workers yet to finish current task */
+static int sleepers = 0;				/* workers that may be asleep on generation */
+static int caller_asleep = 0;			/* caller may be asleep on pending */
+static long spins = POOL_SPINS;			/* spins before sleeping */
+
+static void futex_wait(int *word, int value)
+/* sleep while *word is value; may return early */
+{
+#ifdef __linux__
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+	if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == value)
+		sched_yield();
+#endif
+
+} /* end futex_wait() */
+
+static void futex_wake(int *word)
+/* wake every thread asleep on word */
+{
+#ifdef __linux__
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+
+} /* end futex_wake() */
+
+static int wait_while(int *word, int value, int *asleep)
+/* return the value of *word once it is no longer value, spinning and then
+ * sleeping; *asleep counts the threads that may be asleep on word */
+{
+	long spin; /* loop counter */
+	int now;   /* current value of *word */
+
+	for (spin = 0; spin < spins; spin++)
+	{
+		now = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+		if (now != value)
+			return now;
+		pool_relax();
+	}
+	for (;;)
+	{
+		__atomic_add_fetch(asleep, 1, __ATOMIC_SEQ_CST);
+		now = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+		if (now == value)
+			futex_wait(word, value);
+		__atomic_sub_fetch(asleep, 1, __ATOMIC_SEQ_CST);
+		now = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+		if (now != value)
+			return now;
+	}
+
+} /* end wait_while() */
+
+static int usable_processors(void)
+/* return the number of processors this process may use, or 0 if unknown */
+{
+#if defined(__linux__) && defined(CPU_SET)
+	cpu_set_t allowed; /* processors this process may use */
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+		return CPU_COUNT(&allowed);
+#endif
+	return 0;
+
+} /* end usable_processors() */
+
+static void pin_thread(pthread_t thread, int index, int n_threads)
+/* pin thread to the index'th processor this process may use, if any, and
+ * if the process may use fewer than twice n_threads processors */
+{
+#if defined(__linux__) && defined(CPU_SET)
+	cpu_set_t allowed; /* processors this process may use */
+	cpu_set_t mine;	   /* processor for this thread */
+	int cpu;		   /* loop counter */
+	int n_allowed;	   /* processors this process may use */
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+		return;
+	n_allowed = CPU_COUNT(&allowed);
+	if (n_allowed < 2)
+		return; /* nothing to gain */
+	if (n_allowed >= 2 * n_threads)
+		return; /* not bound by a launcher, so maybe one of many processes */
+	index %= n_allowed;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		if (CPU_ISSET(cpu, &allowed) && (index-- == 0))
+		{
+			CPU_ZERO(&mine);
+			CPU_SET(cpu, &mine);
+			pthread_setaffinity_np(thread, sizeof(mine), &mine); /* failure is harmless */
+			return;
+		}
+	}
+#endif
+
+} /* end pin_thread() */
+
+static void *worker(void *p_index)
+/* body of each worker thread: run each new task until told to quit */
+{
+	const int index = (int)(intptr_t)p_index; /* thread number, from 1 */
+	int seen = 0;							  /* last generation run */
+
+	for (;;)
+	{
+		seen = wait_while(&generation, seen, &sleepers);
+		if (pool_quit == LVB_TRUE)
+			break;
+		pool_task(pool_arg, index);
+		if (__atomic_sub_fetch(&pending, 1, __ATOMIC_SEQ_CST) == 0)
+		{
+			if (__atomic_load_n(&caller_asleep, __ATOMIC_SEQ_CST) > 0)
+				futex_wake(&pending);
+		}
+	}
+	return NULL;
+
+} /* end worker() */
+
+void pool_pause(long round)
+/* wait a little, in round round of waiting for another thread of the pool
+ * from inside a task: spin at first, then give way */
+{
+	if (round < spins)
+		pool_relax();
+	else
+		sched_yield();
+
+} /* end pool_pause() */
+
+void pool_create(int n_threads)
+/* start a pool of n_threads threads, counting the caller; any earlier pool
+ * is stopped first */
+{
+	int i; /* loop counter */
+
+	pool_destroy();
+	if (n_threads < 2)
+		return;
+	workers = (pthread_t *)alloc((n_threads - 1) * sizeof(pthread_t), "worker threads");
+	pool_quit = LVB_FALSE;
+	generation = 0;
+	pending = 0;
+
+	/* with more threads than processors, a spinning thread only delays the
+	 * one it waits for */
+	spins = (n_threads <= usable_processors()) ? POOL_SPINS : 0;
+	for (i = 1; i < n_threads; i++)
+	{
+		if (pthread_create(&workers[i - 1], NULL, worker, (void *)(intptr_t)i) != 0)
+			crash("cannot start worker thread %d", i);
+		pin_thread(workers[i - 1], i, n_threads);
+	}
+	pool_size = n_threads;
+
+} /* end pool_create() */
+
+static void start_generation(void)
+/* let the workers run the task that has been set up */
+{
+	__atomic_store_n(&pending, pool_size - 1, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&generation, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST) > 0)
+		futex_wake(&generation);
+
+} /* end start_generation() */
+
+void pool_run(Pool_task task, void *arg)
+/* run task(arg, thread) on every thread of the pool, returning once all
+ * have finished; task memory written before the call is seen by all
+ * threads, and all memory written by the task is seen on return */
+{
+	int left; /* workers still running */
+
+	if (pool_size < 2)
+	{
+		task(arg, 0);
+		return;
+	}
+	pool_task = task;
+	pool_arg = arg;
+	start_generation();
+	task(arg, 0);
+	left = __atomic_load_n(&pending, __ATOMIC_ACQUIRE);
+	while (left != 0)
+		left = wait_while(&pending, left, &caller_asleep);
+
+} /* end pool_run() */
+
+void pool_destroy(void)
+/* stop and join the workers, if any */
+{
+	int i; /* loop counter */
+
+	if (workers == NULL)
+		return;
+	pool_quit = LVB_TRUE;
+	start_generation();
+	for (i = 1; i < pool_size; i++)
+		pthread_join(workers[i - 1], NULL);
+	free(workers);
+	workers = NULL;
+	pool_size = 1;
+
+} /* end pool_destroy() */
+
+int pool_threads(void)
+/* return the number of threads in the pool, counting the caller */
+{
+	return pool_size;
+
+} /* end pool_threads() */
@@ -0,0 +1,180 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro, and Maximilian Strobl
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl,
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+ 
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "src/LVB.h"
+#include "src/FitchKernel.h"
+
+/* Test for DNAToBinary(). Encodes a random matrix of every allowed
+ * symbol, in blocks of many lengths so that every amount of padding is
+ * met, with each Fitch kernel this CPU supports and with one and several
+ * threads, and checks every word against a plain encoding of each
+ * character in turn. */
+
+#define N_ROWS 9		/* rows of matrix */
+#define N_BLOCKS 40		/* blocks of columns */
+#define N_THREADS 4		/* threads for threaded encoding */
+#define SEED 7301		/* arbitrary seed */
+
+static const char symbols[] = "ACGTUYRWSKMBDHVNX?-"; /* every symbol allowed */
+
+static Lvb_bit_length plain_stateset(char base)
+/* return the state set of base, one symbol at a time */
+{
+    if (base == 'A') return A_BIT;
+    if (base == 'C') return C_BIT;
+    if (base == 'G') return G_BIT;
+    if ((base == 'T') || (base == 'U')) return T_BIT;
+    if (base == 'Y') return C_BIT | T_BIT;
+    if (base == 'R') return A_BIT | G_BIT;
+    if (base == 'W') return A_BIT | T_BIT;
+    if (base == 'S') return C_BIT | G_BIT;
+    if (base == 'K') return T_BIT | G_BIT;
+    if (base == 'M') return C_BIT | A_BIT;
+    if (base == 'B') return C_BIT | G_BIT | T_BIT;
+    if (base == 'D') return A_BIT | G_BIT | T_BIT;
+    if (base == 'H') return A_BIT | C_BIT | T_BIT;
+    if (base == 'V') return A_BIT | C_BIT | G_BIT;
+    return A_BIT | C_BIT | G_BIT | T_BIT; /* N, X, ?, - */
+}
+
+int main(void)
+{
+    Dataptr MSA;			/* data MSA */
+    Lvb_bit_length **enc_mat;		/* encoded data MSA */
+    Lvb_bit_length word;		/* word expected */
+    int kernels[] = { FITCH_KERNEL_SCALAR, FITCH_KERNEL_AVX2 }; /* kernels to try */
+    int kernel;				/* loop counter */
+    int threads;			/* threads for encoding */
+    long i, j, k, b;			/* loop counters */
+    long col;				/* column of character */
+    Lvb_bool all_match = LVB_TRUE;	/* every word was right */
+
+    lvb_initialize();
+    rinit(SEED);
+
+    /* blocks of 1 to N_BLOCKS columns, so every amount of padding is met,
+     * and a long one for the two-word path */
+    MSA = (Dataptr) alloc(sizeof(DataStructure), "data structure");
+    MSA->n = N_ROWS;
+    MSA->n_blocks = N_BLOCKS;
+    MSA->block_col = (long *) alloc((N_BLOCKS + 1) * sizeof(long), "block columns");
+    MSA->block_word = (long *) alloc((N_BLOCKS + 1) * sizeof(long), "block words");
+    MSA->block_weight = (long *) alloc(N_BLOCKS * sizeof(long), "block weights");
+    MSA->block_col[0] = 0;
+    MSA->block_word[0] = 0;
+    for (b = 0; b < N_BLOCKS; b++)
+    {
+        long cols = (b == N_BLOCKS - 1) ? 1000 : b + 1; /* columns in block */
+
+        MSA->block_col[b + 1] = MSA->block_col[b] + cols;
+        MSA->block_word[b + 1] = MSA->block_word[b] + (cols + LENGTH_WORD - 1) / LENGTH_WORD;
+        MSA->block_weight[b] = b + 1;
+    }
+    MSA->m = MSA->block_col[N_BLOCKS];
+    MSA->nwords = MSA->block_word[N_BLOCKS];
+    MSA->bytes = MSA->nwords * sizeof(Lvb_bit_length);
+
+    MSA->row = (char **) alloc(N_ROWS * sizeof(char *), "rows");
+    MSA->rowtitle = (char **) alloc(N_ROWS * sizeof(char *), "row titles");
+    enc_mat = (Lvb_bit_length **) alloc(N_ROWS * sizeof(Lvb_bit_length *), "state sets");
+    for (i = 0; i < N_ROWS; i++)
+    {
+        MSA->row[i] = (char *) alloc(MSA->m + 1, "row");
+        for (k = 0; k < MSA->m; k++)
+            MSA->row[i][k] = symbols[randpint(sizeof(symbols) - 2)];
+        MSA->row[i][MSA->m] = '\0';
+        MSA->rowtitle[i] = (char *) alloc(8, "row title");
+        sprintf(MSA->rowtitle[i], "r%ld", i);
+        enc_mat[i] = (Lvb_bit_length *) alloc(MSA->bytes, "state sets");
+    }
+
+    for (kernel = 0; kernel < 2; kernel++)
+    {
+        if (fitch_kernel_supported(kernels[kernel]) == LVB_FALSE)
+            continue;
+        fitch_kernel_select(kernels[kernel]);
+        for (threads = 1; threads <= N_THREADS; threads += N_THREADS - 1)
+        {
+            for (i = 0; i < N_ROWS; i++)
+                memset(enc_mat[i], 0, MSA->bytes);
+            DNAToBinary(MSA, enc_mat, threads);
+            for (i = 0; i < N_ROWS; i++)
+            {
+                for (b = 0; b < N_BLOCKS; b++)
+                {
+                    for (j = MSA->block_word[b]; j < MSA->block_word[b + 1]; j++)
+                    {
+                        word = 0U;
+                        for (k = 0; k < LENGTH_WORD; k++)
+                        {
+                            col = MSA->block_col[b] + (j - MSA->block_word[b]) * LENGTH_WORD + k;
+                            word |= ((col < MSA->block_col[b + 1]) ? plain_stateset(MSA->row[i][col]) : NIBBLE_MASK)
+                                << (k * NIBBLE_WIDTH);
+                        }
+                        if (enc_mat[i][j] != word)
+                            all_match = LVB_FALSE;
+                    }
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < N_ROWS; i++)
+        free(enc_mat[i]);
+    free(enc_mat);
+    rowfree(MSA);
+    blockfree(MSA);
+    free(MSA);
+
+    if (all_match == LVB_TRUE)
+    {
+        printf("test passed\n");
+	return EXIT_SUCCESS;
+    }
+    else
+    {
+        printf("test failed\n");
+	return EXIT_FAILURE;
+    }
+}
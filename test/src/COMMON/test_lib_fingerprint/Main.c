@@ -0,0 +1,136 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro, and Maximilian Strobl
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl,
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+ 
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "src/LVB.h"
+
+/* Test for TreeFingerprint(). Makes many random rearrangements of a random
+ * tree and checks that the fingerprint of each tree is the same from every
+ * root, and that it matches the fingerprint of the starting tree exactly
+ * when their split bitsets match. The tree is put back as it started now
+ * and then, so that matches are seen. */
+
+#define N_OBJS 70		/* objects in tree, over one word of splits */
+#define LOOP_CNT 5000		/* rearrangements to try */
+#define SEED 4127		/* arbitrary seed */
+
+int main(void)
+{
+    Dataptr MSA;			/* minimal data MSA */
+    TREESTACK_TREE_NODES *tree;		/* tree changed in place */
+    TREESTACK_TREE_NODES *copy;		/* tree re-rooted */
+    TREESTACK_TREE_NODES *first;	/* starting tree */
+    Lvb_bit_length *splits;		/* splits of starting tree */
+    Lvb_fingerprint start;		/* fingerprint of starting tree */
+    Lvb_fingerprint now;		/* fingerprint of current tree */
+    Lvb_fingerprint rerooted;		/* fingerprint from another root */
+    long i;				/* loop counter */
+    long root = 0;			/* root of tree */
+    long same = 0;			/* trees found with the starting topology */
+    Lvb_bool all_match = LVB_TRUE;	/* every check passed */
+
+    lvb_initialize();
+    rinit(SEED);
+
+    MSA = (Dataptr) alloc(sizeof(DataStructure), "data structure");
+    MSA->n = N_OBJS;
+    MSA->numberofpossiblebranches = 2 * N_OBJS - 3;
+    MSA->nsets = N_OBJS - 3;
+    MSA->split_words = (N_OBJS + NUMBER_OF_BITS - 1) / NUMBER_OF_BITS;
+    MSA->nwords = 1;
+    MSA->bytes = sizeof(Lvb_bit_length);
+    MSA->tree_bytes = tree_bytes(MSA);
+
+    tree = treealloc(MSA, LVB_TRUE);
+    copy = treealloc(MSA, LVB_TRUE);
+    first = treealloc(MSA, LVB_TRUE);
+    splits = (Lvb_bit_length *) alloc(MSA->nsets * MSA->split_words * sizeof(Lvb_bit_length), "splits");
+    PullRandomTree(MSA, tree);
+    treecopy(MSA, first, tree, LVB_TRUE);
+    makesets(MSA, tree, root);
+    copy_splits(MSA, splits);
+    start = TreeFingerprint(MSA, tree, root);
+
+    for (i = 0; i < LOOP_CNT; i++)
+    {
+        /* go back to the start now and then, and otherwise rearrange */
+        if ((i % 10) == 0)
+            treecopy(MSA, tree, first, LVB_TRUE);
+        else if ((i % 3) == 0)
+            mutate_nni(MSA, tree, root, NULL);
+        else if ((i % 3) == 1)
+            mutate_spr(MSA, tree, root, NULL);
+        else
+            mutate_tbr(MSA, tree, root, NULL);
+        now = TreeFingerprint(MSA, tree, root);
+
+        treecopy(MSA, copy, tree, LVB_TRUE);
+        lvb_reroot(MSA, copy, root, 1 + i % (N_OBJS - 1), LVB_TRUE);
+        rerooted = TreeFingerprint(MSA, copy, 1 + i % (N_OBJS - 1));
+        if (!(rerooted == now))
+            all_match = LVB_FALSE;
+
+        makesets(MSA, tree, root);
+        if ((splitscmp(MSA, splits) == 0) != (now == start))
+            all_match = LVB_FALSE;
+        if (now == start)
+            same++;
+    }
+
+    free(splits);
+    free(first);
+    free(copy);
+    free(tree);
+    free(MSA);
+
+    if ((all_match == LVB_TRUE) && (same > 0))
+    {
+        printf("test passed\n");
+	return EXIT_SUCCESS;
+    }
+    else
+    {
+        printf("test failed (%ld trees as at start)\n", same);
+	return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,118 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro, and Maximilian Strobl
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl,
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+ 
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "src/LVB.h"
+
+/* Test for the Philox generator. Checks philox4x32() against known answers
+ * from the Random123 distribution, that deviates lie in [0, 1), that a
+ * stream does not depend on how far its parent has got, that streams
+ * differ, and that uni_get() and uni_set() repeat a sequence. */
+
+#define LOOP_CNT 100000		/* deviates compared */
+#define SEED 40000		/* arbitrary seed */
+
+int main(void)
+{
+    static const uint32_t zero[4] = {0U, 0U, 0U, 0U};
+    static const uint32_t ones[4] = {0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU};
+    static const uint32_t zero_answer[4] = {0x6627E8D5U, 0xE169C58DU, 0xBC57AC4CU, 0x9B00DBD8U};
+    static const uint32_t ones_answer[4] = {0x408F276DU, 0x41C83B0EU, 0xA20BC7C6U, 0x6D5451FDU};
+    uint32_t out[4];			/* Philox block */
+    Rng parent;				/* first stream */
+    Rng child_1, child_2;		/* stream 1, made at different times */
+    Rng other;				/* stream 2 */
+    Rng saved;				/* saved generator */
+    double *plain;			/* sequence without saving */
+    long i;				/* loop counter */
+    long differ = 0;			/* deviates of streams 1 and 2 that differ */
+    Lvb_bool all_ok = LVB_TRUE;		/* all checks passed */
+
+    lvb_initialize();
+
+    philox4x32(zero, zero, out);
+    if (memcmp(out, zero_answer, sizeof(out)) != 0)
+        all_ok = LVB_FALSE;
+    philox4x32(ones, ones, out);
+    if (memcmp(out, ones_answer, sizeof(out)) != 0)
+        all_ok = LVB_FALSE;
+
+    rng_init(&parent, RNG_PHILOX, SEED);
+    rng_split(&child_1, &parent, 1);
+    for (i = 0; i < 1000; i++)
+        (void) rng_uni(&parent);
+    rng_split(&child_2, &parent, 1);
+    rng_split(&other, &parent, 2);
+    for (i = 0; i < LOOP_CNT; i++)
+    {
+        double d = rng_uni(&child_1);
+        if ((d < 0.0) || (d >= 1.0) || (d != rng_uni(&child_2)))
+            all_ok = LVB_FALSE;
+        if (d != rng_uni(&other))
+            differ++;
+    }
+    if (differ < LOOP_CNT - 10)
+        all_ok = LVB_FALSE;
+
+    plain = (double *) alloc(LOOP_CNT * sizeof(double), "plain sequence");
+    uni_set(&parent);
+    uni_get(&saved);
+    for (i = 0; i < LOOP_CNT; i++)
+        plain[i] = uni();
+    uni_set(&saved);
+    for (i = 0; i < LOOP_CNT; i++)
+        if (uni() != plain[i])
+            all_ok = LVB_FALSE;
+    free(plain);
+
+    if (all_ok == LVB_TRUE)
+    {
+        printf("test passed\n");
+	return EXIT_SUCCESS;
+    }
+    else
+    {
+        printf("test failed\n");
+	return EXIT_FAILURE;
+    }
+}
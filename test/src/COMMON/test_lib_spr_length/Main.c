@@ -0,0 +1,151 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro, and Maximilian Strobl
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl,
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+ 
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "src/LVB.h"
+#include "src/MemoryOperations.h"
+
+/* Test for spr_length() and tbr_length(). Scores many random SPR and TBR
+ * rearrangements of a random tree from its up-pass statesets, without
+ * making them, then makes each one and checks getplen() gives the same
+ * length. Every other rearrangement is kept, so that later ones start
+ * from new trees. Columns are compressed into weighted patterns, so that
+ * weights are allowed for too. */
+
+#define LOOP_CNT 20000		/* rearrangements to try */
+#define SEED 4231		/* arbitrary seed */
+
+int main(void)
+{
+    Dataptr MSA;			/* data MSA */
+    Parameters rcstruct;		/* configurable parameters */
+    TREESTACK_TREE_NODES *tree;		/* tree changed in place */
+    Lvb_bit_length **enc_mat;		/* encoded data MSA */
+    Undo_log *undo;			/* record of rearrangement */
+    Uppass_sets *up;			/* up-pass statesets of tree */
+    long *p_todo_arr;			/* scratch for getplen() */
+    long *p_todo_arr_sum_changes;	/* scratch for getplen() */
+    long i;				/* loop counter */
+    long root = 0;			/* root of tree */
+    long length;			/* length of tree */
+    long scored;			/* length found without the rearrangement */
+    long src, dest, newroot;		/* rearrangement */
+    Lvb_bool all_match = LVB_TRUE;	/* every length was right */
+
+    lvb_initialize();
+    defaults_params(&rcstruct);
+    rcstruct.n_processors_available = 1;
+    rcstruct.compress_patterns = LVB_TRUE;
+    rinit(SEED);
+
+    MSA = (Dataptr) alloc(sizeof(DataStructure), "data structure");
+    phylip_dna_matrin(rcstruct.file_name_in, rcstruct.n_file_format, MSA);
+    matchange(MSA, rcstruct);
+    calc_distribution_processors(MSA, rcstruct);
+
+    enc_mat = (Lvb_bit_length **) alloc(MSA->n * sizeof(Lvb_bit_length *), "state sets");
+    for (i = 0; i < MSA->n; i++)
+        enc_mat[i] = (Lvb_bit_length *) alloc(MSA->bytes, "state sets");
+    DNAToBinary(MSA, enc_mat, rcstruct.n_processors_available);
+
+    tree = treealloc(MSA, LVB_TRUE);
+    PullRandomTree(MSA, tree);
+    ss_init(MSA, tree, enc_mat);
+    undo = undo_alloc(MSA);
+    up = uppass_alloc(MSA, NULL);
+    alloc_memory_to_getplen(MSA, &p_todo_arr, &p_todo_arr_sum_changes);
+    length = getplen(MSA, tree, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes);
+
+    for (i = 0; i < LOOP_CNT; i++)
+    {
+        if (up->valid == LVB_FALSE)
+            uppass_fill(MSA, tree, root, up);
+        undo_begin(undo);
+        if ((i % 4) < 2)
+        {
+            spr_choose(MSA, tree, root, &src, &dest);
+            scored = spr_length(MSA, tree, up, root, length, src, dest, LONG_MAX);
+            spr_apply(MSA, tree, root, src, dest, undo);
+        }
+        else
+        {
+            tbr_choose(MSA, tree, root, &src, &dest, &newroot);
+            scored = tbr_length(MSA, tree, up, root, length, src, dest, newroot, LONG_MAX);
+            tbr_apply(MSA, tree, root, src, dest, newroot, undo);
+        }
+        if (scored != getplen(MSA, tree, rcstruct, root, p_todo_arr, p_todo_arr_sum_changes))
+            all_match = LVB_FALSE;
+
+        if ((i % 2) == 0)
+        {
+            undo_commit(undo);
+            length = scored;
+            up->valid = LVB_FALSE;
+        }
+        else
+            undo_rollback(MSA, undo, tree);
+    }
+
+    free_memory_to_getplen(&p_todo_arr, &p_todo_arr_sum_changes);
+    uppass_free(up);
+    undo_free(undo);
+    free(tree);
+    for (i = 0; i < MSA->n; i++)
+        free(enc_mat[i]);
+    free(enc_mat);
+    pool_destroy();
+    rowfree(MSA);
+    blockfree(MSA);
+    free(MSA);
+
+    if (all_match == LVB_TRUE)
+    {
+        printf("test passed\n");
+	return EXIT_SUCCESS;
+    }
+    else
+    {
+        printf("test failed\n");
+	return EXIT_FAILURE;
+    }
+}
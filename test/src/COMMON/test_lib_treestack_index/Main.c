@@ -0,0 +1,152 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro, and Maximilian Strobl
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl,
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+ 
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "src/LVB.h"
+
+/* Test for the tree stack index. Pushes many random trees, of few enough
+ * objects that some topologies repeat, and checks that exactly the new
+ * topologies go on the stack, as found by comparing splits of every pair;
+ * that re-rooted copies are found; that trees popped off are no longer
+ * found while the rest still are; and that a cleared stack takes every
+ * topology again. */
+
+#define N_OBJS 8		/* objects in tree */
+#define N_TREES 600		/* random trees */
+#define SEED 3301		/* arbitrary seed */
+
+int main(void)
+{
+    Dataptr MSA;			/* minimal data MSA */
+    TREESTACK stack;			/* stack under test */
+    TREESTACK_TREE_NODES *tree[N_TREES];	/* random trees */
+    TREESTACK_TREE_NODES *copy;		/* tree re-rooted or popped */
+    Lvb_bit_length *splits;		/* splits of every tree */
+    long split_longs;			/* words of splits per tree */
+    long distinct = 0;			/* distinct topologies */
+    long pushed = 0;			/* trees pushed */
+    long root;				/* root of popped tree */
+    long i;				/* loop counter */
+    long j;				/* loop counter */
+    Lvb_bool all_match = LVB_TRUE;	/* every check passed */
+
+    lvb_initialize();
+    rinit(SEED);
+
+    MSA = (Dataptr) alloc(sizeof(DataStructure), "data structure");
+    MSA->n = N_OBJS;
+    MSA->numberofpossiblebranches = 2 * N_OBJS - 3;
+    MSA->nsets = N_OBJS - 3;
+    MSA->split_words = (N_OBJS + NUMBER_OF_BITS - 1) / NUMBER_OF_BITS;
+    MSA->nwords = 1;
+    MSA->bytes = sizeof(Lvb_bit_length);
+    MSA->tree_bytes = tree_bytes(MSA);
+    MSA->tree_bytes_without_sitestate = tree_bytes_without_sitestate(MSA);
+
+    split_longs = MSA->nsets * MSA->split_words;
+    splits = (Lvb_bit_length *) alloc(N_TREES * split_longs * sizeof(Lvb_bit_length), "splits");
+    copy = treealloc(MSA, LVB_TRUE);
+    for (i = 0; i < N_TREES; i++)
+    {
+        tree[i] = treealloc(MSA, LVB_TRUE);
+        PullRandomTree(MSA, tree[i]);
+        makesets(MSA, tree[i], 0);
+        copy_splits(MSA, splits + i * split_longs);
+        for (j = 0; j < i; j++)
+            if (memcmp(splits + i * split_longs, splits + j * split_longs, split_longs * sizeof(Lvb_bit_length)) == 0)
+                break;
+        if (j == i)
+            distinct++;
+    }
+
+    /* each topology goes on once, and re-rooted copies are then found */
+    stack = CreateNewTreestack();
+    for (i = 0; i < N_TREES; i++)
+        pushed += CompareTreeToTreestack(MSA, &stack, tree[i], 0, LVB_FALSE);
+    if ((pushed != distinct) || (stack.next != distinct))
+        all_match = LVB_FALSE;
+    for (i = 0; i < N_TREES; i++)
+    {
+        treecopy(MSA, copy, tree[i], LVB_FALSE);
+        lvb_reroot(MSA, copy, 0, 1 + i % (N_OBJS - 1), LVB_FALSE);
+        if (CompareTreeToTreestack(MSA, &stack, copy, 1 + i % (N_OBJS - 1), LVB_FALSE) != 0)
+            all_match = LVB_FALSE;
+    }
+
+    /* popped trees are gone, the rest are still there */
+    for (i = 0; i < distinct / 2; i++)
+    {
+        PullTreefromTreestack(MSA, copy, &root, &stack, LVB_FALSE);
+        if (FindTreeInTreestack(MSA, &stack, copy, root) != -1)
+            all_match = LVB_FALSE;
+    }
+    for (i = 0; i < stack.next; i++)
+        if (FindTreeInTreestack(MSA, &stack, stack.stack[i].tree, stack.stack[i].root) != i)
+            all_match = LVB_FALSE;
+
+    /* a cleared stack takes every topology again */
+    ClearTreestack(&stack);
+    pushed = 0;
+    for (i = N_TREES - 1; i >= 0; i--)
+        pushed += CompareTreeToTreestack(MSA, &stack, tree[i], 0, LVB_FALSE);
+    if (pushed != distinct)
+        all_match = LVB_FALSE;
+
+    FreeTreestackMemory(MSA, &stack);
+    for (i = 0; i < N_TREES; i++)
+        free(tree[i]);
+    free(copy);
+    free(splits);
+    free(MSA);
+
+    if ((all_match == LVB_TRUE) && (distinct < N_TREES) && (distinct > TREESTACK_INDEX_MIN))
+    {
+        printf("test passed\n");
+	return EXIT_SUCCESS;
+    }
+    else
+    {
+        printf("test failed (%ld distinct trees)\n", distinct);
+	return EXIT_FAILURE;
+    }
+}
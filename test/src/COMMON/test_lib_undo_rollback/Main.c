@@ -0,0 +1,142 @@
+/* LVB
+
+(c) Copyright 2003-2012 by Daniel Barker.
+(c) Copyright 2013, 2014 by Daniel Barker and Maximilian Strobl.
+(c) Copyright 2014 by Daniel Barker, Miguel Pinheiro, and Maximilian Strobl
+(c) Copyright 2015 by Daniel Barker, Miguel Pinheiro, Maximilian Strobl,
+and Chris Wood.
+(c) Copyright 2019 by Daniel Barker, Miguel Pinheiro, Joseph Guscott,
+Fernando Guntoro, Maximilian Strobl and Chris Wood.
+(c) Copyright 2022 by Joseph Guscott, Daniel Barker, Miguel Pinheiro,
+Chang Sik Kim, Fernando Guntoro, Maximilian Strobl, Chris Wood
+and Martyn Winn.
+(c) Copyright 2022 by Joseph Guscott and Daniel Barker.
+(c) Copyright 2023 by Joseph Guscott and Daniel Barker.
+
+All rights reserved.
+ 
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "src/LVB.h"
+
+/* Test for the undo log. Makes many random in-place rearrangements of a
+ * random tree, overwrites the statesets of every "dirty" branch as
+ * getplen() would, then rolls back, and checks that the tree is exactly
+ * as it was, statesets included. Every other rearrangement is committed
+ * instead, so that later ones start from new trees. */
+
+#define N_OBJS 40		/* objects in tree */
+#define NWORDS 3		/* stateset words per branch */
+#define LOOP_CNT 20000		/* rearrangements to try */
+#define SEED 7001		/* arbitrary seed */
+
+int main(void)
+{
+    Dataptr MSA;			/* minimal data MSA */
+    TREESTACK_TREE_NODES *tree;		/* tree changed in place */
+    TREESTACK_TREE_NODES *copy;		/* tree as it was */
+    Undo_log *undo;			/* record of rearrangement */
+    long i;				/* loop counter */
+    long j;				/* loop counter */
+    long k;				/* loop counter */
+    long root = 0;			/* root of tree */
+    Lvb_bool all_match = LVB_TRUE;	/* every rollback was exact */
+
+    lvb_initialize();
+    rinit(SEED);
+
+    MSA = (Dataptr) alloc(sizeof(DataStructure), "data structure");
+    MSA->n = N_OBJS;
+    MSA->numberofpossiblebranches = 2 * N_OBJS - 3;
+    MSA->nwords = NWORDS;
+    MSA->bytes = NWORDS * sizeof(Lvb_bit_length);
+    MSA->tree_bytes = tree_bytes(MSA);
+
+    tree = treealloc(MSA, LVB_TRUE);
+    copy = treealloc(MSA, LVB_TRUE);
+    undo = undo_alloc(MSA);
+    PullRandomTree(MSA, tree);
+    for (j = 0; j < MSA->numberofpossiblebranches; j++)
+        for (k = 0; k < NWORDS; k++)
+            tree[j].sitestate[k] = (Lvb_bit_length) (j * NWORDS + k + 1);
+
+    for (i = 0; i < LOOP_CNT; i++)
+    {
+        treecopy(MSA, copy, tree, LVB_TRUE);
+        undo_begin(undo);
+        if ((i % 3) == 0)
+            mutate_nni(MSA, tree, root, undo);
+        else if ((i % 3) == 1)
+            mutate_spr(MSA, tree, root, undo);
+        else
+            mutate_tbr(MSA, tree, root, undo);
+
+        /* do what getplen() would do to "dirty" branches */
+        for (j = MSA->n; j < MSA->numberofpossiblebranches; j++)
+        {
+            if (tree[j].sitestate[0] == 0U)
+            {
+                for (k = 0; k < NWORDS; k++)
+                    tree[j].sitestate[k] = (Lvb_bit_length) (i + 1) << 32 | (j * NWORDS + k + 1);
+                tree[j].changes = i;
+                tree[j].sum_changes = i;
+            }
+        }
+
+        if ((i % 2) == 0)
+        {
+            undo_commit(undo);
+            continue;
+        }
+        undo_rollback(MSA, undo, tree);
+        for (j = 0; j < MSA->numberofpossiblebranches; j++)
+        {
+            if ((tree[j].parent != copy[j].parent) || (tree[j].left != copy[j].left)
+             || (tree[j].right != copy[j].right) || (tree[j].changes != copy[j].changes)
+             || (tree[j].sum_changes != copy[j].sum_changes)
+             || (memcmp(tree[j].sitestate, copy[j].sitestate, MSA->bytes) != 0))
+                all_match = LVB_FALSE;
+        }
+    }
+
+    undo_free(undo);
+    free(copy);
+    free(tree);
+    free(MSA);
+
+    if (all_match == LVB_TRUE)
+    {
+        printf("test passed\n");
+	return EXIT_SUCCESS;
+    }
+    else
+    {
+        printf("test failed\n");
+	return EXIT_FAILURE;
+    }
+}